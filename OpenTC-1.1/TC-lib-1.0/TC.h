@@ -81,9 +81,17 @@ typedef struct {
 typedef struct  {
   BIGNUM* e; /* public key */
   BIGNUM* n; /* public key */
+
+  BN_MONT_CTX* mont; /* Montgomery context of n, built on first use or by
+			TC_PK_Precompute -- Can be null */
+  BIGNUM* vfy;       /* R^-(e-2) mod n for the Montgomery radix R, built with
+			mont (see TC_verify) -- Can be null */
 } TC_PK; /* Key used by the signature verifier */
   
 
+struct TC_KEY_CACHE;     /* Defined in struct_func.c */
+struct TC_COMBINE_CACHE; /* Defined in combineSig.c */
+
 typedef struct  {
   int l;         /* total number of people */
   int k;         /* threshold */
@@ -100,6 +108,12 @@ typedef struct  {
   BIGNUM* si;    /* ith persons secret key -- Can be null */
 
   const EVP_MD* Hp;    /* hash pointer  */
+
+  struct TC_KEY_CACHE* cache;       /* Montgomery context of n and powers of
+				       v, built on first use or by
+				       TC_IND_Precompute -- Can be null */
+  struct TC_COMBINE_CACHE* combine; /* Constants of TC_Combine_Sigs, built on
+				       first use -- Can be null */
 } TC_IND;        /* The individual Key */     
 
 
@@ -167,6 +181,18 @@ int TC_Combine_Sigs_P2(TC_IND *key, BIGNUM *hM, TC_SIG *sig, BIGNUM *wexps, int
      using openssl > crypto > err(3)
   */
 
+int TC_Multi_Exp(BIGNUM *r, BIGNUM **bases, BIGNUM **exps, int count, const BIGNUM *m,
+    BN_MONT_CTX *mont, BN_CTX *ctx);
+  /* TC_Multi_Exp sets r to the product of bases[i]^exps[i] mod m, for i < count, with the
+     exponentiations done together: one squaring per exponent bit is shared by all of the bases.
+     An exponent may be negative, in which case the inverse of its base is used; all of the
+     negative terms together cost a single inversion. mont is the Montgomery context of m
+     (see openssl > crypto > bn(3)). This is used by TC_Combine_Sigs, and is meant for many
+     small exponents, which is what combining has.
+
+     Return value is 1 in case of success, 0 in case of an error (including a base with
+     no inverse).
+  */
 
 TC_DEALER* TC_generate(int bits, int l, int k, unsigned long e);
   /* TC_generate sets up the threshold signature system by generating the public keys, private keys
@@ -259,6 +285,10 @@ TC_IND *TC_get_ind(int index,TC_DEALER *tcd);
 TC_PK *TC_get_pub (TC_DEALER *tcd);
   /* Extracts the public key from tcd. Should be freed using TC_PK_free to prevent memory leaks */
 
+TC_PK *TC_PK_new(const BIGNUM *e, const BIGNUM *n);
+  /* Returns a public key with copies of e and n, or NULL on error. Should be freed using
+     TC_PK_free */
+
 TC_IND *TC_get_combine(TC_DEALER *tcd);
   /* Extracts the combine key from tcd. This key is similar the ind key except
      that it doesn't have the secret share and hence can only be used for combining
@@ -272,6 +302,46 @@ void TC_PK_free(TC_PK *tcpk);
 void TC_IND_free(TC_IND *tcind);
   /* Frees tcind. tcind can be a secret/private key or a combine key */
 
+void TC_Combine_Cache_free(struct TC_COMBINE_CACHE *cache);
+  /* Frees the constants TC_Combine_Sigs keeps with a key. Called by TC_IND_free */
+
+/* Precomputation. A process uses the same few keys for its whole life, so what only depends
+   on a key is computed once and kept with it: the Montgomery context of n for TC_IND and
+   TC_PK keys, and a table of powers of the verification key v for TC_IND keys. This is done
+   the first time a key is used, which is not safe if that first use can come from two threads
+   at once; call TC_IND_Precompute or TC_PK_Precompute when the key is loaded in that case.
+   A TC_PK with a small public exponent also keeps the constant that lets TC_verify work on
+   the signature without converting it to and from Montgomery form.
+   Scratch BIGNUMs come from a BN_CTX kept by each thread (TC_Thread_BN_CTX) rather than
+   from a new BN_CTX per call. */
+
+BN_CTX *TC_Thread_BN_CTX(void);
+  /* Returns the BN_CTX of the calling thread, creating it the first time. Callers must pair
+     BN_CTX_start with BN_CTX_end and never free it; it is freed when the thread exits.
+     Returns NULL if it cannot be allocated */
+
+int TC_IND_Precompute(TC_IND *key);
+  /* Builds the Montgomery context of key->n and the table of powers of key->v.
+     Returns 1 in case of success, 0 on error */
+
+int TC_PK_Precompute(TC_PK *pk);
+  /* Builds the Montgomery context of pk->n and the constant used by TC_verify. Returns 1 in
+     case of success, 0 on error */
+
+BN_MONT_CTX *TC_IND_Mont(TC_IND *key, BN_CTX *ctx);
+BN_MONT_CTX *TC_PK_Mont(TC_PK *pk, BN_CTX *ctx);
+  /* Return the Montgomery context of the key's modulus, building it the first time, or NULL
+     on error. The result may be passed to BN_mod_exp_mont (which accepts NULL too) */
+
+BIGNUM *TC_PK_Verify_Factor(TC_PK *pk, BN_CTX *ctx);
+  /* Returns pk->vfy, building it the first time, or NULL if pk->e is too large for TC_verify
+     to use it or on error */
+
+int TC_Exp_v(BIGNUM *r, const BIGNUM *exp, TC_IND *key, BN_CTX *ctx);
+  /* Sets r = v^exp mod n for the verification key v of key, using the precomputed powers
+     of v: about one multiplication per 4 bits of exp, and no squarings. Returns 1 in case
+     of success, 0 on error */
+
 TC_IND_SIG *TC_IND_SIG_new();
   /* Allocates and returns a new TC_IND_SIG struct. Should be freed using TC_IND_SIG_free */
 
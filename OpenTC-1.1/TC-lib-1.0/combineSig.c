@@ -29,6 +29,7 @@
  */
 
 
+#include <string.h>
 #include "TC.h"
 
 static int lambda(BIGNUM *answer, int i, int j, int *Set_S, BIGNUM *delta, BIGNUM *temp, BIGNUM *temp2, BIGNUM *temp3,BN_CTX *ctx) {
@@ -75,60 +76,260 @@ static int modified_BN_mod_exp(BIGNUM *r, BIGNUM *a, BIGNUM *b, const BIGNUM *m,
 }
 
 static int ret_error(TC_SIG *sig, int *Set_S, BN_CTX *ctx, int errno) {
-  if( *sig !=  NULL)
+  if( sig != NULL && *sig !=  NULL)
     BN_clear_free(*sig);
   if (Set_S != NULL)
     OPENSSL_free(Set_S);
   
   BN_CTX_end(ctx);
-  BN_CTX_free(ctx);
   
   return errno;
 }
 
+/* Combining. A threshold signature is
+ *   sig = w^p * x^q * (1/u if jacobi(hM,n) == -1),  w = prod_j sig_j^(2*lambda_j)
+ * where x is hM, or hM*u^e when its jacobi symbol is -1, and p*4 + q*e = 1.
+ * Since w is only used raised to p, all of this is a single product of
+ * powers of the k signature shares, hM, and u:
+ *   sig = prod_j sig_j^(2*lambda_j*p) * hM^q * (u^(e*q-1) if jacobi == -1)
+ * which TC_Multi_Exp computes with one shared chain of squarings. Everything
+ * but the bases depends only on the key (p, q, e*q-1, the Montgomery context
+ * of n) or on the key and the subset of signers (the exponents of the
+ * shares), so it is kept in key->combine. A key should therefore not be
+ * used by TC_Combine_Sigs from two threads at once. */
+
+#define TC_LAMBDA_MEMO 16   /* Signer subsets remembered per key */
+
+struct TC_COMBINE_CACHE {
+  BN_MONT_CTX *mont;  /* Montgomery context of n, owned by key->cache */
+  BIGNUM *delta;      /* l! */
+  BIGNUM *q;          /* p*4 + q*e = 1 */
+  BIGNUM *p;
+  BIGNUM *u_exp;      /* e*q - 1 */
+  int next;           /* Next memo entry to replace */
+  struct {
+    int *Set_S;       /* The k signers, or NULL if the entry is unused */
+    BIGNUM **exps;    /* 2*lambda*p for each of them */
+  } memo[TC_LAMBDA_MEMO];
+};
+
+void TC_Combine_Cache_free(struct TC_COMBINE_CACHE *cache) {
+  int i, j;
+
+  if (cache == NULL) return;
+  if (cache->delta != NULL) BN_free(cache->delta);
+  if (cache->q != NULL) BN_free(cache->q);
+  if (cache->p != NULL) BN_free(cache->p);
+  if (cache->u_exp != NULL) BN_free(cache->u_exp);
+  for (i=0;i<TC_LAMBDA_MEMO;i++) {
+    if (cache->memo[i].Set_S == NULL) continue;
+    for (j=0;cache->memo[i].Set_S[j]!=-1;j++)
+      if (cache->memo[i].exps[j] != NULL) BN_free(cache->memo[i].exps[j]);
+    OPENSSL_free(cache->memo[i].exps);
+    OPENSSL_free(cache->memo[i].Set_S);
+  }
+  OPENSSL_free(cache);
+}
+
+/* Returns the combine constants of key, computing them the first time */
+static struct TC_COMBINE_CACHE *combine_cache(TC_IND *key, BN_CTX *ctx) {
+  struct TC_COMBINE_CACHE *cc;
+  BIGNUM *a, *b, *quot, *c, *r, *s, *t;
+  int j, ok;
+
+  if (key->combine != NULL) return key->combine;
+
+  if ((cc = (struct TC_COMBINE_CACHE *)OPENSSL_malloc(sizeof(struct TC_COMBINE_CACHE))) == NULL) return NULL;
+  memset(cc, 0, sizeof(struct TC_COMBINE_CACHE));
+
+  BN_CTX_start(ctx);
+  a = BN_CTX_get(ctx);
+  b = BN_CTX_get(ctx);
+  quot = BN_CTX_get(ctx);
+  c = BN_CTX_get(ctx);
+  r = BN_CTX_get(ctx);
+  s = BN_CTX_get(ctx);
+  t = BN_CTX_get(ctx);
+
+  ok = (t != NULL &&
+        (cc->mont = TC_IND_Mont(key, ctx)) != NULL &&
+        (cc->delta = BN_new()) != NULL &&
+        (cc->p = BN_new()) != NULL &&
+        (cc->q = BN_new()) != NULL &&
+        (cc->u_exp = BN_new()) != NULL &&
+        BN_one(cc->delta));
+
+  /* delta = l! */
+  for(j=2;ok && j<=(key->l);j++)
+    ok = BN_mul_word(cc->delta, j);
+
+  /* Extended Euclid on (e'=4, e) */
+  ok = ok && BN_set_word(a,4) && BN_copy(b,key->e) != NULL && 
+    BN_one(cc->p) && BN_zero(cc->q) && BN_zero(r) && BN_one(s);
+  while (ok && !BN_is_zero(b)) {
+    ok = (BN_div(quot, c, a, b, ctx) &&
+          BN_copy(a,b) != NULL && BN_copy(b,c) != NULL &&
+          BN_mul(t,quot,r,ctx) && BN_sub(t, cc->p, t) &&   /* new_r = p - quot*r */
+          BN_copy(cc->p,r) != NULL && BN_copy(r,t) != NULL &&
+          BN_mul(t,quot,s,ctx) && BN_sub(t, cc->q, t) &&   /* new_s = q - quot*s */
+          BN_copy(cc->q,s) != NULL && BN_copy(s,t) != NULL);
+  }
+
+  ok = ok && BN_mul(cc->u_exp, key->e, cc->q, ctx) && BN_sub_word(cc->u_exp, 1);
+  BN_CTX_end(ctx);
+
+  if (!ok) {
+    TC_Combine_Cache_free(cc);
+    return NULL;
+  }
+
+  key->combine = cc;
+  return cc;
+}
+
+/* Returns 2*lambda(0,j)*p for each signer j of Set_S, computing it the
+   first time this subset is seen */
+static BIGNUM **combine_exps(TC_IND *key, struct TC_COMBINE_CACHE *cc, int *Set_S, BN_CTX *ctx) {
+  BIGNUM *temp, *temp2, *temp3;
+  BIGNUM **exps;
+  int i, j, ok;
+
+  for (i=0;i<TC_LAMBDA_MEMO;i++) {
+    if (cc->memo[i].Set_S == NULL) continue;
+    for (j=0;j<key->k && cc->memo[i].Set_S[j]==Set_S[j];j++);
+    if (j == key->k) return cc->memo[i].exps;
+  }
+
+  /* Replace the oldest entry */
+  i = cc->next;
+  cc->next = (cc->next + 1) % TC_LAMBDA_MEMO;
+  if (cc->memo[i].Set_S != NULL) {
+    for (j=0;j<key->k;j++)
+      if (cc->memo[i].exps[j] != NULL) BN_free(cc->memo[i].exps[j]);
+    OPENSSL_free(cc->memo[i].exps);
+    OPENSSL_free(cc->memo[i].Set_S);
+    cc->memo[i].Set_S = NULL;
+  }
+
+  if ((exps=(BIGNUM **)OPENSSL_malloc((key->k)*sizeof(BIGNUM *)))==NULL) return NULL;
+  if ((cc->memo[i].Set_S=(int *)OPENSSL_malloc(((key->k)+1)*sizeof(int)))==NULL) {
+    OPENSSL_free(exps);
+    return NULL;
+  }
+  memcpy(cc->memo[i].Set_S, Set_S, ((key->k)+1)*sizeof(int));
+  cc->memo[i].exps = exps;
+  for (j=0;j<key->k;j++) exps[j] = NULL;
+
+  BN_CTX_start(ctx);
+  temp = BN_CTX_get(ctx);
+  temp2 = BN_CTX_get(ctx);
+  temp3 = BN_CTX_get(ctx);
+
+  ok = (temp3 != NULL);
+  for (j=0;ok && j<key->k;j++) {
+    ok = ((exps[j] = BN_new()) != NULL &&
+          lambda(exps[j], 0, Set_S[j], Set_S, cc->delta, temp, temp2, temp3, ctx) &&
+          BN_lshift1(exps[j], exps[j]) &&   /* 2*lambda */
+          BN_mul(exps[j], exps[j], cc->p, ctx));
+  }
+  BN_CTX_end(ctx);
+
+  if (!ok) {
+    /* Leave the entry unused */
+    for (j=0;j<key->k;j++)
+      if (exps[j] != NULL) BN_free(exps[j]);
+    OPENSSL_free(exps);
+    OPENSSL_free(cc->memo[i].Set_S);
+    cc->memo[i].Set_S = NULL;
+    return NULL;
+  }
+
+  return exps;
+}
+
+int TC_Multi_Exp(BIGNUM *r, BIGNUM **bases, BIGNUM **exps, int count, const BIGNUM *m,
+    BN_MONT_CTX *mont, BN_CTX *ctx) {
+  BIGNUM **mb=NULL;
+  BIGNUM *acc[2];   /* Product of the positive, and of the negative, terms */
+  int started[2];
+  int i, bit, bits, side, ok;
+
+  if ((mb=(BIGNUM **)OPENSSL_malloc((count+1)*sizeof(BIGNUM *)))==NULL) return 0;
+
+  BN_CTX_start(ctx);
+  acc[0] = BN_CTX_get(ctx);
+  acc[1] = BN_CTX_get(ctx);
+  ok = (acc[1] != NULL);
+
+  /* Bases in Montgomery form */
+  bits = 0;
+  for (i=0;ok && i<count;i++) {
+    if ((mb[i] = BN_CTX_get(ctx)) == NULL) {
+      ok = 0;
+    } else if (BN_is_negative(bases[i]) || BN_ucmp(bases[i], m) >= 0) {
+      ok = BN_nnmod(mb[i], bases[i], m, ctx) &&
+        BN_to_montgomery(mb[i], mb[i], mont, ctx);
+    } else {
+      ok = BN_to_montgomery(mb[i], bases[i], mont, ctx);
+    }
+    if (BN_num_bits(exps[i]) > bits) bits = BN_num_bits(exps[i]);
+  }
+
+  /* Left to right, one squaring per bit for each accumulator in use */
+  started[0] = started[1] = 0;
+  for (bit=bits-1;ok && bit>=0;bit--) {
+    for (side=0;ok && side<2;side++)
+      if (started[side])
+        ok = BN_mod_mul_montgomery(acc[side], acc[side], acc[side], mont, ctx);
+    for (i=0;ok && i<count;i++) {
+      if (!BN_is_bit_set(exps[i], bit)) continue;
+      side = BN_is_negative(exps[i]) ? 1 : 0;
+      if (started[side]) {
+        ok = BN_mod_mul_montgomery(acc[side], acc[side], mb[i], mont, ctx);
+      } else {
+        ok = (BN_copy(acc[side], mb[i]) != NULL);
+        started[side] = 1;
+      }
+    }
+  }
+
+  if (ok) {
+    if (!started[0]) ok = BN_one(r);
+    else ok = BN_from_montgomery(r, acc[0], mont, ctx);
+  }
+  if (ok && started[1]) {
+    ok = BN_from_montgomery(acc[1], acc[1], mont, ctx) &&
+      BN_mod_inverse(acc[1], acc[1], m, ctx) != NULL &&
+      BN_mod_mul(r, r, acc[1], m, ctx);
+  }
+
+  BN_CTX_end(ctx);
+  OPENSSL_free(mb);
+  return ok;
+}
+
 int TC_Combine_Sigs(TC_IND_SIG **ind_sigs, TC_IND *key,  BIGNUM *hM, TC_SIG *sig, int checkproof) {
-  BIGNUM *w=NULL, *delta=NULL;
   BN_CTX *ctx=NULL;
-  BIGNUM *temp=NULL,*temp2=NULL,*temp3=NULL, *temp4=NULL;
-  BIGNUM *a=NULL, *b=NULL, *p=NULL, *q=NULL, *r=NULL, *s=NULL, *c=NULL, *quot=NULL, *new_r=NULL, *new_s=NULL;  
+  struct TC_COMBINE_CACHE *cc;
+  BIGNUM **exps, **mbases, **mexps;
   int *Set_S=NULL;
-  int j,j1;
-  int retJac;
+  int j,j1,count,set_len;
 
   *sig=NULL;
   
   /* Allocate everything */
-  if ((ctx=BN_CTX_new()) == NULL) return(TC_ALLOC_ERROR);
+  if ((ctx=TC_Thread_BN_CTX()) == NULL) return(TC_ALLOC_ERROR);
   BN_CTX_start(ctx);
   
-  w = BN_CTX_get(ctx);
-  delta = BN_CTX_get(ctx);
-  temp = BN_CTX_get(ctx);
-  temp2 = BN_CTX_get(ctx);
-  temp3 = BN_CTX_get(ctx);
-  temp4 = BN_CTX_get(ctx);
-  a = BN_CTX_get(ctx);
-  b = BN_CTX_get(ctx);
-  p = BN_CTX_get(ctx);
-  q = BN_CTX_get(ctx);
-  r = BN_CTX_get(ctx);
-  s = BN_CTX_get(ctx);
-  c = BN_CTX_get(ctx);
-  quot = BN_CTX_get(ctx);
-  new_r = BN_CTX_get(ctx);
-  if ((new_s = BN_CTX_get(ctx))== NULL) return(ret_error(sig, Set_S, ctx, TC_ALLOC_ERROR));
   if ((*sig = BN_new())==NULL) return (ret_error(sig, Set_S, ctx, TC_ALLOC_ERROR)); /* Users responsiblity to free this */
-  if ((Set_S=(int *)OPENSSL_malloc(((key->k)+1)*sizeof(int)))==NULL) return(ret_error(sig, Set_S, ctx, TC_ALLOC_ERROR));
+  /* Set_S (rounded up to keep the pointers aligned), then the bases and
+     exponents of the k+2 terms */
+  set_len = ((key->k)+2) & ~1;
+  if ((Set_S=(int *)OPENSSL_malloc(set_len*sizeof(int) + 2*((key->k)+2)*sizeof(BIGNUM *)))==NULL) return(ret_error(sig, Set_S, ctx, TC_ALLOC_ERROR));
+  mbases = (BIGNUM **)(Set_S + set_len);
+  mexps = mbases + (key->k)+2;
 
-
-  /* Compute delta */
-  if (!BN_one(delta)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-
-  for(j=2;j<=(key->l);j++) {
-    if (!BN_set_word(temp, j)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    if (!BN_mul(delta, delta, temp, ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  }
-  /* Delta computed */
+  if ((cc = combine_cache(key, ctx)) == NULL) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
 
   /* Compute the Set_S */
   j=0;
@@ -151,70 +352,24 @@ int TC_Combine_Sigs(TC_IND_SIG **ind_sigs, TC_IND *key,  BIGNUM *hM, TC_SIG *sig
   else
     return(ret_error(sig, Set_S, ctx, TC_NOT_ENOUGH_SIGS));
 
-  /* Compute w */
-  if (!BN_one(w)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  for (j=0;j<key->k;j++) {
-    if (!lambda(temp, 0, Set_S[j], Set_S, delta, temp2, temp3, temp4, ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    if (!BN_lshift1(temp, temp)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR)); // temp= temp*2
-    if (!modified_BN_mod_exp(temp2,ind_sigs[Set_S[j]-1]->sig,temp,key->n,ctx, temp3)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    if (!BN_mod_mul(w,w,temp2,key->n,ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  }
-
-  /* Use extended Euclidean Algorithm */
-  /* Initialisations */
-  if (!BN_set_word(a,4)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR)); /* a=e' */
-  if (!BN_copy(b,key->e)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR)); /* b = e */
-
-
-  if (!BN_one(p)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  if (!BN_zero(q)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  if (!BN_zero(r)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  if (!BN_one(s)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-
-  while (!BN_is_zero(b)) {
-    if (!BN_div(quot, c, a, b, ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    
-    if (!BN_copy(a,b)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    if (!BN_copy(b,c)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
+  if ((exps = combine_exps(key, cc, Set_S, ctx)) == NULL) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
 
-    if (!BN_mul(temp,quot,r,ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR)); /* new_r = p - quot*r */
-    if (!BN_sub(new_r, p, temp)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-
-    if (!BN_mul(temp,quot,s,ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR)); /* new_s = q - quot*s */
-    if (!BN_sub(new_s, q, temp)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-
-    if (!BN_copy(p,r)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR)); 
-    if (!BN_copy(q,s)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    if (!BN_copy(r,new_r)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR)); 
-    if (!BN_copy(s,new_s)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
+  /* sig = prod_j sig_j^(2*lambda_j*p) * hM^q [* u^(e*q-1)] */
+  for (count=0;count<key->k;count++) {
+    mbases[count] = ind_sigs[Set_S[count]-1]->sig;
+    mexps[count] = exps[count];
   }
-
-  /* p*e'+ q*e = a = gcd(e,e') = 1 */
-  /* y = w^p x^q ; this gives (y/u)^e = x */
-  if (!modified_BN_mod_exp(temp, w, p, key->n,ctx,temp3)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
- 
-  retJac = jacobi(hM,key->n);
-  
-  if (retJac == -1 ) {
-    if (!BN_mod_exp(temp4, key->u, key->e, key->n, ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    if (!BN_mod_mul(temp4, temp4, hM,key->n,ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  } else 
-    BN_copy(temp4,hM);
-
-  if (!modified_BN_mod_exp(temp2, temp4, q, key->n, ctx, temp3)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  if (!BN_mod_mul(temp, temp, temp2,key->n, ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  
-  /* sig = y/u */
-  if (retJac == -1) {
-    if (!BN_mod_inverse(temp2, key->u, key->n, ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-    if (!BN_mod_mul(*sig, temp, temp2, key->n,ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
-  } else {
-    BN_copy(*sig,temp);
+  mbases[count] = hM;
+  mexps[count++] = cc->q;
+  if (jacobi(hM,key->n) == -1) {
+    mbases[count] = key->u;
+    mexps[count++] = cc->u_exp;
   }
 
+  if (!TC_Multi_Exp(*sig, mbases, mexps, count, key->n, cc->mont, ctx)) return (ret_error(sig,Set_S, ctx, TC_BN_ARTH_ERROR));
+
   OPENSSL_free(Set_S);
   BN_CTX_end(ctx);
-  BN_CTX_free(ctx);
   
   return TC_NOERROR;
 }
@@ -227,7 +382,7 @@ int TC_Combine_Sigs_P1(TC_IND_SIG **ind_sigs, TC_IND *key, BIGNUM *hM, int check
   int j,j1;
   
   /* Allocate everything */
-  if ((ctx=BN_CTX_new()) == NULL) return(TC_ALLOC_ERROR);
+  if ((ctx=TC_Thread_BN_CTX()) == NULL) return(TC_ALLOC_ERROR);
   BN_CTX_start(ctx);
   
   w = BN_CTX_get(ctx);
@@ -279,7 +434,6 @@ int TC_Combine_Sigs_P1(TC_IND_SIG **ind_sigs, TC_IND *key, BIGNUM *hM, int check
   BN_copy(wexp,temp2);
 
   BN_CTX_end(ctx);
-  BN_CTX_free(ctx);
   
   return TC_NOERROR;
 }
@@ -293,7 +447,7 @@ int TC_Combine_Sigs_P2(TC_IND *key, BIGNUM *hM, TC_SIG *sig, BIGNUM *wexps, int
   int retJac;
 
   /* Allocate everything */
-  if ((ctx=BN_CTX_new()) == NULL) return(TC_ALLOC_ERROR);
+  if ((ctx=TC_Thread_BN_CTX()) == NULL) return(TC_ALLOC_ERROR);
   BN_CTX_start(ctx);
   
   w = BN_CTX_get(ctx);
@@ -372,7 +526,6 @@ int TC_Combine_Sigs_P2(TC_IND *key, BIGNUM *hM, TC_SIG *sig, BIGNUM *wexps, int
 
   OPENSSL_free(Set_S);
   BN_CTX_end(ctx);
-  BN_CTX_free(ctx);
   
   return TC_NOERROR;
 }
@@ -36,7 +36,6 @@
 
 static int ret_error_veri(BN_CTX *ctx, int errno) {
   BN_CTX_end(ctx);
-  BN_CTX_free(ctx);
   return errno;
 }
 
@@ -47,6 +46,7 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
   int retJacobi;
 
   BN_CTX *temp=NULL;
+  BN_MONT_CTX *mont;
   BIGNUM* x =NULL;  
   BIGNUM* xt =NULL;  
   BIGNUM* xiSq =NULL;  
@@ -62,7 +62,7 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
 
   signum--;
 
-  if ((temp=BN_CTX_new()) == NULL) return(TC_ALLOC_ERROR);
+  if ((temp=TC_Thread_BN_CTX()) == NULL) return(TC_ALLOC_ERROR);
   BN_CTX_start(temp);
   x = BN_CTX_get(temp);  
   xt = BN_CTX_get(temp);  
@@ -78,6 +78,7 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
   calcTemp6 = BN_CTX_get(temp);
   
   if(calcTemp6 == NULL) return (ret_error_veri(temp, TC_ALLOC_ERROR));
+  if((mont = TC_IND_Mont(tcind, temp)) == NULL) return (ret_error_veri(temp, TC_ALLOC_ERROR));
 
   /*0) x = _x if jacobi(_x,n) =1 
     x = _x*u^e if jacobi(_x,n) = -1*/
@@ -88,7 +89,7 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
   case 1: if (!BN_copy(x,_x)) return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
     break;
   case -1: 
-    if (!(BN_mod_exp(calcTemp,tcind->u,tcind->e,tcind->n,temp)))
+    if (!(BN_mod_exp_mont(calcTemp,tcind->u,tcind->e,tcind->n,temp,mont)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
     if (!(BN_mod_mul(x,_x,calcTemp,tcind->n,temp)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
@@ -108,16 +109,16 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
   }
   
   /*to get xt*/
-  if (!(BN_mod_exp(xt,x,four,tcind->n,temp))){
+  if (!(BN_mod_exp_mont(xt,x,four,tcind->n,temp,mont))){
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
   }
   
-  if(!(BN_mod_exp(xiSq,sign->sig,two,tcind->n,temp))){
+  if(!(BN_mod_exp_mont(xiSq,sign->sig,two,tcind->n,temp,mont))){
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));     
   }
   
   /*v^z*/
-  if(!(BN_mod_exp(calcTemp,tcind->v,sign->proof_z,tcind->n,temp))){
+  if(!(TC_Exp_v(calcTemp,sign->proof_z,tcind,temp))){
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));     
   }
 
@@ -125,7 +126,7 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
   if (!(BN_mod_inverse(calcTemp2, tcind->vki[signum], tcind->n, temp)))
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
 
-  if(!(BN_mod_exp(calcTemp3,calcTemp2,sign->proof_c,tcind->n,temp))){
+  if(!(BN_mod_exp_mont(calcTemp3,calcTemp2,sign->proof_c,tcind->n,temp,mont))){
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));     
   }
   
@@ -134,7 +135,7 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
   
   /*xt^z*/
-  if(!(BN_mod_exp(calcTemp,xt,sign->proof_z,tcind->n,temp))){
+  if(!(BN_mod_exp_mont(calcTemp,xt,sign->proof_z,tcind->n,temp,mont))){
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));     
   }
   
@@ -148,7 +149,7 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
   if (!(BN_mod_inverse(calcTemp3 ,sign->sig, tcind->n, temp)))
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
 
-  if(!(BN_mod_exp(calcTemp5,calcTemp3,calcTemp2,tcind->n,temp))){
+  if(!(BN_mod_exp_mont(calcTemp5,calcTemp3,calcTemp2,tcind->n,temp,mont))){
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));     
   }
   
@@ -176,12 +177,10 @@ int TC_Check_Proof(TC_IND *tcind, BIGNUM*_x,TC_IND_SIG* sign, int signum) {
 
   if (BN_cmp(calcTemp,sign->proof_c)==0) {
     BN_CTX_end(temp);
-    BN_CTX_free(temp);
     return 1;
   }
 
   BN_CTX_end(temp);
-  BN_CTX_free(temp);
   
   return 0;
 }
@@ -199,6 +198,7 @@ int genIndSig(TC_IND *tcind,BIGNUM *_x,TC_IND_SIG* sign, int genproof) {
 
 /*signature share of the player i*/
   BN_CTX *temp;
+  BN_MONT_CTX *mont;
   BIGNUM* x ;
   BIGNUM* calcTemp ;
   BIGNUM *one ;
@@ -223,7 +223,7 @@ int genIndSig(TC_IND *tcind,BIGNUM *_x,TC_IND_SIG* sign, int genproof) {
   if (tcind->mynum == -1)
     return (TC_ERROR);
 
-  if ((temp=BN_CTX_new()) == NULL) return(TC_ALLOC_ERROR);
+  if ((temp=TC_Thread_BN_CTX()) == NULL) return(TC_ALLOC_ERROR);
   BN_CTX_start(temp);
   x = BN_CTX_get(temp);
   calcTemp = BN_CTX_get(temp);
@@ -241,6 +241,7 @@ int genIndSig(TC_IND *tcind,BIGNUM *_x,TC_IND_SIG* sign, int genproof) {
   xiSq = BN_CTX_get(temp);
   tempz = BN_CTX_get(temp);
   if(tempz == NULL) return (ret_error_veri(temp, TC_ALLOC_ERROR));
+  if((mont = TC_IND_Mont(tcind, temp)) == NULL) return (ret_error_veri(temp, TC_ALLOC_ERROR));
 
   /*set secondary security parameter*/
   if (!BN_set_word(L1,iL1))  return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
@@ -253,7 +254,7 @@ int genIndSig(TC_IND *tcind,BIGNUM *_x,TC_IND_SIG* sign, int genproof) {
   case 1: if (!BN_copy(x,_x)) return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
     break;
   case -1: 
-    if (!(BN_mod_exp(calcTemp,tcind->u,tcind->e,tcind->n,temp)))
+    if (!(BN_mod_exp_mont(calcTemp,tcind->u,tcind->e,tcind->n,temp,mont)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
     if (!(BN_mod_mul(x,_x,calcTemp,tcind->n,temp)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
@@ -272,7 +273,7 @@ int genIndSig(TC_IND *tcind,BIGNUM *_x,TC_IND_SIG* sign, int genproof) {
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
   if (!(BN_mod_mul(calcTemp,two,tcind->si,tcind->n,temp)))
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
-  if (!(BN_mod_exp(sign->sig,x,calcTemp,tcind->n,temp)))
+  if (!(BN_mod_exp_mont(sign->sig,x,calcTemp,tcind->n,temp,mont)))
     return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
 
   /*verification*/
@@ -303,13 +304,13 @@ int genIndSig(TC_IND *tcind,BIGNUM *_x,TC_IND_SIG* sign, int genproof) {
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
     if (!(BN_rand_range(calcTemp,Range)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
-    if(!(BN_mod_exp(vp,tcind->v,calcTemp,tcind->n,temp)))
+    if(!(TC_Exp_v(vp,calcTemp,tcind,temp)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
-    if (!(BN_mod_exp(xt,x,four,tcind->n,temp)))
+    if (!(BN_mod_exp_mont(xt,x,four,tcind->n,temp,mont)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
-    if(!(BN_mod_exp(xp,xt,calcTemp,tcind->n,temp)))
+    if(!(BN_mod_exp_mont(xp,xt,calcTemp,tcind->n,temp,mont)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
-    if(!(BN_mod_exp(xiSq,sign->sig,two,tcind->n,temp)))
+    if(!(BN_mod_exp_mont(xiSq,sign->sig,two,tcind->n,temp,mont)))
       return(ret_error_veri(temp,TC_BN_ARTH_ERROR));
 
     if ((tempc = (unsigned char*)OPENSSL_malloc(EVP_MAX_MD_SIZE))==NULL)
@@ -338,7 +339,6 @@ int genIndSig(TC_IND *tcind,BIGNUM *_x,TC_IND_SIG* sign, int genproof) {
   }
   
   BN_CTX_end(temp);
-  BN_CTX_free(temp);
 
   return TC_NOERROR;
 }
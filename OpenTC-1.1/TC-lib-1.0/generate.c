@@ -290,6 +290,8 @@ TC_IND * TC_read_share(char* file)
 		fprintf(stderr, "TC_read_share: Error opening file");
 
 	tci = (TC_IND *)OPENSSL_malloc(sizeof(TC_IND));
+	tci->cache = NULL;
+	tci->combine = NULL;
 	current = RSA_new();
 	
 	PEM_read_RSAPublicKey(read, &current, NULL, NULL);
@@ -356,6 +358,8 @@ TC_PK * TC_read_public_key(char* file)
 	tcpk = (TC_PK*)(malloc(sizeof(TC_PK)));
 	tcpk->e = BN_dup(ret->e);
 	tcpk->n = BN_dup(ret->n);
+	tcpk->mont = NULL;
+	tcpk->vfy = NULL;
 	RSA_free(ret);
 
 	return tcpk;
@@ -34,7 +34,8 @@
 int jacobi(BIGNUM* paramp,BIGNUM* paramq) 
 {
 	int j, result;
-  	BN_CTX *temp=BN_CTX_new();
+  	BN_CTX *temp=TC_Thread_BN_CTX(); /* Every return below must end the
+					    frame started on it */
 
 	BIGNUM* p ;
         BIGNUM* q ;
@@ -69,7 +70,10 @@ int jacobi(BIGNUM* paramp,BIGNUM* paramq)
 	
 	/* error if q <= 0 or q  is even */
  	if ( (BN_cmp(q,z) <= 0) || (BN_is_odd(q) == 0) ) 
-		return (-2);
+	{
+		j = -2;
+		goto done;
+	}
 
   	/*if (p < 0) {p = p%q; if (p < 0) p += q;}*/
   	if( BN_cmp(p,z) < 0 ) 
@@ -88,7 +92,10 @@ int jacobi(BIGNUM* paramp,BIGNUM* paramq)
 
    	/*if (p == 1 || q == 1) return(1);*/
    	if ( (BN_cmp(p,o) == 0) || (BN_cmp(q,o) == 0) ) 
-		return(1);
+	{
+		j = 1;
+		goto done;
+	}
 
    	/*if (q <= p) p = p%q;*/
    	if ( BN_cmp(p,q) <= 0 )
@@ -101,7 +108,10 @@ int jacobi(BIGNUM* paramp,BIGNUM* paramq)
 
   	/*if (p == 0) return(0);*/
   	if( BN_cmp(p,z) == 0) 
-		return(0);
+	{
+		j = 0;
+		goto done;
+	}
 
      	j = 1;
      	while ( BN_cmp(p,o) != 0 )
@@ -141,7 +151,10 @@ int jacobi(BIGNUM* paramp,BIGNUM* paramq)
 				if( result == 0 ) goto arth_err;
 
          			if( BN_cmp(m,z) == 0 ) 
-					return(0);
+				{
+					j = 0;
+					goto done;
+				}
          			else
            			{
              				if( BN_copy(q,p) == NULL ) goto null_err;
@@ -151,19 +164,16 @@ int jacobi(BIGNUM* paramp,BIGNUM* paramq)
        		}/* end of switch */
      	}/* end of while */
      
-	/* free the memory */
+done:
 	BN_CTX_end(temp);
-     	BN_CTX_free(temp);
 
      	return(j);
 
 null_err:
 	BN_CTX_end(temp);
-        BN_CTX_free(temp);
 	return TC_ALLOC_ERROR;
 
 arth_err:
 	BN_CTX_end(temp);
-        BN_CTX_free(temp);
 	return TC_BN_ARTH_ERROR;
 }
@@ -109,6 +109,8 @@ TC_PK *TC_PK_demarshal(unsigned char *buf) {
   }
 
   ans->e=ans->n=NULL;
+  ans->mont=NULL;
+  ans->vfy=NULL;
   
   size = demarshal_int(2,pk);
   ans->e = BN_bin2bn(pk+2, size, NULL);
@@ -224,6 +226,8 @@ TC_IND *TC_IND_demarshal(unsigned char *buf) {
   ans->v=ans->u=ans->e=ans->n=ans->si=NULL;
   ans->Hp=NULL;
   ans->vki=NULL;
+  ans->cache=NULL;
+  ans->combine=NULL;
   ans->mynum=-1;
 
   private=demarshal_int(1,pk);
@@ -36,6 +36,27 @@
 #include <stdio.h>
 #endif
 
+#include <string.h>
+#include <pthread.h>
+
+#define TC_VFY_MAX_E_BITS 32  /* Largest public exponent that TC_verify raises to
+                                 without converting to Montgomery form */
+
+/* Powers of v are kept for exponents of up to L(n) + TC_V_EXTRA_BITS bits,
+   which covers the proof exponents r (L(n) + 2*L1 bits) and z = si*c + r. */
+#define TC_V_WINDOW 4
+#define TC_V_EXTRA_BITS 384
+
+struct TC_KEY_CACHE {
+  BN_MONT_CTX *mont;  /* Montgomery context of n */
+  int v_bits;         /* Exponent bits covered by v_table */
+  BIGNUM **v_table;   /* v^(d * 2^(TC_V_WINDOW*i)) in Montgomery form, for
+                         d = 1 .. 2^TC_V_WINDOW-1, at index
+                         i*(2^TC_V_WINDOW-1) + d-1 */
+};
+
+static void key_cache_free(struct TC_KEY_CACHE *cache);
+
 TC_DEALER *TC_DEALER_new(void)
 {
 	TC_DEALER *tc;
@@ -155,6 +176,8 @@ TC_IND *TC_get_ind(int index,TC_DEALER *tcd){
 
   tcind->si = BN_dup(tcd->si[index-1]);
   tcind->Hp = tcd->Hp;
+  tcind->cache = NULL;
+  tcind->combine = NULL;
   
   if ((tcind->v == NULL) ||
       (tcind->u == NULL) ||
@@ -179,12 +202,18 @@ TC_IND *TC_get_ind(int index,TC_DEALER *tcd){
 }
 
 TC_PK *TC_get_pub (TC_DEALER *tcd){
+  return TC_PK_new(tcd->e, tcd->n);
+}
+
+TC_PK *TC_PK_new(const BIGNUM *e, const BIGNUM *n){
   TC_PK *tcpk = (TC_PK *)OPENSSL_malloc(sizeof(TC_PK));
   if (tcpk==NULL)
     return NULL;
 
-  tcpk->e = BN_dup(tcd->e);
-  tcpk->n = BN_dup(tcd->n);
+  tcpk->e = BN_dup(e);
+  tcpk->n = BN_dup(n);
+  tcpk->mont = NULL;
+  tcpk->vfy = NULL;
 
   if ((tcpk->e==NULL) || (tcpk->n == NULL)) {
     if (tcpk->e!=NULL) BN_clear_free(tcpk->e);
@@ -226,6 +255,8 @@ TC_IND *TC_get_combine(TC_DEALER *tcd){
   tcind->n = BN_dup(tcd->n);
   tcind->si = NULL;
   tcind->Hp = tcd->Hp;
+  tcind->cache = NULL;
+  tcind->combine = NULL;
   
   if ((tcind->v == NULL) ||
       (tcind->u == NULL) ||
@@ -251,6 +282,8 @@ void TC_PK_free(TC_PK *tcpk){
   if (tcpk == NULL) return;
   if (tcpk->n != NULL) BN_clear_free(tcpk->n);
   if (tcpk->e != NULL) BN_clear_free(tcpk->e);
+  if (tcpk->mont != NULL) BN_MONT_CTX_free(tcpk->mont);
+  if (tcpk->vfy != NULL) BN_free(tcpk->vfy);
 
   OPENSSL_free(tcpk);
 }
@@ -269,6 +302,8 @@ void TC_IND_free(TC_IND *tcind){
       if (tcind->vki[i] != NULL) BN_clear_free(tcind->vki[i]);
     OPENSSL_free(tcind->vki);
   }
+  key_cache_free(tcind->cache);
+  TC_Combine_Cache_free(tcind->combine);
   OPENSSL_free(tcind);
 }
 
@@ -387,3 +422,193 @@ void TC_SIG_Array_free(TC_IND_SIG **a,int l) {
   
   OPENSSL_free(a);
 }
+
+
+/* Precomputation */
+
+static __thread BN_CTX *tc_thread_bn_ctx;
+static pthread_key_t tc_thread_bn_ctx_key;
+static pthread_once_t tc_thread_bn_ctx_once = PTHREAD_ONCE_INIT;
+
+/* Frees the BN_CTX of a thread when the thread exits */
+static void tc_thread_bn_ctx_free(void *ctx) {
+  BN_CTX_free((BN_CTX *)ctx);
+}
+
+static void tc_thread_bn_ctx_init(void) {
+  pthread_key_create(&tc_thread_bn_ctx_key, tc_thread_bn_ctx_free);
+}
+
+BN_CTX *TC_Thread_BN_CTX(void) {
+  if (tc_thread_bn_ctx == NULL) {
+    pthread_once(&tc_thread_bn_ctx_once, tc_thread_bn_ctx_init);
+    tc_thread_bn_ctx = BN_CTX_new();
+    if (tc_thread_bn_ctx != NULL)
+      pthread_setspecific(tc_thread_bn_ctx_key, tc_thread_bn_ctx);
+  }
+  return tc_thread_bn_ctx;
+}
+
+static void key_cache_free(struct TC_KEY_CACHE *cache) {
+  int i, entries;
+
+  if (cache == NULL) return;
+  if (cache->mont != NULL) BN_MONT_CTX_free(cache->mont);
+  if (cache->v_table != NULL) {
+    entries = (cache->v_bits / TC_V_WINDOW) * ((1 << TC_V_WINDOW) - 1);
+    for (i=0;i<entries;i++)
+      if (cache->v_table[i] != NULL) BN_free(cache->v_table[i]);
+    OPENSSL_free(cache->v_table);
+  }
+  OPENSSL_free(cache);
+}
+
+/* Returns the cache of key, building it the first time */
+static struct TC_KEY_CACHE *key_cache(TC_IND *key, BN_CTX *ctx) {
+  struct TC_KEY_CACHE *cc;
+  int i, d, digits, entries, ok;
+  BIGNUM **t;
+
+  if (key->cache != NULL) return key->cache;
+
+  if ((cc = (struct TC_KEY_CACHE *)OPENSSL_malloc(sizeof(struct TC_KEY_CACHE))) == NULL) return NULL;
+  memset(cc, 0, sizeof(struct TC_KEY_CACHE));
+
+  digits = (BN_num_bits(key->n) + TC_V_EXTRA_BITS + TC_V_WINDOW - 1) / TC_V_WINDOW;
+  cc->v_bits = digits * TC_V_WINDOW;
+  entries = digits * ((1 << TC_V_WINDOW) - 1);
+
+  ok = ((cc->mont = BN_MONT_CTX_new()) != NULL &&
+        BN_MONT_CTX_set(cc->mont, key->n, ctx) &&
+        (cc->v_table = (BIGNUM **)OPENSSL_malloc(entries*sizeof(BIGNUM *))) != NULL);
+  if (ok) memset(cc->v_table, 0, entries*sizeof(BIGNUM *));
+
+  /* Digit position i holds v^(2^(TC_V_WINDOW*i)) times 1 .. 2^TC_V_WINDOW-1 */
+  for (i=0;ok && i<digits;i++) {
+    t = cc->v_table + i*((1 << TC_V_WINDOW) - 1);
+    for (d=0;ok && d<(1 << TC_V_WINDOW) - 1;d++)
+      ok = ((t[d] = BN_new()) != NULL);
+    if (!ok) break;
+    if (i == 0)
+      ok = BN_to_montgomery(t[0], key->v, cc->mont, ctx);
+    else  /* v^(2^(w*i)) = v^((2^w-1) * 2^(w*(i-1))) * v^(2^(w*(i-1))) */
+      ok = BN_mod_mul_montgomery(t[0], t[-1], t[-((1 << TC_V_WINDOW) - 1)], cc->mont, ctx);
+    for (d=1;ok && d<(1 << TC_V_WINDOW) - 1;d++)
+      ok = BN_mod_mul_montgomery(t[d], t[d-1], t[0], cc->mont, ctx);
+  }
+
+  if (!ok) {
+    key_cache_free(cc);
+    return NULL;
+  }
+
+  key->cache = cc;
+  return cc;
+}
+
+int TC_IND_Precompute(TC_IND *key) {
+  BN_CTX *ctx;
+
+  if ((ctx = TC_Thread_BN_CTX()) == NULL) return 0;
+  return (key_cache(key, ctx) != NULL);
+}
+
+int TC_PK_Precompute(TC_PK *pk) {
+  BN_CTX *ctx;
+
+  if ((ctx = TC_Thread_BN_CTX()) == NULL) return 0;
+  if (TC_PK_Mont(pk, ctx) == NULL) return 0;
+  if (BN_num_bits(pk->e) <= TC_VFY_MAX_E_BITS && TC_PK_Verify_Factor(pk, ctx) == NULL)
+    return 0;
+  return 1;
+}
+
+BN_MONT_CTX *TC_IND_Mont(TC_IND *key, BN_CTX *ctx) {
+  struct TC_KEY_CACHE *cc;
+
+  if ((cc = key_cache(key, ctx)) == NULL) return NULL;
+  return cc->mont;
+}
+
+BN_MONT_CTX *TC_PK_Mont(TC_PK *pk, BN_CTX *ctx) {
+  BN_MONT_CTX *mont;
+
+  if (pk->mont != NULL) return pk->mont;
+
+  if ((mont = BN_MONT_CTX_new()) == NULL) return NULL;
+  if (!BN_MONT_CTX_set(mont, pk->n, ctx)) {
+    BN_MONT_CTX_free(mont);
+    return NULL;
+  }
+  pk->mont = mont;
+  return mont;
+}
+
+BIGNUM *TC_PK_Verify_Factor(TC_PK *pk, BN_CTX *ctx) {
+  BN_MONT_CTX *mont;
+  BIGNUM *vfy, *rinv, *exp;
+  int ok;
+
+  if (pk->vfy != NULL) return pk->vfy;
+  if (BN_num_bits(pk->e) > TC_VFY_MAX_E_BITS || BN_cmp(pk->e, BN_value_one()) <= 0)
+    return NULL;
+  if ((mont = TC_PK_Mont(pk, ctx)) == NULL) return NULL;
+  if ((vfy = BN_new()) == NULL) return NULL;
+
+  /* R^-1 is the Montgomery reduction of 1 */
+  BN_CTX_start(ctx);
+  rinv = BN_CTX_get(ctx);
+  exp = BN_CTX_get(ctx);
+  ok = (exp != NULL) &&
+    BN_from_montgomery(rinv, BN_value_one(), mont, ctx) &&
+    BN_copy(exp, pk->e) != NULL &&
+    BN_sub_word(exp, 2) &&
+    BN_mod_exp_mont(vfy, rinv, exp, pk->n, ctx, mont);
+  BN_CTX_end(ctx);
+
+  if (!ok) {
+    BN_free(vfy);
+    return NULL;
+  }
+  pk->vfy = vfy;
+  return vfy;
+}
+
+int TC_Exp_v(BIGNUM *r, const BIGNUM *exp, TC_IND *key, BN_CTX *ctx) {
+  struct TC_KEY_CACHE *cc;
+  BIGNUM *acc;
+  int i, b, d, digits, started, ok;
+
+  if ((cc = key_cache(key, ctx)) == NULL) return 0;
+
+  if (BN_is_negative(exp) || BN_num_bits(exp) > cc->v_bits)
+    return BN_mod_exp_mont(r, key->v, exp, key->n, ctx, cc->mont);
+
+  BN_CTX_start(ctx);
+  acc = BN_CTX_get(ctx);
+  ok = (acc != NULL);
+
+  /* v^exp = prod_i (v^(2^(w*i)))^(digit i of exp) */
+  digits = (BN_num_bits(exp) + TC_V_WINDOW - 1) / TC_V_WINDOW;
+  started = 0;
+  for (i=0;ok && i<digits;i++) {
+    d = 0;
+    for (b=TC_V_WINDOW-1;b>=0;b--)
+      d = (d << 1) | BN_is_bit_set(exp, i*TC_V_WINDOW + b);
+    if (d == 0) continue;
+    if (started) {
+      ok = BN_mod_mul_montgomery(acc, acc, cc->v_table[i*((1 << TC_V_WINDOW) - 1) + d-1], cc->mont, ctx);
+    } else {
+      ok = (BN_copy(acc, cc->v_table[i*((1 << TC_V_WINDOW) - 1) + d-1]) != NULL);
+      started = 1;
+    }
+  }
+
+  if (ok) {
+    if (started) ok = BN_from_montgomery(r, acc, cc->mont, ctx);
+    else ok = BN_one(r);
+  }
+
+  BN_CTX_end(ctx);
+  return ok;
+}
@@ -1,62 +1,101 @@
-/**
- * file: verify.c - Implements TC_verify
- *
- * OpenTC.
- *
- * The contents of this file are subject to the OpenTC Open-Source
- * License, Version 1.0 (the ``License''); you may not use
- * this file except in compliance with the License.  You may obtain a
- * copy of the License in the file ``LICENSE.txt'' found in this distribution.
- *
- * Software distributed under the License is distributed on an AS IS basis,
- * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
- * for the specific language governing rights and limitations under the
- * License.
- *
- *
- * The Creators of OpenTC are:
- *         Abhilasha Bhargav, <bhargav@cs.purdue.edu>
- *         Rahim Sewani, <sewani@cs.purdue.edu>
- *         Sarvjeet Singh, <sarvjeet_s@yahoo.com, sarvjeet@purdue.edu>
- *         Cristina Nita-Rotaru, <crisn@cs.purdue.edu>
- *
- * Contributors:
- *         Chi-Bun Chan, <cbchan@cs.purdue.edu>
- *
- * Copyright (c) 2004 Purdue University.
- * All rights reserved.
- *
- */
-
-
-#include "TC.h"
-
-int TC_verify(BIGNUM *hM, TC_SIG sig, TC_PK *tcpk) {
-  BN_CTX *ctx=NULL;
-  BIGNUM *temp=NULL;
-
-  if ((ctx=BN_CTX_new()) == NULL) return(TC_ALLOC_ERROR);
-  BN_CTX_start(ctx);
-  temp = BN_CTX_get(ctx);
-  if ((temp = BN_CTX_get(ctx))== NULL) {
-    BN_CTX_end(ctx);
-    BN_CTX_free(ctx);
-    return(TC_ALLOC_ERROR);
-  }
-  
-  if (!BN_mod_exp(temp,sig,tcpk->e,tcpk->n,ctx)) {
-    BN_CTX_end(ctx);
-    BN_CTX_free(ctx);
-    return TC_BN_ARTH_ERROR;    
-  };
- 
-  if (BN_cmp(temp,hM)==0) {
-    BN_CTX_end(ctx);
-    BN_CTX_free(ctx);
-    return 1;
-  } else {
-    BN_CTX_end(ctx);
-    BN_CTX_free(ctx);
-    return 0;
-  }
-}
+/**
+ * file: verify.c - Implements TC_verify
+ *
+ * OpenTC.
+ *
+ * The contents of this file are subject to the OpenTC Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ *
+ * The Creators of OpenTC are:
+ *         Abhilasha Bhargav, <bhargav@cs.purdue.edu>
+ *         Rahim Sewani, <sewani@cs.purdue.edu>
+ *         Sarvjeet Singh, <sarvjeet_s@yahoo.com, sarvjeet@purdue.edu>
+ *         Cristina Nita-Rotaru, <crisn@cs.purdue.edu>
+ *
+ * Contributors:
+ *         Chi-Bun Chan, <cbchan@cs.purdue.edu>
+ *
+ * Copyright (c) 2004 Purdue University.
+ * All rights reserved.
+ *
+ */
+
+
+#include "TC.h"
+
+/* With Montgomery products mm(a,b) = a*b/R mod n, the binary ladder for e run
+   directly on sig (no conversion into Montgomery form) ends at sig^e / R^(e-1),
+   and mm(hM, R^-(e-2)) is hM / R^(e-1), so the two are compared as they are (no
+   conversion back either). For the small public exponents in use this saves
+   about a third of the work of BN_mod_exp_mont. */
+static int verify_small_e(BIGNUM *hM, TC_SIG sig, TC_PK *tcpk, BIGNUM *vfy,
+    BN_MONT_CTX *mont, BN_CTX *ctx) {
+  BIGNUM *s, *acc, *h;
+  int i, ret;
+
+  /* Out of range hashes could never match sig^e mod n */
+  if (BN_is_negative(hM) || BN_ucmp(hM, tcpk->n) >= 0) return 0;
+
+  BN_CTX_start(ctx);
+  s = BN_CTX_get(ctx);
+  acc = BN_CTX_get(ctx);
+  if ((h = BN_CTX_get(ctx)) == NULL) {
+    BN_CTX_end(ctx);
+    return(TC_ALLOC_ERROR);
+  }
+
+  ret = TC_BN_ARTH_ERROR;
+  if (!BN_nnmod(s, sig, tcpk->n, ctx) || BN_copy(acc, s) == NULL) goto done;
+  for (i = BN_num_bits(tcpk->e) - 2; i >= 0; i--) {
+    if (!BN_mod_mul_montgomery(acc, acc, acc, mont, ctx)) goto done;
+    if (BN_is_bit_set(tcpk->e, i) && 
+        !BN_mod_mul_montgomery(acc, acc, s, mont, ctx)) goto done;
+  }
+  if (!BN_mod_mul_montgomery(h, hM, vfy, mont, ctx)) goto done;
+  ret = (BN_cmp(acc, h) == 0);
+
+ done:
+  BN_CTX_end(ctx);
+  return ret;
+}
+
+int TC_verify(BIGNUM *hM, TC_SIG sig, TC_PK *tcpk) {
+  BN_CTX *ctx=NULL;
+  BIGNUM *temp=NULL, *vfy;
+  int ret;
+
+  if ((ctx=TC_Thread_BN_CTX()) == NULL) return(TC_ALLOC_ERROR);
+  BN_CTX_start(ctx);
+  if ((vfy = TC_PK_Verify_Factor(tcpk, ctx)) != NULL) {
+    ret = verify_small_e(hM, sig, tcpk, vfy, TC_PK_Mont(tcpk, ctx), ctx);
+    BN_CTX_end(ctx);
+    return ret;
+  }
+
+  temp = BN_CTX_get(ctx);
+  if ((temp = BN_CTX_get(ctx))== NULL) {
+    BN_CTX_end(ctx);
+    return(TC_ALLOC_ERROR);
+  }
+  
+  if (!BN_mod_exp_mont(temp,sig,tcpk->e,tcpk->n,ctx,TC_PK_Mont(tcpk,ctx))) {
+    BN_CTX_end(ctx);
+    return TC_BN_ARTH_ERROR;    
+  };
+ 
+  if (BN_cmp(temp,hM)==0) {
+    BN_CTX_end(ctx);
+    return 1;
+  } else {
+    BN_CTX_end(ctx);
+    return 0;
+  }
+}
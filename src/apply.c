@@ -38,6 +38,7 @@
 #include "apply.h"
 #include "construct_collective_state_protocol.h"
 #include "global_view_change.h"
+#include "checkpoint.h"
 #include "util/memory.h"
 #include "util/alarm.h"
 
@@ -230,6 +231,9 @@ void APPLY_Sig_Share( signed_message *sig_share ) {
 	case CCS_UNION_TYPE:
 	    APPLY_Sig_Share_CCS_Union(sig_share);
 	    return;
+	case CHECKPOINT_TYPE:
+	    CKPT_Apply_Sig_Share(sig_share);
+	    return;
     }
  
 }
@@ -1042,7 +1046,7 @@ signed_message* APPLY_Generate_Proposal( pending_slot_struct *slot) {
      * to generate a proposal. If all of the shares are good, a valid signature
      * for a proposal can be generated. However, if any of the shares are bad,
      * we must identify any bad shares and add them to a blacklist. 
-     * The blacklisting code is not currently implemented. */
+     * THRESH_Attempt_To_Combine does this. */
 
     signed_message *proposal;
     int32u combine_success;
@@ -1077,7 +1081,7 @@ signed_message* APPLY_Generate_Accept( global_slot_struct *slot) {
      * to generate a proposal. If all of the shares are good, a valid signature
      * for a proposal can be generated. However, if any of the shares are bad,
      * we must identify any bad shares and add them to a blacklist. 
-     * The blacklisting code is not currently implemented.  */
+     * THRESH_Attempt_To_Combine does this.  */
 
     signed_message *accept;
     int32u combine_success;
@@ -1114,7 +1118,7 @@ signed_message* APPLY_Generate_Global_View_Change() {
      * a valid signature for a proposal can be generated. However, if any of
      * the shares are bad, we must identify any bad shares and add them to a
      * blacklist. 
-     * The blacklisting code is not currently implemented. */
+     * THRESH_Attempt_To_Combine does this. */
 
     signed_message *global_vc;
     int32u combine_success;
@@ -1173,7 +1177,7 @@ signed_message* APPLY_Generate_Local_View_Proof() {
      * a valid signature for a proposal can be generated. However, if any of
      * the shares are bad, we must identify any bad shares and add them to a
      * blacklist. 
-     * The blacklisting code is not currently implemented. */
+     * THRESH_Attempt_To_Combine does this. */
 
     signed_message *local_view_proof;
     int32u combine_success;
@@ -1231,7 +1235,7 @@ signed_message* APPLY_Generate_CCS_Union( int32u context ) {
      * are good, a valid signature for a ccs union can be
      * generated. However, if any of the shares are bad, we must
      * identify any bad shares and add them to a blacklist.  
-     * The blacklisting code is not currently implemented. */
+     * THRESH_Attempt_To_Combine does this. */
 
     signed_message *ccs_union;
     int32u combine_success;
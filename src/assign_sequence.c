@@ -41,6 +41,7 @@
 #include "timeouts.h"
 #include "network.h"
 #include "construct_collective_state_protocol.h"
+#include "window.h"
 #include <string.h>
 
 /* Globally Accessible Variables */
@@ -61,22 +62,28 @@ void ASEQ_Process_Update_From_Client( signed_message *mess );
 int32u ASEQ_Okay_To_Send_Next_Proposal_On_Wide_Area(); 
 int32u ASEQ_Okay_To_Send_Next_Pre_Prepare_On_Local_Area();
 void ASEQ_Attempt_To_Send_Proposal( int dummy, void *dummpy ); 
-/* Process an update in ASEQ. */
-void ASEQ_Process_Update( signed_message *mess ); 
+/* Process a batch of updates in ASEQ. */
+void ASEQ_Process_Update( byte *batch, int32u batch_len ); 
+
+/* Update batching */
+byte* ASEQ_Get_Constrained_Batch_If_Exists( int32u seq, int32u *batch_len ); 
+int32u ASEQ_Max_Batch_Bytes(); 
+int32u ASEQ_Update_Batch_Is_Ready(); 
+int32u ASEQ_Fill_Update_Batch( byte *batch ); 
+void ASEQ_Batch_Linger_Expired( int dummy, void *dummyp ); 
 
 /* Checks to see if we should play the ASEQ protocol */
 int32u ASEQ_Is_Constrained(); 
 int32u ASEQ_Seq_Num_Within_My_Response_Window( int32u seq_num );
 
 /* Message construction and sending */
-signed_message* ASEQ_Construct_Pre_Prepare( signed_message *mess,
+signed_message* ASEQ_Construct_Pre_Prepare( byte *batch, int32u batch_len,
 		    int32u seq_num ); 
 signed_message* ASEQ_Construct_Prepare( signed_message *mess );
 signed_message* ASEQ_Construct_Proposal(signed_message *mess);
 
 /* Garbage collection */
 void ASEQ_Garbage_Collect_Prepare_Certificate( prepare_certificate_struct *pcert);
-void ASEQ_Garbage_Collect_Pending_Slot( pending_slot_struct *slot ); 
 
 /* Local Variables */
 
@@ -91,6 +98,10 @@ util_stopwatch send_proposal_stopwatch;
 dll_struct update_dll;
 dll_struct proposal_dll;
 
+/* The time at which the oldest update in update_dll started waiting to be
+ * batched. */
+sp_time batch_linger_start;
+
 /* Protocol 1 Normal Case Functions */
 
 /* Dispatches a valid signed message to an appropriate function which
@@ -171,6 +182,10 @@ void ASEQ_Process_Update_From_Client( signed_message *update ) {
  * messages that come from clients. */
 void ASEQ_Add_Update_To_Queue( signed_message *mess ) {
 
+    if ( UTIL_DLL_Is_Empty( &update_dll ) ) {
+	batch_linger_start = E_get_time();
+    }
+
     UTIL_DLL_Add_Data( &update_dll, mess );
 
     UTIL_DLL_Set_Last_Int32u_1( &update_dll, 0 );
@@ -185,15 +200,15 @@ void ASEQ_Add_Proposal_To_Queue( signed_message *mess )   {
 
 }
 
-signed_message* ASEQ_Get_Constrained_Update_If_Exists( int32u seq ) {
+byte* ASEQ_Get_Constrained_Batch_If_Exists( int32u seq, int32u *batch_len ) {
 
-    /* Do I have knowledge of an update that should be bound to the next
-     * sequence number? */
+    /* Do I have knowledge of a batch of updates that should be bound to the
+     * next sequence number? If so, return it and set batch_len to its length
+     * in bytes. */
 
     global_slot_struct *gslot;
     pending_slot_struct *pslot;
 
-    signed_message *update;
     signed_message *gpro;
     signed_message *ppro;
 
@@ -201,7 +216,6 @@ signed_message* ASEQ_Get_Constrained_Update_If_Exists( int32u seq ) {
     proposal_message *gpro_specific;
     pre_prepare_message *pre_prepare_specific;
 
-    update = NULL;
     gpro = NULL;
     ppro = NULL;
 
@@ -248,21 +262,25 @@ signed_message* ASEQ_Get_Constrained_Update_If_Exists( int32u seq ) {
 	 * an error in purging the data structs, the one with the higher view
 	 * is the correct one. */
 	if ( gpro_specific->global_view >= ppro_specific->global_view ) {
-	    return (signed_message*)(gpro_specific+1);
+	    *batch_len = gpro->len - sizeof(proposal_message);
+	    return (byte*)(gpro_specific+1);
 	}
-	return (signed_message*)(ppro_specific+1);
+	*batch_len = ppro->len - sizeof(proposal_message);
+	return (byte*)(ppro_specific+1);
     }
 
     if ( gpro != NULL ) {
 	gpro_specific = (proposal_message*)(gpro+1);
-	/* Return the update associated with this proposal */
-	return (signed_message*)(gpro_specific+1);
+	/* Return the updates associated with this proposal */
+	*batch_len = gpro->len - sizeof(proposal_message);
+	return (byte*)(gpro_specific+1);
     }
 
     if ( ppro != NULL ) {
 	ppro_specific = (proposal_message*)(ppro+1);
-	/* Return the update associated with this proposal */
-	return (signed_message*)(ppro_specific+1);
+	/* Return the updates associated with this proposal */
+	*batch_len = ppro->len - sizeof(proposal_message);
+	return (byte*)(ppro_specific+1);
     }
    
     /* WE DO NOT HAVE ANY PROPOSALS, but we may have a prepare certificate.
@@ -271,7 +289,9 @@ signed_message* ASEQ_Get_Constrained_Update_If_Exists( int32u seq ) {
 	if ( pslot->prepare_certificate.pre_prepare != NULL ) {
 	    pre_prepare_specific = (pre_prepare_message*)
 		(pslot->prepare_certificate.pre_prepare + 1); 
-	    return (signed_message*)(pre_prepare_specific+1);
+	    *batch_len = pslot->prepare_certificate.pre_prepare->len - 
+		sizeof(pre_prepare_message);
+	    return (byte*)(pre_prepare_specific+1);
 	}
     }
 
@@ -282,10 +302,10 @@ signed_message* ASEQ_Get_Constrained_Update_If_Exists( int32u seq ) {
 /* Process the next update in the queue if the queue is not empty. */
 void ASEQ_Process_Next_Update() {
 
-    signed_message *next;
-    int32u seq_num;
     int32u count;
-    signed_message *constrained_update;
+    byte *constrained_batch;
+    int32u batch_len;
+    byte batch[MAX_PACKET_SIZE];
 
     if ( !(UTIL_I_Am_Representative() && UTIL_I_Am_In_Leader_Site()) ) {
 	return;
@@ -308,20 +328,23 @@ void ASEQ_Process_Next_Update() {
     while ( ASEQ_Okay_To_Send_Next_Pre_Prepare_On_Local_Area() ) {
 	/* At this point, we are constrained and we must check to make sure
 	 * that we send a valid update. */
-	constrained_update = ASEQ_Get_Constrained_Update_If_Exists( 
-		VAR.Global_seq + 1 );
-	if ( constrained_update != NULL ) {
-	    /* There is already an update that has been bound to this sequence
+	constrained_batch = ASEQ_Get_Constrained_Batch_If_Exists( 
+		VAR.Global_seq + 1, &batch_len );
+	if ( constrained_batch != NULL ) {
+	    /* There is already a batch that has been bound to this sequence
 	     * number, therefore we need to inject it into the system and not
-	     * one of the updates in our queue. */
+	     * the updates in our queue. */
 	    Alarm(ASEQ_PRINT,"\n********* REPLAY %d **********\n\n", VAR.Global_seq
 		    + 1 );
-	    ASEQ_Process_Update( constrained_update );
+	    ASEQ_Process_Update( constrained_batch, batch_len );
 	} else {    
-	    next = UTIL_DLL_Front_Message( &update_dll );
-	    seq_num = UTIL_DLL_Front_Int32u_1( &update_dll );
-	    ASEQ_Process_Update( next );
-	    UTIL_DLL_Pop_Front( &update_dll );
+	    if ( !ASEQ_Update_Batch_Is_Ready() ) {
+		/* Wait for more updates to join the batch */
+		break;
+	    }
+	    batch_len = ASEQ_Fill_Update_Batch( batch );
+	    ASEQ_Process_Update( batch, batch_len );
+	    batch_linger_start = E_get_time();
 	    count++;
 	}
     }
@@ -332,6 +355,108 @@ void ASEQ_Process_Next_Update() {
 
 }
 
+/* Returns the maximum number of bytes of updates that can be bound to a
+ * single sequence number. */
+int32u ASEQ_Max_Batch_Bytes() {
+
+    int32u max_bytes;
+
+    max_bytes = UPDATE_BATCH_MAX_BYTES;
+
+    if ( UPDATE_BATCH_PACKET_BYTES < max_bytes ) {
+	max_bytes = UPDATE_BATCH_PACKET_BYTES;
+    }
+    if ( UPDATE_BATCH_SHARE_BYTES < max_bytes ) {
+	max_bytes = UPDATE_BATCH_SHARE_BYTES;
+    }
+    return max_bytes;
+
+}
+
+/* Returns 1 if the updates at the front of update_dll should be sent as a
+ * batch now. A batch is sent when it is full or when its oldest update has
+ * waited timeout_update_batch_linger. Otherwise a timeout is scheduled to
+ * send the partial batch and 0 is returned. */
+int32u ASEQ_Update_Batch_Is_Ready() {
+
+    int32u count;
+    int32u bytes;
+    sp_time now;
+    sp_time deadline;
+    signed_message *update;
+
+    if ( timeout_update_batch_linger.sec == 0 && 
+	 timeout_update_batch_linger.usec == 0 ) {
+	return 1;
+    }
+
+    count = 0;
+    bytes = 0;
+    UTIL_DLL_Set_Begin( &update_dll );
+    while ( !UTIL_DLL_At_End( &update_dll ) ) {
+	update = UTIL_DLL_Get_Signed_Message( &update_dll );
+	count++;
+	bytes += update->len + sizeof(signed_message);
+	if ( count >= UPDATE_BATCH_MAX_COUNT || 
+	     bytes >= ASEQ_Max_Batch_Bytes() ) {
+	    /* The batch is full */
+	    return 1;
+	}
+	UTIL_DLL_Next( &update_dll );
+    }
+
+    now = E_get_time();
+    deadline = E_add_time( batch_linger_start, timeout_update_batch_linger );
+
+    if ( E_compare_time( now, deadline ) >= 0 ) {
+	return 1;
+    }
+
+    E_queue( ASEQ_Batch_Linger_Expired, 0, NULL, 
+	    E_sub_time( deadline, now ) );
+
+    return 0;
+
+}
+
+void ASEQ_Batch_Linger_Expired( int dummy, void *dummyp ) {
+
+    ASEQ_Process_Next_Update();
+
+}
+
+/* Pop updates off the front of update_dll and copy them back to back into
+ * the batch buffer, which must hold MAX_PACKET_SIZE bytes. The first update
+ * is always taken. Returns the length of the batch in bytes. */
+int32u ASEQ_Fill_Update_Batch( byte *batch ) {
+
+    signed_message *next;
+    int32u batch_len;
+    int32u update_len;
+    int32u count;
+
+    batch_len = 0;
+    count = 0;
+
+    while ( !UTIL_DLL_Is_Empty( &update_dll ) && 
+	    count < UPDATE_BATCH_MAX_COUNT ) {
+	next = UTIL_DLL_Front_Message( &update_dll );
+	update_len = next->len + sizeof(signed_message);
+	if ( count > 0 && batch_len + update_len > ASEQ_Max_Batch_Bytes() ) {
+	    break;
+	}
+	memcpy( (void*)(batch + batch_len), (void*)next, update_len );
+	batch_len += update_len;
+	count++;
+	UTIL_DLL_Pop_Front( &update_dll );
+    }
+
+    Alarm(DEBUG,"ASEQ batched %d updates in %d bytes\n", count, batch_len );
+
+    return batch_len;
+
+}
+
 void ASEQ_Attempt_To_Send_Proposal( int dummy, void *dummpy ) {
 
     ASEQ_Process_Next_Proposal();
@@ -359,13 +484,11 @@ int32u ASEQ_Okay_To_Send_Next_Proposal_On_Wide_Area() {
 
     proposal_specific = (proposal_message*)(proposal+1);
 
-    if ( proposal_specific->seq_num >= GLOBAL.ARU + GLOBAL_WINDOW + 10000 ) {
-
-	/* FINAL added a 10000 in the if statement above -- we won't use this
-	 * window */
+    if ( proposal_specific->seq_num >= GLOBAL.ARU + VAR.Global_window ) {
 
 	/* The global window is full -- we should not send any more proposals
 	 * until the global aru increases. */
+	WIN_Window_Full( GLOBAL_CONTEXT );
 	Alarm(ASEQ_PRINT,"Global Window Full %d %d\n",
 	      proposal_specific->seq_num, GLOBAL.ARU );
 	/* FINAL */
@@ -406,6 +529,7 @@ int32u ASEQ_Okay_To_Send_Next_Proposal_On_Wide_Area() {
 void ASEQ_Process_Next_Proposal() {
 
     signed_message *next;
+    pending_slot_struct *slot;
 
     while ( ASEQ_Okay_To_Send_Next_Proposal_On_Wide_Area() ) {
       	next = UTIL_DLL_Front_Message( &proposal_dll );
@@ -420,6 +544,14 @@ void ASEQ_Process_Next_Proposal() {
 	UTIL_Stopwatch_Start(&send_proposal_stopwatch);
 
 	UTIL_Send_To_Site_Representatives( next );
+
+	/* Time the proposal from when it goes on the wide area */
+	slot = UTIL_Get_Pending_Slot_If_Exists( 
+		((proposal_message*)(next+1))->seq_num );
+	if ( slot != NULL ) {
+	    slot->time_proposal_sent = E_get_time();
+	}
+
  	UTIL_DLL_Pop_Front( &proposal_dll );
     }
 
@@ -456,15 +588,24 @@ int32u ASEQ_Okay_To_Send_Next_Pre_Prepare_On_Local_Area() {
     }
 
     /* Check both local and global windows */
-    if ( VAR.Global_seq >= PENDING.ARU + LOCAL_WINDOW
-	 || VAR.Global_seq >= GLOBAL.ARU + GLOBAL_WINDOW ) {
+    if ( VAR.Global_seq >= PENDING.ARU + VAR.Local_window ) {
 	/* The local window is full -- we should not send any more pre-prepares
-	 * until the global aru increases. */
+	 * until the pending aru increases. */
+	WIN_Window_Full( PENDING_CONTEXT );
 	Alarm(ASEQ_PRINT,"Local Window Full %d g.aru: %d p.aru %d\n",
 	      VAR.Global_seq, GLOBAL.ARU, PENDING.ARU );
 	return 0;
     } 
 
+    if ( VAR.Global_seq >= GLOBAL.ARU + VAR.Global_window ) {
+	/* The global window is full -- we should not send any more
+	 * pre-prepares until the global aru increases. */
+	WIN_Window_Full( GLOBAL_CONTEXT );
+	Alarm(ASEQ_PRINT,"Global Window Full %d g.aru: %d p.aru %d\n",
+	      VAR.Global_seq, GLOBAL.ARU, PENDING.ARU );
+	return 0;
+    } 
+
     if ( !ASEQ_Is_Constrained() ) {
 	/* I am not constrained, so I cannot send a message. */
 	Alarm(ASEQ_PRINT,"ASEQ: Not constrained so cannot send a pre_prepare.\n");
@@ -475,15 +616,16 @@ int32u ASEQ_Okay_To_Send_Next_Pre_Prepare_On_Local_Area() {
  
 }
 
-/* Process an update. */
-void ASEQ_Process_Update( signed_message *mess ) {
+/* Process a batch of updates. */
+void ASEQ_Process_Update( byte *batch, int32u batch_len ) {
 
     int32u bind_seq_num;
     signed_message *pre_prepare;
     pending_slot_struct *slot;
 
     Alarm(DEBUG,"%d %d ASEQ_Process_Update from %d\n",
-	    VAR.My_Site_ID, VAR.My_Server_ID, mess->machine_id );
+	    VAR.My_Site_ID, VAR.My_Server_ID, 
+	    ((signed_message*)batch)->machine_id );
 
     if ( UTIL_I_Am_Representative() ) {
 	VAR.Global_seq++;
@@ -492,7 +634,8 @@ void ASEQ_Process_Update( signed_message *mess ) {
 	/* Construct and send a Pre-Prepare message */
 	Alarm(ASEQ_PRINT,"%d ASEQ_Process_Update (sending pre-prepare) %d %d gv %d\n",
 		VAR.My_Server_ID,VAR.Global_seq,bind_seq_num,GLOBAL.View);
- 	pre_prepare = ASEQ_Construct_Pre_Prepare( mess, bind_seq_num );
+ 	pre_prepare = ASEQ_Construct_Pre_Prepare( batch, batch_len, 
+		bind_seq_num );
 	APPLY_Message_To_Data_Structs( pre_prepare );
 	slot = UTIL_Get_Pending_Slot( bind_seq_num );
 	slot->time_pre_prepare_sent = E_get_time();
@@ -859,19 +1002,19 @@ signed_message* ASEQ_Construct_Proposal( signed_message *pre_prepare ) {
     
 }
 
-signed_message* ASEQ_Construct_Pre_Prepare( signed_message *mess, int32u seq_num ) {
+signed_message* ASEQ_Construct_Pre_Prepare( byte *batch, int32u batch_len,
+	int32u seq_num ) {
     signed_message *pre_prepare;
     pre_prepare_message *pre_prepare_specific;
-    int32u update_len;
     
     /* Construct new message */
     pre_prepare = UTIL_New_Signed_Message();
 
     pre_prepare_specific = (pre_prepare_message*)(pre_prepare + 1);
     
-    /* Fill in the message based on the update. We construct a message that
-     * contains the update by copying the update (which is a signed message)
-     * into the Pre-Prepare message. */
+    /* Fill in the message based on the batch. We construct a message that
+     * contains the updates by copying the batch (a sequence of signed
+     * messages) into the Pre-Prepare message. */
 
     pre_prepare->site_id = VAR.My_Site_ID;
     
@@ -879,9 +1022,7 @@ signed_message* ASEQ_Construct_Pre_Prepare( signed_message *mess, int32u seq_num
     
     pre_prepare->type = PRE_PREPARE_TYPE;
 
-    update_len = mess->len + sizeof(signed_message);
-    
-    pre_prepare->len = update_len + sizeof(pre_prepare_message);
+    pre_prepare->len = batch_len + sizeof(pre_prepare_message);
 
     pre_prepare_specific->seq_num = seq_num;          /* seq number */
 
@@ -903,9 +1044,9 @@ signed_message* ASEQ_Construct_Pre_Prepare( signed_message *mess, int32u seq_num
     pre_prepare_specific->global_view = GLOBAL.View;  /* the global view number
     */
     
-    /* Now copy the body of the update to the pre prepare message */
+    /* Now copy the batch of updates to the pre prepare message */
     memcpy( (void*)(pre_prepare_specific + 1), 
-	    (void*)mess, update_len );
+	    (void*)batch, batch_len );
 
     /* Sign the message with a standard RSA signature */
     UTIL_RSA_Sign_Message( pre_prepare );
@@ -920,7 +1061,7 @@ signed_message* ASEQ_Construct_Prepare( signed_message *pre_prepare ) {
     prepare_message *prepare_specific;
 
     /* Construct new message */
-    prepare = UTIL_New_Signed_Message();
+    prepare = UTIL_New_Signed_Message_Size( sizeof(prepare_message) );
 
     prepare_specific = (prepare_message*)(prepare + 1);
      
@@ -972,6 +1113,7 @@ int32u ASEQ_Update_ARU() {
 	    update = 0;
 	} else /* there is a proposal in the slot */ {
 	    PENDING.ARU++;
+	    WIN_Ordered( PENDING_CONTEXT, slot->time_pre_prepare_sent );
 	    Alarm(ASEQ_PRINT, "Pending: %d; Global: %d\n", PENDING.ARU, GLOBAL.ARU);
 	    ASEQ_Garbage_Collect_Pending_Slot( slot );
 	}
@@ -1042,6 +1184,7 @@ void ASEQ_Retransmit(int dummy, void *dummyp ) {
 	    if ( E_compare_time( diff, timeout_pre_prepare_retrans ) > 0 ) {
 	    	/* retransmit pre_prepare */
 		Alarm(DEBUG,"Pre prep Exp\n");
+		WIN_Retransmitted( PENDING_CONTEXT );
 		if ( slot->pre_prepare != NULL ) {
 		    slot->time_pre_prepare_sent = now;
 		    Alarm(DEBUG,"Retrans pre_prepare_message %d\n",
@@ -1069,6 +1212,7 @@ void ASEQ_Retransmit(int dummy, void *dummyp ) {
 	    	/* retransmit proposal */
 		Alarm(DEBUG,"Pro Exp\n");
 		if ( slot->proposal != NULL ) {
+		    WIN_Retransmitted( GLOBAL_CONTEXT );
 		    slot->time_proposal_sent = now;
 		    Alarm(ASEQ_PRINT,"Retrans proposal_message %d\n",
 			    ((proposal_message*)(slot->proposal+1))->seq_num);
@@ -1098,7 +1242,7 @@ void ASEQ_Initialize() {
  * ARU by more than a certain amount. */
 int32u ASEQ_Seq_Num_Within_My_Response_Window( int32u seq_num ) {
 
-    if ( seq_num > PENDING.ARU + LOCAL_WINDOW + 1 ) {
+    if ( seq_num > PENDING.ARU + LOCAL_WINDOW_MAX + 1 ) {
 	/* do not send if my pending aru is not high enough */
 	Alarm(ASEQ_PRINT,"seq_num %d not in response window %d %d %d\n",
 	      seq_num, PENDING.ARU, GLOBAL.ARU );
@@ -52,4 +52,6 @@ void ASEQ_Process_Next_Update();
 
 void ASEQ_Reset_For_Pending_View_Change();
 
+void ASEQ_Garbage_Collect_Pending_Slot( pending_slot_struct *slot ); 
+
 #endif
@@ -48,6 +48,8 @@
 #include "error_wrapper.h"
 #include "global_reconciliation.h"
 #include "meta_globally_order.h"
+#include "checkpoint.h"
+#include "window.h"
 
 #ifdef	ARCH_PC_WIN95
 #include	<winsock.h>
@@ -134,9 +136,12 @@ int main(int argc, char* argv[])
     GVC_Initialize();
 
     CCS_Initialize();
+    UTIL_Refresh_Alarm_Prefix();
    
     GLOBO_Initialize(); 
     GRECON_Init();
+    CKPT_Initialize();
+    WIN_Initialize( 0, 0 );
 
     fflush(0);
 
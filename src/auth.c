@@ -0,0 +1,203 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+/* Local-area authenticators. With LOCAL_AUTH_MACS set, the messages that
+ * servers of a site exchange only among themselves are authenticated with a
+ * vector of HMACs, as in PBFT, in place of an RSA signature. The signature
+ * field holds AUTH_MAC_SIZE bytes for each server in the site, in server
+ * order, each computed over the digest that an RSA signature would have
+ * covered. Every server of the site can check its own entry, so a message
+ * forwarded inside the site still verifies. The pairwise keys are written by
+ * gen_keys, one file per pair of servers in a site. */
+
+#include <stdio.h>
+#include <string.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include "auth.h"
+#include "util/alarm.h"
+
+extern server_variables VAR;
+
+#if LOCAL_AUTH_MACS && NUM_SERVERS_IN_SITE * AUTH_MAC_SIZE > SIGNATURE_SIZE
+#error An authenticator for NUM_SERVERS_IN_SITE servers does not fit in a signature
+#endif
+
+/* The key I share with each server of my site, indexed by server id */
+byte auth_keys[NUM_SERVERS_IN_SITE + 1][AUTH_KEY_SIZE];
+int32u auth_keys_read;
+
+/* Local Functions */
+void AUTH_Key_File_Name( char *name, int32u site, int32u server_a, 
+	int32u server_b ); 
+void AUTH_Make_MAC( byte *key, byte *digest, byte *mac ); 
+
+/* Returns the scheme that authenticates messages of this type. These are the
+ * server messages that never leave the site. Ordered Proofs and Global
+ * Reconciliation messages are sent to other sites, and client messages come
+ * from outside, so they keep RSA signatures. */
+int32u AUTH_Scheme( int32u type ) {
+
+#if LOCAL_AUTH_MACS
+    if ( type == PRE_PREPARE_TYPE ||
+	 type == PREPARE_TYPE ||
+	 type == SIG_SHARE_TYPE ||
+	 type == L_NEW_REP_TYPE ||
+	 type == LOCAL_RECONCILIATION_TYPE ||
+	 type == CCS_INVOCATION_TYPE ||
+	 type == CCS_REPORT_TYPE ||
+	 type == CCS_DESCRIPTION_TYPE ) {
+	return AUTH_SCHEME_MAC;
+    }
+#endif
+    return AUTH_SCHEME_RSA;
+}
+
+void AUTH_Make_MAC( byte *key, byte *digest, byte *mac ) {
+
+    byte md[EVP_MAX_MD_SIZE];
+    unsigned int md_len;
+
+    HMAC( EVP_sha1(), key, AUTH_KEY_SIZE, digest, DIGEST_SIZE, md, &md_len );
+    memcpy( mac, md, AUTH_MAC_SIZE );
+}
+
+/* Fill in the authenticator of a message of a MAC type. Returns 1 if the
+ * message was authenticated here and 0 if it needs an RSA signature. */
+int32u AUTH_Authenticate_Message( signed_message *mess ) {
+
+    byte digest[DIGEST_SIZE];
+    int32u s;
+
+    if ( AUTH_Scheme( mess->type ) != AUTH_SCHEME_MAC ) {
+	return 0;
+    }
+
+    OPENSSL_RSA_Make_Digest( ((byte*)mess) + SIGNATURE_SIZE, 
+	    mess->len + sizeof(signed_message) - SIGNATURE_SIZE, digest ); 
+
+    memset( mess->sig, 0, SIGNATURE_SIZE );
+    for ( s = 1; s <= NUM_SERVERS_IN_SITE; s++ ) {
+	AUTH_Make_MAC( auth_keys[s], digest, 
+		mess->sig + (s - 1) * AUTH_MAC_SIZE );
+    }
+
+    return 1;
+}
+
+/* Check my entry of the authenticator on a message from a server of my
+ * site. This only reads the keys, so verification threads may call it. */
+int32u AUTH_Verify_Message( signed_message *mess, int32u sender_id, 
+	int32u site_id ) {
+
+    byte digest[DIGEST_SIZE];
+    byte mac[AUTH_MAC_SIZE];
+
+    if ( site_id != VAR.My_Site_ID || sender_id < 1 ||
+	 sender_id > NUM_SERVERS_IN_SITE || !auth_keys_read ) {
+	return 0;
+    }
+
+    OPENSSL_RSA_Make_Digest( ((byte*)mess) + SIGNATURE_SIZE, 
+	    mess->len + sizeof(signed_message) - SIGNATURE_SIZE, digest ); 
+
+    AUTH_Make_MAC( auth_keys[sender_id], digest, mac );
+
+    return CRYPTO_memcmp( mac, 
+	    mess->sig + (VAR.My_Server_ID - 1) * AUTH_MAC_SIZE,
+	    AUTH_MAC_SIZE ) == 0;
+}
+
+/* The key of a pair of servers is stored under the smaller id first. */
+void AUTH_Key_File_Name( char *name, int32u site, int32u server_a, 
+	int32u server_b ) {
+
+    if ( server_a > server_b ) {
+	sprintf( name, "./keys/mac_%02d_%02d_%02d.key", site, server_b,
+		server_a );
+    } else {
+	sprintf( name, "./keys/mac_%02d_%02d_%02d.key", site, server_a,
+		server_b );
+    }
+}
+
+/* Read the keys I share with each server of my site (and with myself, since
+ * my own entry is part of every authenticator I make). */
+void AUTH_Read_Keys( int32u my_number, int32u my_site ) {
+
+    FILE *f;
+    char name[80];
+    unsigned int b;
+    int32u s, i;
+
+    for ( s = 1; s <= NUM_SERVERS_IN_SITE; s++ ) {
+	AUTH_Key_File_Name( name, my_site, my_number, s );
+	f = fopen( name, "r" );
+	if ( f == NULL ) {
+	    Alarm(EXIT,"   ERROR: Could not open the key file: %s\n", name );
+	}
+	for ( i = 0; i < AUTH_KEY_SIZE; i++ ) {
+	    if ( fscanf( f, "%2x", &b ) != 1 ) {
+		Alarm(EXIT,"   ERROR: Bad key file: %s\n", name );
+	    }
+	    auth_keys[s][i] = b;
+	}
+	fclose( f );
+    }
+
+    auth_keys_read = 1;
+}
+
+/* Write a fresh key for every pair of servers in every site. */
+void AUTH_Generate_Keys() {
+
+    FILE *f;
+    char name[80];
+    byte key[AUTH_KEY_SIZE];
+    int32u nsite, a, b, i;
+
+    for ( nsite = 1; nsite <= NUM_SITES; nsite++ ) {
+	for ( a = 1; a <= NUM_SERVERS_IN_SITE; a++ ) {
+	    for ( b = a; b <= NUM_SERVERS_IN_SITE; b++ ) {
+		if ( RAND_bytes( key, AUTH_KEY_SIZE ) != 1 ) {
+		    Alarm(EXIT,"AUTH_Generate_Keys: No random bytes.\n");
+		}
+		AUTH_Key_File_Name( name, nsite, a, b );
+		f = fopen( name, "w" );
+		if ( f == NULL ) {
+		    Alarm(EXIT,"   ERROR: Could not open the key file: %s\n",
+			    name );
+		}
+		for ( i = 0; i < AUTH_KEY_SIZE; i++ ) {
+		    fprintf( f, "%02x", key[i] );
+		}
+		fprintf( f, "\n" );
+		fclose( f );
+	    }
+	}
+    }
+}
@@ -0,0 +1,59 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+/* Authentication of server messages. Each signed_message carries either an
+ * RSA signature or, for the messages that servers of a site send only to each
+ * other, an authenticator: one MAC of the message digest for each server in
+ * the site, each under a key that the sender shares with that server. The
+ * scheme is chosen by message type, so a sender and its receivers always
+ * agree on it. */
+
+#ifndef AUTH_K3NW8QZ1VB6YJ2TD5XHR
+#define AUTH_K3NW8QZ1VB6YJ2TD5XHR 1
+
+#include "data_structs.h"
+#include "openssl_rsa.h"
+
+#define AUTH_SCHEME_RSA   1    /* RSA signature (or a Merkle root signature) */
+#define AUTH_SCHEME_MAC   2    /* Authenticator of pairwise HMACs */
+
+#define AUTH_KEY_SIZE     20   /* Bytes in a pairwise key */
+#define AUTH_MAC_SIZE     16   /* Bytes kept of each HMAC-SHA1 */
+
+/* Public functions */
+
+int32u AUTH_Scheme( int32u type );
+
+int32u AUTH_Authenticate_Message( signed_message *mess ); 
+
+int32u AUTH_Verify_Message( signed_message *mess, int32u sender_id, 
+	int32u site_id ); 
+
+void AUTH_Read_Keys( int32u my_number, int32u my_site ); 
+
+void AUTH_Generate_Keys(); 
+
+#endif
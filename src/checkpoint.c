@@ -0,0 +1,555 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* Checkpointing and history truncation. Every CHECKPOINT_INTERVAL executed
+ * global sequence numbers, the servers in a site threshold sign a checkpoint
+ * carrying a digest that is chained over the update batches executed so far.
+ * Each server sends its site's checkpoint to the server with the same id in
+ * every other site. A checkpoint is stable once I have reached it and a
+ * majority of sites have reached it or a later one. Global and pending slots
+ * at or below the stable checkpoint are freed, and a reconciliation request
+ * for a freed slot is answered with a checkpoint reply carrying my latest
+ * checkpoint. A server moves its aru up to a checkpoint only on such a reply:
+ * as long as peers still hold the slots, it keeps reconciling them. */
+
+#include "data_structs.h"
+#include "checkpoint.h"
+#include "utility.h"
+#include "threshold_sign.h"
+#include "meta_globally_order.h"
+#include "assign_sequence.h"
+#include "global_reconciliation.h"
+#include "openssl_rsa.h"
+#include "timeouts.h"
+#include "util/alarm.h"
+#include "util/memory.h"
+#include <string.h>
+
+/* Globally Accessible Variables */
+
+extern server_variables VAR;
+
+extern global_data_struct GLOBAL;
+
+extern pending_data_struct PENDING;
+
+/* Local variables */
+
+/* Digest chained over the update batches of every executed seq number */
+byte ckpt_state_digest[DIGEST_SIZE];
+
+/* The state digest at the last checkpoint that I executed */
+int32u ckpt_my_seq;
+byte ckpt_my_digest[DIGEST_SIZE];
+
+/* Signature shares on the checkpoint that my site is signing */
+int32u ckpt_share_seq;
+signed_message *ckpt_share[NUM_SERVER_SLOTS];
+
+/* The latest checkpoint received from each site */
+signed_message *ckpt_site[NUM_SITES+1];
+
+/* The latest checkpoint that matches my own state. This is sent in place of
+ * slots that have been freed. */
+signed_message *ckpt_own;
+
+/* The stable checkpoint, and the seq at or below which slots are freed */
+int32u ckpt_stable_seq;
+int32u ckpt_gc_seq;
+
+/* Local Functions */
+signed_message* CKPT_Construct_Checkpoint( int32u seq_num ); 
+int32u CKPT_Seq( signed_message *ckpt ); 
+void CKPT_Handle_Checkpoint( signed_message *ckpt ); 
+void CKPT_Set_Own( signed_message *ckpt ); 
+void CKPT_Update_Stable_Seq(); 
+void CKPT_Adopt( signed_message *ckpt ); 
+void CKPT_Clear_Shares(); 
+void CKPT_Garbage_Collect( int dummy, void *dummyp ); 
+void CKPT_Release_Global_Slot( global_slot_struct *slot ); 
+void CKPT_Release_Pending_Slot( pending_slot_struct *slot ); 
+
+void CKPT_Initialize() {
+
+    int32u si;
+
+    memset( ckpt_state_digest, 0, DIGEST_SIZE );
+    memset( ckpt_my_digest, 0, DIGEST_SIZE );
+    ckpt_my_seq = 0;
+
+    ckpt_share_seq = 0;
+    for ( si = 0; si <= NUM_SERVERS_IN_SITE; si++ ) {
+	ckpt_share[si] = NULL;
+    }
+
+    for ( si = 0; si <= NUM_SITES; si++ ) {
+	ckpt_site[si] = NULL;
+    }
+    ckpt_own = NULL;
+
+    ckpt_stable_seq = 0;
+    ckpt_gc_seq = 0;
+
+}
+
+void CKPT_Process_Executed_Proposal( signed_message *proposal ) {
+
+    proposal_message *proposal_specific;
+    signed_message *ckpt;
+    byte chain[2*DIGEST_SIZE];
+    int32u site;
+
+    proposal_specific = (proposal_message*)(proposal+1);
+
+    /* The views in a proposal can differ between sites, so only the batch of
+     * updates goes into the digest. */
+    memcpy( chain, ckpt_state_digest, DIGEST_SIZE );
+    OPENSSL_RSA_Make_Digest( (byte*)(proposal_specific+1), 
+	    proposal->len - sizeof(proposal_message), chain + DIGEST_SIZE );
+    OPENSSL_RSA_Make_Digest( chain, 2*DIGEST_SIZE, ckpt_state_digest );
+
+    if ( proposal_specific->seq_num % CHECKPOINT_INTERVAL != 0 ) {
+	return;
+    }
+
+    ckpt_my_seq = proposal_specific->seq_num;
+    memcpy( ckpt_my_digest, ckpt_state_digest, DIGEST_SIZE );
+
+    /* Another site may have signed this checkpoint before I got here */
+    for ( site = 1; site <= NUM_SITES; site++ ) {
+	CKPT_Set_Own( ckpt_site[site] );
+    }
+
+    Alarm(GLO_PRINT,"%d %d Sending share for checkpoint %d\n",
+	    VAR.My_Site_ID, VAR.My_Server_ID, ckpt_my_seq );
+
+    ckpt = CKPT_Construct_Checkpoint( ckpt_my_seq );
+    THRESH_Invoke_Threshold_Signature( ckpt );
+    dec_ref_cnt( ckpt );
+
+}
+
+signed_message* CKPT_Construct_Checkpoint( int32u seq_num ) {
+
+    signed_message *ckpt;
+    checkpoint_message *ckpt_specific;
+
+    ckpt = UTIL_New_Signed_Message();
+    ckpt_specific = (checkpoint_message*)(ckpt+1);
+
+    ckpt->site_id    = VAR.My_Site_ID;
+    ckpt->machine_id = 0;
+    ckpt->type       = CHECKPOINT_TYPE;
+    ckpt->len        = sizeof(checkpoint_message);
+
+    ckpt_specific->seq_num = seq_num;
+    memcpy( ckpt_specific->state_digest, ckpt_my_digest, DIGEST_SIZE );
+
+    /* NOTE: This is a signature share message so we don't sign it. This is
+     * done in the threshold_sign code. */
+
+    return ckpt;
+
+}
+
+int32u CKPT_Seq( signed_message *ckpt ) {
+
+    if ( ckpt == NULL ) {
+	return 0;
+    }
+
+    return ((checkpoint_message*)(ckpt+1))->seq_num;
+
+}
+
+void CKPT_Apply_Sig_Share( signed_message *sig_share ) {
+
+    signed_message *ckpt;
+    int32u seq_num;
+    int32u si;
+    int32u scount;
+    int32u si_dest;
+
+    seq_num = CKPT_Seq( (signed_message*)
+	    (((sig_share_message*)(sig_share+1))+1) );
+
+    /* Only keep shares for the newest checkpoint that my site has not yet
+     * signed */
+    if ( seq_num <= CKPT_Seq( ckpt_site[VAR.My_Site_ID] ) || 
+	 seq_num < ckpt_share_seq ) {
+	return;
+    }
+
+    if ( seq_num > ckpt_share_seq ) {
+	CKPT_Clear_Shares();
+	ckpt_share_seq = seq_num;
+    }
+
+    if ( ckpt_share[sig_share->machine_id] != NULL ) {
+	return;
+    }
+
+    /* Store the share */
+    ckpt_share[sig_share->machine_id] = sig_share;
+    inc_ref_cnt(sig_share);
+
+    scount = 0;
+    for ( si = 1; si <= NUM_SERVERS_IN_SITE; si++ ) {
+	if ( ckpt_share[si] != NULL ) {
+	    scount++;
+	}
+    }
+
+    if ( scount < 2*VAR.Faults+1 ) {
+	return;
+    }
+
+    /* Combine the signature shares and create a new checkpoint. */
+    ckpt = UTIL_New_Signed_Message();
+
+    if ( !THRESH_Attempt_To_Combine( ckpt_share, ckpt ) ) {
+	dec_ref_cnt( ckpt );
+	return;
+    }
+
+    CKPT_Clear_Shares();
+
+    Alarm(GLO_PRINT,"%d %d Generated checkpoint %d\n",
+	    VAR.My_Site_ID, VAR.My_Server_ID, seq_num );
+
+    CKPT_Handle_Checkpoint( ckpt );
+
+    /* Send it to my peer in each of the other sites */
+    for ( si_dest = 1; si_dest <= NUM_SITES; si_dest++ ) {
+	if ( si_dest != VAR.My_Site_ID ) {
+	    UTIL_Send_To_Server( ckpt, si_dest, VAR.My_Server_ID );
+	}
+    }
+
+    dec_ref_cnt( ckpt );
+
+}
+
+void CKPT_Clear_Shares() {
+
+    int32u si;
+
+    for ( si = 1; si <= NUM_SERVERS_IN_SITE; si++ ) {
+	UTIL_PURGE( &ckpt_share[si] );
+    }
+
+}
+
+void CKPT_Process_Checkpoint( signed_message *mess ) {
+
+    Alarm(GLO_PRINT,"%d %d Received checkpoint %d from site %d\n",
+	    VAR.My_Site_ID, VAR.My_Server_ID, CKPT_Seq(mess), mess->site_id );
+
+    CKPT_Handle_Checkpoint( mess );
+
+}
+
+/* Store a threshold signed checkpoint as the latest one from its site */
+void CKPT_Handle_Checkpoint( signed_message *ckpt ) {
+
+    checkpoint_message *ckpt_specific;
+    int32u site;
+
+    ckpt_specific = (checkpoint_message*)(ckpt+1);
+    site = ckpt->site_id;
+
+    if ( ckpt_specific->seq_num <= CKPT_Seq( ckpt_site[site] ) ) {
+	return;
+    }
+
+    if ( ckpt_specific->seq_num == ckpt_my_seq &&
+	 memcmp( ckpt_specific->state_digest, ckpt_my_digest, 
+	     DIGEST_SIZE ) != 0 ) {
+	Alarm(PRINT,"%d %d CKPT: site %d executed a different history up to"
+		" seq %d\n", VAR.My_Site_ID, VAR.My_Server_ID, site, 
+		ckpt_specific->seq_num );
+	return;
+    }
+
+    if ( ckpt_site[site] != NULL ) {
+	dec_ref_cnt( ckpt_site[site] );
+    }
+    inc_ref_cnt( ckpt );
+    ckpt_site[site] = ckpt;
+
+    if ( ckpt_specific->seq_num > GLOBAL.ARU ) {
+	/* I am behind. Reconcile up to the checkpoint. If the slots have been
+	 * freed, a checkpoint reply moves me up to it. */
+	GRECON_Start_Reconciliation( ckpt_specific->seq_num );
+    } else {
+	CKPT_Set_Own( ckpt );
+    }
+
+    CKPT_Update_Stable_Seq();
+
+}
+
+/* Make a checkpoint my own if it is for the last checkpoint that I executed
+ * and it matches my state */
+void CKPT_Set_Own( signed_message *ckpt ) {
+
+    checkpoint_message *ckpt_specific;
+
+    if ( ckpt == NULL ) {
+	return;
+    }
+
+    ckpt_specific = (checkpoint_message*)(ckpt+1);
+
+    if ( ckpt_specific->seq_num != ckpt_my_seq || 
+	 ckpt_specific->seq_num <= CKPT_Seq( ckpt_own ) ||
+	 memcmp( ckpt_specific->state_digest, ckpt_my_digest, 
+	     DIGEST_SIZE ) != 0 ) {
+	return;
+    }
+
+    if ( ckpt_own != NULL ) {
+	dec_ref_cnt( ckpt_own );
+    }
+    inc_ref_cnt( ckpt );
+    ckpt_own = ckpt;
+
+    CKPT_Update_Stable_Seq();
+
+}
+
+void CKPT_Update_Stable_Seq() {
+
+    int32u site;
+    int32u si;
+    int32u count;
+    int32u candidate;
+    int32u stable;
+    int32u seq[NUM_SITES+1];
+
+    /* A site counts as having reached a checkpoint if it has signed that
+     * checkpoint or a later one. I must have reached it myself so that I can
+     * send it in place of the slots. */
+    for ( site = 1; site <= NUM_SITES; site++ ) {
+	seq[site] = CKPT_Seq( ckpt_site[site] );
+	if ( site == VAR.My_Site_ID || seq[site] > CKPT_Seq( ckpt_own ) ) {
+	    seq[site] = CKPT_Seq( ckpt_own );
+	}
+    }
+
+    stable = 0;
+    for ( site = 1; site <= NUM_SITES; site++ ) {
+	candidate = seq[site];
+	if ( candidate <= stable ) {
+	    continue;
+	}
+	count = 0;
+	for ( si = 1; si <= NUM_SITES; si++ ) {
+	    if ( seq[si] >= candidate ) {
+		count++;
+	    }
+	}
+	if ( count > NUM_SITES / 2 ) {
+	    stable = candidate;
+	}
+    }
+
+    if ( stable <= ckpt_stable_seq ) {
+	return;
+    }
+
+    ckpt_stable_seq = stable;
+
+    Alarm(GLO_PRINT,"%d %d Stable checkpoint %d\n",
+	    VAR.My_Site_ID, VAR.My_Server_ID, ckpt_stable_seq );
+
+    if ( ckpt_stable_seq > ckpt_gc_seq ) {
+	ckpt_gc_seq = ckpt_stable_seq;
+	/* Slots may be in use further up the stack */
+	E_queue( CKPT_Garbage_Collect, 0, NULL, timeout_zero );
+    }
+
+}
+
+/* Free all global and pending slots at or below the stable checkpoint. Slots
+ * that were created again by late messages are freed at the next
+ * checkpoint. */
+void CKPT_Garbage_Collect( int dummy, void *dummyp ) {
+
+    int32u pending_gc_seq;
+    int32u freed;
+
+    freed = UTIL_Remove_Global_Slots( ckpt_gc_seq, CKPT_Release_Global_Slot );
+
+    /* Pending slots above the pending aru may still be in use by the local
+     * ordering. */
+    pending_gc_seq = ckpt_gc_seq;
+    if ( pending_gc_seq > PENDING.ARU ) {
+	pending_gc_seq = PENDING.ARU;
+    }
+
+    freed += UTIL_Remove_Pending_Slots( pending_gc_seq, 
+	    CKPT_Release_Pending_Slot );
+
+    Alarm(GLO_PRINT,"%d %d Freed %d slots at or below %d\n",
+	    VAR.My_Site_ID, VAR.My_Server_ID, freed, ckpt_gc_seq );
+
+}
+
+void CKPT_Release_Global_Slot( global_slot_struct *slot ) {
+
+    int32u si;
+
+    GLOBO_Garbage_Collect_Global_Slot( slot );
+    UTIL_PURGE( &slot->ordered_proof );
+    UTIL_PURGE( &slot->proposal );
+    for ( si = 1; si <= NUM_SITES; si++ ) {
+	UTIL_PURGE( &slot->accept[si] );
+    }
+    dec_ref_cnt( slot );
+
+}
+
+void CKPT_Release_Pending_Slot( pending_slot_struct *slot ) {
+
+    ASEQ_Garbage_Collect_Pending_Slot( slot );
+    UTIL_PURGE( &slot->proposal );
+    dec_ref_cnt( slot );
+
+}
+
+int32u CKPT_Send_Checkpoint( int32u seq_num, int32u site, int32u server ) {
+
+    signed_message *reply;
+    checkpoint_reply_message *reply_specific;
+
+    if ( seq_num > ckpt_gc_seq || seq_num > CKPT_Seq( ckpt_own ) ) {
+	return 0;
+    }
+
+    Alarm(GRECON_PRINT,"Sending checkpoint %d for freed seq %d\n",
+	    CKPT_Seq( ckpt_own ), seq_num );
+
+    reply = UTIL_New_Signed_Message();
+    reply_specific = (checkpoint_reply_message*)(reply+1);
+
+    reply->site_id    = VAR.My_Site_ID;
+    reply->machine_id = VAR.My_Server_ID;
+    reply->type       = CHECKPOINT_REPLY_TYPE;
+    reply->len        = sizeof(checkpoint_reply_message) + 
+	sizeof(signed_message) + ckpt_own->len;
+
+    reply_specific->seq_num = seq_num;
+    memcpy( reply_specific+1, ckpt_own, 
+	    sizeof(signed_message) + ckpt_own->len );
+
+    UTIL_RSA_Sign_Message( reply );
+
+    if ( site == 0 || server == 0 ) {
+	UTIL_Site_Broadcast( reply );
+    } else {
+	UTIL_Send_To_Server( reply, site, server );
+    }
+    dec_ref_cnt( reply );
+
+    return 1;
+
+}
+
+/* A peer has freed the slot that I asked for, so no one will send it to me
+ * and I move up to the checkpoint that it was freed below. The checkpoint is
+ * taken even if I already hold it, or a later one, from its site. */
+void CKPT_Process_Checkpoint_Reply( signed_message *mess ) {
+
+    checkpoint_reply_message *reply_specific;
+    signed_message *ckpt;
+
+    reply_specific = (checkpoint_reply_message*)(mess+1);
+
+    Alarm(GLO_PRINT,"%d %d Received checkpoint reply %d for seq %d from"
+	    " %d %d\n", VAR.My_Site_ID, VAR.My_Server_ID, 
+	    CKPT_Seq( (signed_message*)(reply_specific+1) ), 
+	    reply_specific->seq_num, mess->site_id, mess->machine_id );
+
+    /* Only a reply to the request for my next seq moves me */
+    if ( reply_specific->seq_num != GLOBAL.ARU + 1 ) {
+	return;
+    }
+
+    ckpt = UTIL_New_Signed_Message();
+    memcpy( ckpt, reply_specific+1, 
+	    sizeof(signed_message) + sizeof(checkpoint_message) );
+
+    CKPT_Handle_Checkpoint( ckpt );
+    CKPT_Adopt( ckpt );
+
+    dec_ref_cnt( ckpt );
+
+}
+
+void CKPT_Adopt( signed_message *ckpt ) {
+
+    checkpoint_message *ckpt_specific;
+
+    ckpt_specific = (checkpoint_message*)(ckpt+1);
+
+    Alarm(PRINT,"%d %d CKPT: moving global aru from %d to checkpoint %d of"
+	    " site %d\n", VAR.My_Site_ID, VAR.My_Server_ID, GLOBAL.ARU,
+	    ckpt_specific->seq_num, ckpt->site_id );
+
+    /* The updates between my aru and the checkpoint are not executed */
+    GLOBAL.ARU = ckpt_specific->seq_num;
+    UTIL_Refresh_Alarm_Prefix();
+    if ( GLOBAL.Max_ordered < GLOBAL.ARU ) {
+	GLOBAL.Max_ordered = GLOBAL.ARU;
+    }
+    if ( PENDING.ARU < GLOBAL.ARU ) {
+	PENDING.ARU = GLOBAL.ARU;
+    }
+    if ( PENDING.Max_ordered < GLOBAL.ARU ) {
+	PENDING.Max_ordered = GLOBAL.ARU;
+    }
+    if ( VAR.Global_seq < GLOBAL.ARU ) {
+	VAR.Global_seq = GLOBAL.ARU;
+    }
+
+    memcpy( ckpt_state_digest, ckpt_specific->state_digest, DIGEST_SIZE );
+    memcpy( ckpt_my_digest, ckpt_specific->state_digest, DIGEST_SIZE );
+    ckpt_my_seq = ckpt_specific->seq_num;
+    CKPT_Set_Own( ckpt );
+
+    /* None of the slots at or below the checkpoint are of use now */
+    if ( GLOBAL.ARU > ckpt_gc_seq ) {
+	ckpt_gc_seq = GLOBAL.ARU;
+	E_queue( CKPT_Garbage_Collect, 0, NULL, timeout_zero );
+    }
+
+    /* Slots above the checkpoint may already be ordered */
+    GLOBO_Update_ARU();
+    ASEQ_Update_ARU();
+
+}
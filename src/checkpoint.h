@@ -0,0 +1,52 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+#ifndef CHECKPOINT_Q7WN3KD8ZP2MAX5RT4HB
+#define CHECKPOINT_Q7WN3KD8ZP2MAX5RT4HB
+
+#include "data_structs.h"
+
+void CKPT_Initialize();
+
+/* Fold a proposal that was just executed into the state digest and, at a
+ * checkpoint interval, threshold sign a checkpoint. */
+void CKPT_Process_Executed_Proposal( signed_message *proposal );
+
+void CKPT_Apply_Sig_Share( signed_message *sig_share );
+
+void CKPT_Process_Checkpoint( signed_message *mess );
+
+/* Answer a reconciliation request for a slot that has been freed with the
+ * checkpoint it was freed below. Returns 1 if a reply was sent. */
+int32u CKPT_Send_Checkpoint( int32u seq_num, int32u site, int32u server );
+
+/* Move my aru up to the checkpoint in a reply to my reconciliation request */
+void CKPT_Process_Checkpoint_Reply( signed_message *mess );
+
+int32u CKPT_Stable_Seq();
+
+#endif
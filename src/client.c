@@ -29,6 +29,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <math.h>
 
 #include "util/arch.h"
 #include "util/alarm.h"
@@ -56,6 +57,25 @@ extern server_variables VAR;
 
 #define MAX_ACTIONS 200000 
 
+/* Benchmark mode. When an offered load is given with -r, the client sends
+ * updates at that rate (fixed spacing, or Poisson arrivals with -P) whether or
+ * not earlier ones have been ordered, keeping up to -o of them outstanding.
+ * An update that comes due while the limit is reached is skipped and counted.
+ * Latency is measured from the time an update was due, so a slow system is
+ * not hidden by the client falling behind. Every -t seconds one line of
+ * counters and latency percentiles is written to bench.<site>_<client>.log,
+ * and a summary line is written when the run ends. */
+#define BENCH_WINDOW        1024  /* Max outstanding updates (power of 2) */
+#define BENCH_OFFER_BURST   32    /* Max updates sent per timer callback */
+#define BENCH_DRAIN_SEC     10    /* Wait this long for the last replies */
+
+/* Latencies are kept in microseconds in a log-linear histogram: values below
+ * 2 * BENCH_HIST_HALF are counted exactly, and each power of 2 above that is
+ * split into BENCH_HIST_HALF buckets, so a reported value is within 1/64 of
+ * the real one. */
+#define BENCH_HIST_HALF     64
+#define BENCH_HIST_BUCKETS  ((32 - 7 + 2) * BENCH_HIST_HALF)
+
 
 /* Client Variables */
 
@@ -91,6 +111,7 @@ void CLIENT_Init_State_File();
 
 void Send_Next_Action();
 void Send_Update();
+signed_message *Construct_Update();
 void Send_Query();
 
 void Reset_Query_Data();
@@ -105,6 +126,62 @@ signed_message *pending_update;
 
 double Latencies[MAX_ACTIONS];
 
+/* Benchmark Variables */
+
+typedef struct dummy_bench_slot {
+    signed_message *update;   /* NULL if the slot is free */
+    sp_time         offered;  /* When the update came due */
+    sp_time         sent;     /* When it was last sent */
+} bench_slot;
+
+typedef struct dummy_bench_hist {
+    int32u count[BENCH_HIST_BUCKETS];
+    int32u total;
+    int32u max;
+} bench_hist;
+
+typedef struct dummy_bench_counts {
+    int32u offered;           /* Updates that came due */
+    int32u skipped;           /* ... but found the window full */
+    int32u done;              /* Updates ordered */
+    int32u lost;              /* Updates given up on */
+    int32u resent;            /* Retransmissions */
+} bench_counts;
+
+double Bench_Rate = 0;              /* Offered updates/sec, 0 = closed loop */
+int32u Bench_Poisson = 0;
+int32u Bench_Max_Outstanding = 64;
+int32u Bench_Duration = 60;         /* Seconds of offered load */
+int32u Bench_Interval = 1;          /* Seconds between report lines */
+
+static bench_slot   Bench_Window[BENCH_WINDOW];
+static int32u       Bench_Outstanding;
+static int32u       Bench_Highest_Done;
+static int32u       Bench_Offering;
+static sp_time      Bench_Start_Time;
+static sp_time      Bench_End_Time;
+static sp_time      Bench_Next_Offer;
+static sp_time      Bench_Last_Report;
+static bench_hist   Bench_Interval_Hist;
+static bench_hist   Bench_Total_Hist;
+static bench_counts Bench_Interval_Counts;
+static bench_counts Bench_Total_Counts;
+static FILE        *Bench_Log;
+
+static void   Bench_Start(void);
+static void   Bench_Offer( int dummy, void *dummyp );
+static void   Bench_Send( sp_time offered );
+static void   Bench_Process_Proposal( signed_message *proposal );
+static void   Bench_Retransmit( int dummy, void *dummyp );
+static void   Bench_Report( int dummy, void *dummyp );
+static void   Bench_Finish(void);
+static void   Bench_Write_Line( const char *label, double elapsed,
+				bench_counts *counts, bench_hist *hist );
+static sp_time Bench_Interarrival(void);
+static void   Bench_Hist_Record( bench_hist *hist, double latency );
+static int32u Bench_Hist_Percentile( bench_hist *hist, double p );
+static double Bench_Elapsed( sp_time from, sp_time to );
+
 /***********************************************************/
 /* int main(int argc, char* argv[])                        */
 /*                                                         */
@@ -161,10 +238,14 @@ int main(int argc, char* argv[])
     UTIL_Load_Addresses(); 
     UTIL_Test_Server_Address_Functions(); 
 
-    Send_Next_Action();
+    if ( Bench_Rate > 0 ) {
+	Bench_Start();
+    } else {
+	Send_Next_Action();
 
-    E_queue( Client_Is_Finished, 0, NULL, timeout_client );
-    E_queue( Retransmit_Request, 0, NULL, timeout_zero ); 
+	E_queue( Client_Is_Finished, 0, NULL, timeout_client );
+	E_queue( Retransmit_Request, 0, NULL, timeout_zero ); 
+    }
     
     E_handle_events();
 
@@ -255,12 +336,47 @@ static void    Usage(int argc, char *argv[])
 		      NUM_SITES);
 	    }
 	    argc--; argv++;
+	}else if((argc > 1)&&(!strncmp(*argv, "-r", 3))) {
+	    sscanf(argv[1], "%lf", &Bench_Rate);
+	    if(Bench_Rate <= 0) {
+		Alarm(EXIT, "Invalid offered load %s\n", argv[1]);
+	    }
+	    argc--; argv++;
+	}else if(!strncmp(*argv, "-P", 3)) {
+	    Bench_Poisson = 1;
+	}else if((argc > 1)&&(!strncmp(*argv, "-o", 3))) {
+	    sscanf(argv[1], "%d", &tmp);
+	    if(tmp < 1 || tmp > BENCH_WINDOW) {
+		Alarm(EXIT, "Outstanding updates must be 1 to %d\n",
+		      BENCH_WINDOW);
+	    }
+	    Bench_Max_Outstanding = tmp;
+	    argc--; argv++;
+	}else if((argc > 1)&&(!strncmp(*argv, "-d", 3))) {
+	    sscanf(argv[1], "%d", &tmp);
+	    if(tmp < 1) {
+		Alarm(EXIT, "Invalid duration %d\n", tmp);
+	    }
+	    Bench_Duration = tmp;
+	    argc--; argv++;
+	}else if((argc > 1)&&(!strncmp(*argv, "-t", 3))) {
+	    sscanf(argv[1], "%d", &tmp);
+	    if(tmp < 1) {
+		Alarm(EXIT, "Invalid report interval %d\n", tmp);
+	    }
+	    Bench_Interval = tmp;
+	    argc--; argv++;
 	} else{
 		Alarm(PRINT, "ERR: %d | %s\n", argc, *argv);	
-		Alarm(PRINT, "Usage: \n%s\n%s\n%s\n",
+		Alarm(PRINT, "Usage: \n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n",
 		      "\t[-l <IP address>   ] : local address,",
-		      "\t[-i <local ID>     ] : local ID, indexed base 1, default is 1"
-		      "\t[-s <site  ID>     ] : site  ID, indexed base 1, default is 1"
+		      "\t[-i <local ID>     ] : local ID, indexed base 1, default is 1",
+		      "\t[-s <site  ID>     ] : site  ID, indexed base 1, default is 1",
+		      "\t[-r <updates/sec>  ] : offered load, runs the benchmark",
+		      "\t[-P                ] : Poisson arrivals, default is fixed rate",
+		      "\t[-o <outstanding>  ] : max updates in flight, default is 64",
+		      "\t[-d <seconds>      ] : length of the run, default is 60",
+		      "\t[-t <seconds>      ] : report interval, default is 1"
 		);
 		Alarm(EXIT, "Bye...\n");
 	}
@@ -415,10 +531,12 @@ void Process_Message( signed_message *mess, int32u num_bytes )
   update_message   *update_specific;
   signed_message   *ret_proposal;
   int32u caller_is_client;
+  byte             *batch;
+  int32u           batch_len;
 
 
   /* I should not receive responses if I have no pending update */
-  if(pending_update == NULL)
+  if(Bench_Rate == 0 && pending_update == NULL)
     return;
 
   /* The response comes in the form of a Complete_Ordered_Proof message.
@@ -435,17 +553,30 @@ void Process_Message( signed_message *mess, int32u num_bytes )
     return;
   }
 
-  /* Make sure the client id and timestamp match my pending update */
+  if(Bench_Rate > 0) {
+    Bench_Process_Proposal(ret_proposal);
+    dec_ref_cnt(ret_proposal);
+    return;
+  }
+
+  /* Find my update in the ordered batch. Make sure the client id and
+   * timestamp match my pending update */
   proposal_specific = (proposal_message *)(ret_proposal + 1);
-  update            = (signed_message *)(proposal_specific+1);
-  update_specific   = (update_message *)(update+1);
+  batch             = (byte *)(proposal_specific+1);
+  batch_len         = ret_proposal->len - sizeof(proposal_message);
+
+  for(update = UTIL_Next_Batched_Update(batch, batch_len, NULL);
+      update != NULL;
+      update = UTIL_Next_Batched_Update(batch, batch_len, update)) {
+    if(update->machine_id == My_Client_ID && update->site_id == My_Site_ID)
+      break;
+  }
 
-  if(update->machine_id != My_Client_ID)
-    return;
-      
-  if(update->site_id != My_Site_ID)
+  if(update == NULL)
     return;
 
+  update_specific = (update_message *)(update+1);
+
   if(update_specific->time_stamp != 
      ((update_message *)(pending_update+1))->time_stamp) {
     Alarm(/*PRINT*/DEBUG, "Timestamp was %d, expecting %d\n", 
@@ -507,14 +638,11 @@ void Send_Next_Action()
   }
 }
 
-void Send_Update() {
+signed_message *Construct_Update() {
 
     signed_message *update;
     update_message *update_specific;
 
-    UTIL_Stopwatch_Start(&sw);
-    UTIL_Stopwatch_Start(&latency_sw);
-  
     update = UTIL_New_Signed_Message();
 
     update_specific = (update_message*)(update+1);
@@ -535,6 +663,18 @@ void Send_Update() {
     /* Sign the message */
     UTIL_RSA_Sign_Message( update );
 
+    return update;
+}
+
+void Send_Update() {
+
+    signed_message *update;
+
+    UTIL_Stopwatch_Start(&sw);
+    UTIL_Stopwatch_Start(&latency_sw);
+  
+    update = Construct_Update();
+
     /* Send to all servers, Note: could send to a single server that the client
      * choses */
     UTIL_Site_Broadcast( update );
@@ -666,6 +806,343 @@ void Send_Query()
   UTIL_Site_Broadcast(query);
 }
 
+/* Benchmark mode */
+
+static void Bench_Start(void)
+{
+    char fname[100];
+    sp_time report_time;
+
+    sprintf(fname, "bench.%02d_%02d.log", My_Site_ID, My_Client_ID);
+    Bench_Log = fopen(fname, "w");
+    if ( Bench_Log == NULL ) {
+	Alarm(EXIT, "Bench_Start: Could not open %s\n", fname);
+    }
+
+    Bench_Start_Time    = E_get_time();
+    Bench_End_Time      = Bench_Start_Time;
+    Bench_End_Time.sec += Bench_Duration;
+    Bench_Next_Offer    = Bench_Start_Time;
+    Bench_Last_Report   = Bench_Start_Time;
+    Bench_Highest_Done  = time_stamp;
+    Bench_Offering      = 1;
+
+    Alarm(PRINT, "Offering %.1f updates/sec (%s) for %d sec, "
+	  "at most %d outstanding\n", Bench_Rate,
+	  Bench_Poisson ? "Poisson" : "fixed", Bench_Duration,
+	  Bench_Max_Outstanding);
+
+    report_time.sec  = Bench_Interval;
+    report_time.usec = 0;
+
+    E_queue( Bench_Offer, 0, NULL, timeout_zero );
+    E_queue( Bench_Retransmit, 0, NULL, timeout_client );
+    E_queue( Bench_Report, 0, NULL, report_time );
+}
+
+static void Bench_Offer( int dummy, void *dummyp )
+{
+    sp_time now;
+    int32u burst;
+
+    now = E_get_time();
+
+    /* Send the updates that have come due, a bounded number at a time so
+     * that replies are still read when more is offered than can be signed */
+    for ( burst = 0; burst < BENCH_OFFER_BURST; burst++ ) {
+	if ( E_compare_time( Bench_Next_Offer, Bench_End_Time ) >= 0 ) {
+	    Bench_Offering = 0;
+	    return;
+	}
+	if ( E_compare_time( Bench_Next_Offer, now ) > 0 ) {
+	    break;
+	}
+	Bench_Send( Bench_Next_Offer );
+	Bench_Next_Offer = E_add_time( Bench_Next_Offer, 
+				       Bench_Interarrival() );
+    }
+
+    if ( burst == BENCH_OFFER_BURST ) {
+	E_queue( Bench_Offer, 0, NULL, timeout_zero );
+    } else {
+	E_queue( Bench_Offer, 0, NULL, E_sub_time( Bench_Next_Offer, now ) );
+    }
+}
+
+static sp_time Bench_Interarrival(void)
+{
+    double gap;
+    long usec;
+    sp_time t;
+
+    if ( Bench_Poisson ) {
+	/* Exponentially distributed, uniform taken from (0,1] */
+	gap = -log( (rand() + 1.0) / (RAND_MAX + 1.0) ) / Bench_Rate;
+    } else {
+	gap = 1.0 / Bench_Rate;
+    }
+
+    usec   = (long)(gap * 1000000.0 + 0.5);
+    t.sec  = usec / 1000000;
+    t.usec = usec % 1000000;
+
+    return t;
+}
+
+static void Bench_Send( sp_time offered )
+{
+    bench_slot *slot;
+
+    Bench_Interval_Counts.offered++;
+    Bench_Total_Counts.offered++;
+
+    /* The slot for the next timestamp can still hold an update sent a full
+     * window ago */
+    slot = &Bench_Window[ (time_stamp + 1) & (BENCH_WINDOW - 1) ];
+    if ( Bench_Outstanding >= Bench_Max_Outstanding || slot->update != NULL ) {
+	Bench_Interval_Counts.skipped++;
+	Bench_Total_Counts.skipped++;
+	return;
+    }
+
+    slot->update  = Construct_Update();
+    slot->offered = offered;
+    slot->sent    = E_get_time();
+    Bench_Outstanding++;
+
+    UTIL_Site_Broadcast( slot->update );
+}
+
+static void Bench_Process_Proposal( signed_message *proposal )
+{
+    proposal_message *proposal_specific;
+    signed_message   *update;
+    bench_slot       *slot;
+    byte             *batch;
+    int32u           batch_len;
+    int32u           ts;
+    double           latency;
+    sp_time          now;
+
+    now = E_get_time();
+
+    proposal_specific = (proposal_message *)(proposal + 1);
+    batch             = (byte *)(proposal_specific + 1);
+    batch_len         = proposal->len - sizeof(proposal_message);
+
+    /* Several of my updates can be ordered in the same batch */
+    for(update = UTIL_Next_Batched_Update(batch, batch_len, NULL);
+	update != NULL;
+	update = UTIL_Next_Batched_Update(batch, batch_len, update)) {
+
+	if(update->machine_id != My_Client_ID || update->site_id != My_Site_ID)
+	    continue;
+
+	ts   = ((update_message *)(update + 1))->time_stamp;
+	slot = &Bench_Window[ ts & (BENCH_WINDOW - 1) ];
+
+	/* Already answered, or given up on */
+	if ( slot->update == NULL || 
+	     ((update_message *)(slot->update + 1))->time_stamp != ts ) {
+	    continue;
+	}
+
+	latency = Bench_Elapsed( slot->offered, now );
+	Bench_Hist_Record( &Bench_Interval_Hist, latency );
+	Bench_Hist_Record( &Bench_Total_Hist, latency );
+	Bench_Interval_Counts.done++;
+	Bench_Total_Counts.done++;
+
+	if ( ts > Bench_Highest_Done ) {
+	    Bench_Highest_Done = ts;
+	}
+
+	dec_ref_cnt( slot->update );
+	slot->update = NULL;
+	Bench_Outstanding--;
+    }
+}
+
+static void Bench_Retransmit( int dummy, void *dummyp )
+{
+    bench_slot *slot;
+    sp_time now;
+    int32u i;
+
+    now = E_get_time();
+
+    for ( i = 0; i < BENCH_WINDOW; i++ ) {
+	slot = &Bench_Window[i];
+
+	if ( slot->update == NULL || 
+	     E_compare_time( E_sub_time( now, slot->sent ), 
+			     timeout_client ) < 0 ) {
+	    continue;
+	}
+
+	/* The leader site only accepts a timestamp above the last one it took
+	 * from this client, and only answers a retransmission of the last one
+	 * it ordered. An unanswered update older than one that has been
+	 * ordered will never be answered. */
+	if ( ((update_message *)(slot->update + 1))->time_stamp < 
+	     Bench_Highest_Done ) {
+	    Bench_Interval_Counts.lost++;
+	    Bench_Total_Counts.lost++;
+	    dec_ref_cnt( slot->update );
+	    slot->update = NULL;
+	    Bench_Outstanding--;
+	    continue;
+	}
+
+	UTIL_Site_Broadcast( slot->update );
+	slot->sent = now;
+	Bench_Interval_Counts.resent++;
+	Bench_Total_Counts.resent++;
+    }
+
+    E_queue( Bench_Retransmit, 0, NULL, timeout_client );
+}
+
+static void Bench_Report( int dummy, void *dummyp )
+{
+    sp_time now;
+    sp_time report_time;
+
+    now = E_get_time();
+
+    Bench_Write_Line( "interval", Bench_Elapsed( Bench_Last_Report, now ),
+		      &Bench_Interval_Counts, &Bench_Interval_Hist );
+
+    memset( &Bench_Interval_Counts, 0, sizeof(Bench_Interval_Counts) );
+    memset( &Bench_Interval_Hist, 0, sizeof(Bench_Interval_Hist) );
+    Bench_Last_Report = now;
+
+    if ( !Bench_Offering && 
+	 ( Bench_Outstanding == 0 || 
+	   Bench_Elapsed( Bench_End_Time, now ) >= BENCH_DRAIN_SEC ) ) {
+	Bench_Finish();
+    }
+
+    report_time.sec  = Bench_Interval;
+    report_time.usec = 0;
+    E_queue( Bench_Report, 0, NULL, report_time );
+}
+
+static void Bench_Finish(void)
+{
+    /* Whatever is still outstanding did not make it */
+    Bench_Total_Counts.lost += Bench_Outstanding;
+
+    Bench_Write_Line( "total", 
+		      Bench_Elapsed( Bench_Start_Time, Bench_Last_Report ),
+		      &Bench_Total_Counts, &Bench_Total_Hist );
+    fclose( Bench_Log );
+
+    Alarm(EXIT, "Client Exiting Site: %d ID: %d\n", My_Site_ID, My_Client_ID);
+}
+
+/* Writes one line of space separated key=value pairs, to the log and to
+ * stdout. Latencies are in microseconds. */
+static void Bench_Write_Line( const char *label, double elapsed,
+			      bench_counts *counts, bench_hist *hist )
+{
+    char line[400];
+
+    sprintf(line, "%s time=%.3f elapsed=%.3f site=%d client=%d rate=%.1f "
+	    "offered=%u skipped=%u done=%u lost=%u resent=%u outstanding=%u "
+	    "tput=%.1f p50_us=%u p99_us=%u p999_us=%u max_us=%u\n",
+	    label, Bench_Elapsed( Bench_Start_Time, E_get_time() ), elapsed,
+	    My_Site_ID, My_Client_ID, Bench_Rate,
+	    counts->offered, counts->skipped, counts->done, counts->lost,
+	    counts->resent, Bench_Outstanding,
+	    elapsed > 0 ? counts->done / elapsed : 0.0,
+	    Bench_Hist_Percentile( hist, 0.50 ), 
+	    Bench_Hist_Percentile( hist, 0.99 ),
+	    Bench_Hist_Percentile( hist, 0.999 ), hist->max);
+
+    fputs( line, Bench_Log );
+    fflush( Bench_Log );
+    fputs( line, stdout );
+    fflush( stdout );
+}
+
+static void Bench_Hist_Record( bench_hist *hist, double latency )
+{
+    int32u usec;
+    int32u index;
+    int32u shift;
+
+    if ( latency <= 0 ) {
+	usec = 0;
+    } else if ( latency >= 4294.0 ) {
+	usec = 0xffffffff;
+    } else {
+	usec = (int32u)(latency * 1000000.0);
+    }
+
+    if ( usec < 2 * BENCH_HIST_HALF ) {
+	index = usec;
+    } else {
+	for ( shift = 1; (usec >> shift) >= 2 * BENCH_HIST_HALF; shift++ );
+	index = shift * BENCH_HIST_HALF + (usec >> shift);
+    }
+
+    hist->count[index]++;
+    hist->total++;
+    if ( usec > hist->max ) {
+	hist->max = usec;
+    }
+}
+
+static int32u Bench_Hist_Percentile( bench_hist *hist, double p )
+{
+    int32u target;
+    int32u seen;
+    int32u index;
+    int32u shift;
+    int32u value;
+
+    if ( hist->total == 0 ) {
+	return 0;
+    }
+
+    target = (int32u)ceil( p * hist->total );
+    if ( target == 0 ) {
+	target = 1;
+    }
+
+    seen = 0;
+    for ( index = 0; index < BENCH_HIST_BUCKETS - 1; index++ ) {
+	seen += hist->count[index];
+	if ( seen >= target ) {
+	    break;
+	}
+    }
+
+    /* Report the highest value that falls in the bucket */
+    if ( index < 2 * BENCH_HIST_HALF ) {
+	value = index;
+    } else {
+	shift = index / BENCH_HIST_HALF - 1;
+	value = (((index % BENCH_HIST_HALF) + BENCH_HIST_HALF + 1) << shift) 
+	    - 1;
+    }
+
+    return value < hist->max ? value : hist->max;
+}
+
+static double Bench_Elapsed( sp_time from, sp_time to )
+{
+    sp_time result;
+
+    if ( E_compare_time( to, from ) <= 0 ) {
+	return 0.0;
+    }
+
+    result = E_sub_time( to, from );
+    return (double)result.sec + (double)result.usec / 1000000.0;
+}
+
 //#if 0
 
 //#endif
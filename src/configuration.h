@@ -49,3 +49,136 @@
 #define OUTPUT_STATE_MACHINE 1     /* Output the ordered stream of updates */
 
 
+
+/* Update batching. The representative of the leader site binds up to
+ * UPDATE_BATCH_MAX_COUNT queued client updates (and at most
+ * UPDATE_BATCH_MAX_BYTES of them) to a single global sequence number. The
+ * byte limit is further clamped so that a Proposal carrying the batch still
+ * fits inside a Complete Ordered Proof packet. Setting the count to 1 turns
+ * batching off. How long a partial batch may wait for more updates is set by
+ * timeout_update_batch_linger in timeouts.h. */
+
+#define UPDATE_BATCH_MAX_COUNT  16    /* Max updates per sequence number */
+
+#define UPDATE_BATCH_MAX_BYTES  1024  /* Max bytes of updates per sequence
+					 number */
+
+/* Merkle tree signature aggregation. When set, a server does not RSA sign
+ * each of its Pre-Prepare, Prepare, Sig_Share and Ordered_Proof messages.
+ * Instead, the messages signed while the event loop is busy are collected
+ * (at most MERKLE_MAX_LEAVES of them), a Merkle tree is built over their
+ * digests, and a single RSA signature on the root is placed on every one of
+ * them. Each message carries its authentication path after its content.
+ * Receivers remember recently verified roots so that only the first message
+ * from a tree costs an RSA verification. All servers must be compiled with
+ * the same setting. */
+
+#define MERKLE_AGGREGATION 0     /* 1 = sign one Merkle root per burst of
+				    ordering messages */
+
+#define MERKLE_MAX_LEAVES  32    /* Max messages covered by one root (must
+				    not exceed 64) */
+
+/* Local-area authenticators. When set, the messages that the servers of a
+ * site send only to each other (Pre-Prepare, Prepare, Sig_Share, the local
+ * view change and reconciliation messages, and the CCS messages) are not RSA
+ * signed. Their signature field holds an HMAC of the message for each server
+ * in the site instead, under keys that gen_keys writes for each pair of
+ * servers, as in PBFT. Ordered Proofs, Global Reconciliation messages and
+ * client messages keep RSA signatures, and Merkle aggregation then covers
+ * only the Ordered Proofs. MACs are much cheaper, but a server cannot show a
+ * third server what another server sent it, so a faulty sender can have its
+ * message accepted by some servers of the site and dropped by others. All
+ * servers must be compiled with the same setting. */
+
+#define LOCAL_AUTH_MACS    0     /* 1 = authenticate local-area messages with
+				    MACs */
+
+/* Signature verification threads. When VERIFY_THREADS is nonzero, the
+ * receive path hands each packet to a pool of that many threads, which check
+ * the RSA or threshold signature on it. Checked packets are handed back to
+ * the event loop in the order they were received, and all protocol code
+ * still runs on the event loop. At most VERIFY_QUEUE_SIZE packets can be
+ * outstanding; beyond that the receive socket is left unread. */
+
+#define VERIFY_THREADS     0     /* 0 = verify on the event loop */
+
+#define VERIFY_QUEUE_SIZE  1024  /* Max packets waiting for verification
+				    (power of 2) */
+
+/* Threshold signature threads. When THRESH_THREADS is nonzero, the
+ * signature share on a Proposal, Accept, or other site message is generated
+ * on one of that many threads, and the share message is signed and sent
+ * from the event loop once it is ready. Combining shares stays on the event
+ * loop, which needs the result right away. */
+
+#define THRESH_THREADS     0     /* 0 = generate shares on the event loop */
+
+#define THRESH_QUEUE_SIZE  256   /* Max shares waiting to be generated
+				    (power of 2) */
+
+/* Checkpointing. Every CHECKPOINT_INTERVAL globally ordered sequence numbers,
+ * the servers of a site threshold sign a checkpoint carrying a digest of the
+ * executed history, and send it to the other sites. Once a majority of sites
+ * have reached a checkpoint, the global and pending slots at or below it are
+ * freed. A server asking for a freed slot is sent the checkpoint instead. */
+
+#define CHECKPOINT_INTERVAL  128   /* Global seq numbers between checkpoints */
+
+/* Site broadcast. With SITE_MULTICAST set, a message for every server in the
+ * site is sent once to the site's IP multicast group (set with -m, by default
+ * 225.2.1.<site id>), which each server joins when it opens its receive
+ * socket. Otherwise one copy is sent to each server, and with SITE_SENDMMSG
+ * set (Linux only) all of the copies go out in a single sendmmsg call. */
+
+#define SITE_MULTICAST  0     /* 1 = use IP multicast inside a site */
+
+#define SITE_SENDMMSG   1     /* 1 = batch the per-server copies into one
+				 system call */
+
+/* Batched receive. Each time the server socket is readable, up to
+ * RECV_BATCH_SIZE datagrams are read with a single recvmmsg call (Linux only)
+ * into a set of preallocated packet buffers, and then processed in order. A
+ * buffer kept by the protocol is replaced with a fresh one. Setting this to 1
+ * reads one datagram per wakeup. */
+
+#define RECV_BATCH_SIZE  16    /* Max datagrams read per wakeup */
+
+/* Verified signature cache. A client update is carried inside Pre-Prepares,
+ * Proposals and Ordered Proofs, and its signature would otherwise be checked
+ * again each time. When VAL_SIG_CACHE_SIZE is nonzero, each RSA or threshold
+ * signature that verifies is remembered by the digest of the whole signed
+ * message (signature included) and its signer, and is not checked again
+ * while its entry has not been overwritten. */
+
+#define VAL_SIG_CACHE_SIZE  4096  /* Entries, direct mapped (power of 2, 0 =
+				     no cache) */
+
+/* I/O stage threads. When IO_STAGE_THREADS is set, the server socket is read
+ * on a receiver thread and every server and client send is made from a
+ * sender thread (Linux only). Packets are passed to and from the event loop
+ * through rings of IO_STAGE_QUEUE_SIZE packet slots, so the event loop only
+ * copies packets while the system calls run on other cores. Together with
+ * VERIFY_THREADS and THRESH_THREADS this spreads a server over several cores;
+ * the ordering protocols themselves still run on the event loop. */
+
+#define IO_STAGE_THREADS     0     /* 1 = receive and send on their own
+				      threads */
+
+#define IO_STAGE_QUEUE_SIZE  1024  /* Packet slots in each ring (power of 2) */
+
+/* State machine output. With OUTPUT_STATE_MACHINE set, the ordered updates
+ * are gathered into chunks of STATE_MACHINE_CHUNK_SIZE bytes, which are handed
+ * over when full and at the end of each pass of the event loop. With
+ * STATE_MACHINE_ASYNC set the chunks are written by a thread of their own, so
+ * executing updates never waits on the disk; otherwise the event loop writes
+ * them. With STATE_MACHINE_SYNC_MSEC nonzero, the file is synced no more than
+ * that many milliseconds after a write, and one sync covers every update
+ * written in the meantime. Zero leaves syncing to the operating system. */
+
+#define STATE_MACHINE_ASYNC       1      /* 1 = write from a thread */
+
+#define STATE_MACHINE_CHUNK_SIZE  65536  /* Bytes per write chunk */
+
+#define STATE_MACHINE_SYNC_MSEC   0      /* Max msec a written update may go
+					    unsynced (0 = never sync) */
@@ -183,10 +183,12 @@ void CCS_Invocation_Handler(signed_message *m)
   if(CCS_STATE.State[context] == INITIAL_STATE) {
     CCS_STATE.Invocation_ARU[context] = aru;  
     CCS_STATE.State[context] = INVOCATION_RECEIVED;
+    UTIL_Refresh_Alarm_Prefix();
 
     if(UTIL_I_Am_Representative()) {
       Respond_To_CCS_Invocation(UTIL_Get_ARU(context), context);
       CCS_STATE.State[context] = COLLECTING_REPORT_CONTENTS;
+      UTIL_Refresh_Alarm_Prefix();
     }
     else
       CCS_Response_Decider(context);
@@ -252,6 +254,7 @@ void Respond_To_CCS_Invocation(int32u my_aru, int32u context)
     UTIL_RETRANS_Start( &CCS_RETRANS[context] ); 
 
     CCS_STATE.State[context] = REPORT_SENT;
+    UTIL_Refresh_Alarm_Prefix();
 
     if( UTIL_I_Am_In_Leader_Site() && VAR.My_Site_ID == 2 
 	&& context == GLOBAL_CONTEXT ) {     
@@ -443,6 +446,7 @@ void CCS_Send_Description_And_Reports(int32u context)
     Alarm(DEBUG, "Send Description, Reports, Union in context %d\n", context);
   }
   CCS_STATE.State[context] = COLLECTING_SIG_SHARES;
+  UTIL_Refresh_Alarm_Prefix();
 }
 
 void CCS_Allocate_Receiver_Slots( signed_message *report ) 
@@ -666,6 +670,7 @@ void CCS_Begin_Collection_Phase(int32u context)
 
 
   CCS_STATE.State[context] = COLLECTING_UNION_CONTENTS;
+  UTIL_Refresh_Alarm_Prefix();
 
   Alarm(DEBUG, "CCS_Begin_Collection_Phase()\n");
 
@@ -703,6 +708,7 @@ void CCS_Union_Decider(int32u context)
     THRESH_Invoke_Threshold_Signature(union_share);
     dec_ref_cnt(union_share);
     CCS_STATE.State[context] = COLLECTING_SIG_SHARES;
+    UTIL_Refresh_Alarm_Prefix();
     
     if(context == PENDING_CONTEXT)
       Alarm(CCS_PRINT, "Reached COLLECTING_SIG_SHARES in Pending context.\n");
@@ -1018,6 +1024,7 @@ void CCS_Handle_Union_Message( signed_message *new_ccs_union ) {
 	CCS_GLOBAL_RETRANS.type = UTIL_RETRANS_TO_SERVERS_WITH_MY_ID;
 	inc_ref_cnt( new_ccs_union );
 	GLOBAL_CCS_UNION[ VAR.My_Site_ID ] = new_ccs_union;
+	UTIL_Refresh_Alarm_Prefix();
       }
       else {
 	/* Non-leader site sends the contents, too.*/
@@ -1229,6 +1236,7 @@ void CCS_Process_Union_Message( signed_message *ccs_union ) {
 	GLOBAL_CCS_UNION[ ccs_union->site_id ] = ccs_union;
 	inc_ref_cnt( ccs_union );
 	CCS_Is_Globally_Constrained();
+	UTIL_Refresh_Alarm_Prefix();
 	CCS_Forward_Union_Message( ccs_union );
     } else {
       /* This message corresponds to a Prepare message.*/
@@ -146,7 +146,7 @@ int32u Construct_CCS_Report_List(byte *Report_List, int32u my_aru,
   pre_prepare_message *pre_prepare_specific;
 
   /* Sanity */
-  if(CCS_STATE.My_Max_Seq_Response[context] > my_aru + GLOBAL_WINDOW+ 5) {
+  if(CCS_STATE.My_Max_Seq_Response[context] > my_aru + GLOBAL_WINDOW_MAX+ 5) {
     Alarm(CCS_PRINT, "Trying to report too much, my_aru = %d, my max = %d\n",
 	  my_aru, CCS_STATE.My_Max_Seq_Response[context]);
     return 0;
@@ -878,6 +878,8 @@ void CCS_Reset_Data_Structures(int32u context)
   for(si = 1; si <= NUM_SITES; si++ ) {
     UTIL_Stopwatch_Start( &(UNION_FORWARD_STOPWATCH[si]));
   }
+
+  UTIL_Refresh_Alarm_Prefix();
 }
 
 /* 
@@ -42,8 +42,13 @@
 
 /* JWL SPEED Windows */
 
+/* The windows start at these values and are adapted by the representative
+ * of the leader site, up to the maximums (see window.c). Servers respond to
+ * seq numbers up to the maximums. */
+
 /* Window for local area ordering */
 #define LOCAL_WINDOW 2 
+#define LOCAL_WINDOW_MAX 16
 
 /* Window for wide area ordering */
 #ifdef SET_USE_SPINES
@@ -51,6 +56,7 @@
 #else
 #define GLOBAL_WINDOW 16 
 #endif
+#define GLOBAL_WINDOW_MAX 128
 
 /* These values should not be changed by the user */
 #define NUM_SERVERS_IN_SITE   (3*NUM_FAULTS+1)
@@ -67,7 +73,7 @@
 #define TRUE                   1
 
 #define SIG_SHARE_SIZE	       SIGNATURE_SIZE
-#define SIG_SHARE_PROOF_SIZE   128
+#define SIG_SHARE_PROOF_SIZE   192
 
 #define NET_CLIENT_PROGRAM_TYPE    1
 #define NET_SERVER_PROGRAM_TYPE    2
@@ -95,6 +101,10 @@
 
 #define COMPLETE_ORDERED_PROOF_TYPE 17
 
+#define CHECKPOINT_TYPE             18
+
+#define CHECKPOINT_REPLY_TYPE       19
+
 #define CCS_INVOCATION_TYPE          50
 #define CCS_REPORT_TYPE              51
 #define CCS_DESCRIPTION_TYPE         52
@@ -103,6 +113,12 @@
 
 typedef byte packet_body[MAX_PACKET_SIZE];
 
+/* Size classes of signed message buffers. A message that fits in one of these
+ * (a Prepare, or a share on an Accept) is kept in it rather than in a whole
+ * packet_body. Larger messages use a packet_body. */
+#define MESS_SMALL_SIZE   320
+#define MESS_MEDIUM_SIZE  768
+
 /* Message structures:
  *
  * Messages are composed of the following structures.
@@ -149,7 +165,7 @@ typedef struct dummy_pre_prepare_message {
     int32u seq_num;          /* seq number */
     int32u local_view;       /* the local view number */
     int32u global_view;      /* the global view number */
-    /* the update follows */  
+    /* a batch of one or more updates follows, back to back */  
 } pre_prepare_message;
 
 /* Structure of a Prepare Message */
@@ -165,7 +181,7 @@ typedef struct dummy_proposal_message {
     int32u seq_num;           /* the seq number of the proposal */
     int32u local_view;        /* the local view number */
     int32u global_view;       /* the global view number */
-    /* an update_message follows this message */
+    /* a batch of one or more update messages follows this message */
 } proposal_message;
 
 /* Structure of an Accept message. */
@@ -175,6 +191,18 @@ typedef struct dummy_accept_message {
     byte update_digest[DIGEST_SIZE]; /* digest of the update */
 } accept_message;
 
+/* The number of bytes of batched updates that a Proposal can carry and still
+ * fit, along with NUM_SITES/2 Accepts, in a Complete Ordered Proof. */
+#define UPDATE_BATCH_PACKET_BYTES  ( MAX_PACKET_SIZE - \
+	( (NUM_SITES/2) * (sizeof(signed_message) + sizeof(accept_message)) ) - \
+	sizeof(signed_message) - sizeof(proposal_message) )
+
+/* The number of bytes of batched updates that a Proposal can carry and still
+ * fit in the signature share message on it. */
+#define UPDATE_BATCH_SHARE_BYTES  ( MAX_PACKET_SIZE - \
+	2 * sizeof(signed_message) - sizeof(sig_share_message) - \
+	sizeof(proposal_message) )
+
 typedef struct dummy_ordered_proof_message {
     int32u time_stamp;
     /* A complete proposal message follows */
@@ -214,6 +242,19 @@ typedef struct dummy_global_reconciliation_message {
   int32u seq_num;
 } global_reconciliation_message;
 
+/* Checkpoint. A site threshold signs this after executing seq_num. */
+typedef struct dummy_checkpoint_message {
+    int32u seq_num;                  /* the last executed seq number */
+    byte state_digest[DIGEST_SIZE];  /* digest chained over the update
+					batches of every seq up to seq_num */
+} checkpoint_message;
+
+/* Answer to a global reconciliation request for a slot that has been freed.
+ * The threshold signed checkpoint that the slot was freed below follows. */
+typedef struct dummy_checkpoint_reply_message {
+    int32u seq_num;                  /* the requested seq number */
+} checkpoint_reply_message;
+
 
 /* Local Data Structure Slot. */
 typedef struct dummy_pending_slot {
@@ -243,16 +284,37 @@ typedef struct dummy_pending_slot {
 
 /* Global Data Structure Slot */
 typedef struct dummy_global_slot {
+    int32u seq_num;                                    /* seq number */
     signed_message* proposal;                          /* proposal */
     signed_message* accept[NUM_SITES+1];               /* set of accepts */
     signed_message* accept_share[NUM_SERVER_SLOTS];    /* accept share */
     int32u is_ordered;
+    signed_message* ordered_proof;                     /* cached complete
+							  ordered proof */
     sp_time time_accept_share_sent;
     util_stopwatch stopwatch_complete_ordered_proof_site_broadcast;
     util_stopwatch forward_proposal_stopwatch;
     int32u purge_view;
 } global_slot_struct;
 
+/* Slots are looked up in a ring indexed by seq number modulo SLOT_RING_SIZE.
+ * An entry holds the slot with the greatest seq number that maps to it,
+ * unless that would push out a slot that has not been ordered yet. Slots that
+ * do not fit in the ring are kept in the History hash. The ring must be
+ * larger than the seq numbers that are in use at once: those above the last
+ * stable checkpoint and within the ordering windows. */
+#define SLOT_RING_SIZE  1024  /* Must be a power of 2 */
+
+typedef struct dummy_global_ring_entry {
+    int32u seq_num;
+    global_slot_struct *slot;
+} global_ring_entry;
+
+typedef struct dummy_pending_ring_entry {
+    int32u seq_num;
+    pending_slot_struct *slot;
+} pending_ring_entry;
+
 /* Client response message */
 typedef struct dummy_client_response_message {
     int32u seq_num;
@@ -280,6 +342,8 @@ typedef struct server_variables_dummy {
     int32u My_Site_ID;
     int32u Global_seq;
     int32u Faults;
+    int32u Local_window;
+    int32u Global_window;
 } server_variables;
 
 typedef struct network_variables_dummy {
@@ -295,6 +359,7 @@ typedef struct dummy_global_data_struct {
     int32u View;
     int32u Installed;
     int32u Max_ordered;
+    global_ring_entry Ring[SLOT_RING_SIZE];
     stdhash History;
     int32u ARU;
     signed_message* Global_VC[NUM_SITES+1];
@@ -308,6 +373,7 @@ typedef struct dummy_pending_data_structs {
     int32u Is_preinstalled;
     int32u Max_ordered;
     int32u ARU;
+    pending_ring_entry Ring[SLOT_RING_SIZE];
     stdhash History;
     signed_message *L_new_rep[NUM_SERVER_SLOTS];
     signed_message *Local_view_proof[NUM_SITES+1];
@@ -44,6 +44,7 @@
 #include "util/alarm.h"
 #include "query_protocol.h"
 #include "global_reconciliation.h"
+#include "checkpoint.h"
 
 /* Protocol types */
 #define PROT_INVALID             0
@@ -58,6 +59,7 @@
 #define QUERY_HANDLER            9
 #define META_GLOBAL_VC          10 
 #define GLOBAL_RECON            11
+#define PROT_CHECKPOINT         12
 
 /* Dispatch Code */
 
@@ -116,6 +118,10 @@ int32u DIS_Classify_Message( signed_message *mess ) {
       return GLOBAL_RECON;
     }
 
+    if ( mt == CHECKPOINT_TYPE || mt == CHECKPOINT_REPLY_TYPE ) {
+	return PROT_CHECKPOINT;
+    }
+
     /* Otherwise, we have received an invalid message type. */
     Alarm(EXIT,"*********** %d\b",mt);
     return 0;
@@ -167,6 +173,13 @@ void DIS_Dispatch_Message( signed_message *mess ) {
         case GLOBAL_RECON:
 	  GRECON_Dispatcher( mess );
 	  return;
+	case PROT_CHECKPOINT:
+	    if ( mess->type == CHECKPOINT_TYPE ) {
+		CKPT_Process_Checkpoint( mess );
+	    } else {
+		CKPT_Process_Checkpoint_Reply( mess );
+	    }
+	    return;
 
 	default:
 	    INVALID_MESSAGE(""); 
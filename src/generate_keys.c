@@ -26,6 +26,8 @@
  */
 
 #include "openssl_rsa.h"
+#include "auth.h"
+#include "keyring.h"
 
 int main( int numargs, char* *args[] ) {
 
@@ -33,5 +35,7 @@ int main( int numargs, char* *args[] ) {
 
     OPENSSL_RSA_Generate_Keys();
     TC_Generate();
+    AUTH_Generate_Keys();
+    KEYRING_Write();
 
 }
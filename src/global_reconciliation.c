@@ -36,6 +36,7 @@
 #include "global_reconciliation.h"
 #include "meta_globally_order.h"
 #include "validate.h"
+#include "checkpoint.h"
 #include <string.h>
 
 /* Globally Accessible Variables */
@@ -86,15 +87,19 @@ void GRECON_Send_Response( int32u seq_num, int32u site, int32u server ) {
     p = GRECON_Construct_Ordered_Proof_Message( seq_num );
 
     if ( p == NULL ) {
+	/* The slot may have been freed at a stable checkpoint */
+	CKPT_Send_Checkpoint( seq_num, site, server );
 	return;
     }
    
     if ( site == 0 || server == 0 ) {
 	UTIL_Site_Broadcast( p );
+	dec_ref_cnt( p );
 	return;
     }
 
     UTIL_Send_To_Server(p, site, server);
+    dec_ref_cnt( p );
 
     /*ORDRCV_Send_Ordered_Proof_Bundle( seq_num, 
             site, server );*/ 
@@ -261,6 +266,12 @@ signed_message* GRECON_Construct_Ordered_Proof_Message( int32u seq_num ) {
 	return NULL;
     }
 
+    if ( slot->ordered_proof != NULL ) {
+	/* Already built; the proof never changes once the slot is ordered */
+	inc_ref_cnt( slot->ordered_proof );
+	return slot->ordered_proof;
+    }
+
     /* Let's build the proof */
     proof = UTIL_New_Signed_Message();
 
@@ -333,6 +344,11 @@ signed_message* GRECON_Construct_Ordered_Proof_Message( int32u seq_num ) {
     Alarm(GRECON_PRINT, "Constructed proof for client timestamp %d\n", 
 	  update_specific->time_stamp);
 
+    /* Keep the proof on the slot for later clients and servers. The slot
+     * holds one reference and the caller gets another. */
+    slot->ordered_proof = proof;
+    inc_ref_cnt( proof );
+
     return proof;
     
 #if 0
@@ -447,7 +463,8 @@ int32u GRECON_Process_Complete_Ordered_Proof(signed_message *mess,
   proposal_len = mess->len - non_proposal_len;
 
   if( (proposal_len < sizeof(signed_message) + sizeof(proposal_message)) ||
-      proposal_len > 1024 ) {
+      proposal_len > sizeof(signed_message) + sizeof(proposal_message) + 
+      UPDATE_BATCH_PACKET_BYTES ) {
     *ret_prop = NULL;
     return 1;
   }  
@@ -44,6 +44,9 @@ int32u GRECON_Process_Complete_Ordered_Proof(signed_message *mess,
 					     signed_message **ret_prop, 
 					     int32u caller_is_client);
 
+/* Returns a reference to the complete ordered proof for seq_num, built the
+ * first time it is asked for and then kept on the global slot. The caller
+ * must dec_ref_cnt it and must not modify it. */
 signed_message* GRECON_Construct_Ordered_Proof_Message( int32u seq_num ); 
 
 void GRECON_Init();
@@ -192,6 +192,7 @@ void GVC_Increase_Global_View( int32u new_view ) {
 	GLOBAL.View = new_view;
 	GLOBAL.Is_preinstalled = 0;
 	GLOBO_Reset_Global_Progress_Bookkeeping_For_Global_View_Change();
+	UTIL_Refresh_Alarm_Prefix();
 #if 0
 	CCS_Reset_Data_Structures( GLOBAL_CONTEXT );
 #endif
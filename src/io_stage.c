@@ -0,0 +1,409 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* I/O stage threads. Each ring has one producer and one consumer, and only
+ * the producer writes head while only the consumer writes tail. A consumer
+ * that finds its ring empty sets waiting and then waits on the ring's
+ * eventfd; a producer that sees waiting set after publishing a slot clears
+ * it and writes the eventfd. The receive ring's consumer is the event loop,
+ * which waits on the eventfd through E_attach_fd. The same is done the other
+ * way around with space_waiting and space_fd when a producer finds its ring
+ * full, so neither side spins or sleeps for a fixed time. */
+
+#define _GNU_SOURCE  /* sendmmsg, recvmmsg */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include "io_stage.h"
+#include "util/alarm.h"
+
+#define IOSTAGE_MAX_DESTS  NUM_SERVERS_IN_SITE
+
+typedef struct dummy_iostage_slot {
+    int32  fd;			     /* socket to send on */
+    int32u num_dests;
+    int32  address[IOSTAGE_MAX_DESTS];
+    int16u port;
+    int32u len;
+    packet_body data;
+} iostage_slot;
+
+typedef struct dummy_iostage_ring {
+    iostage_slot *slots;
+    int32u size;		     /* Power of 2 */
+    int32u head;		     /* Next slot to fill, producer only */
+    int32u tail;		     /* Next slot to take, consumer only */
+    int32u waiting;		     /* Consumer is waiting on event_fd */
+    int event_fd;
+    int32u space_waiting;	     /* Producer is waiting on space_fd */
+    int space_fd;
+} iostage_ring;
+
+static iostage_ring iostage_send_ring;
+static iostage_ring iostage_recv_ring;
+static int32u iostage_sender_started;
+
+/* Local Functions */
+void IOSTAGE_Ring_Init( iostage_ring *ring, int32u size, int flags ); 
+int32u IOSTAGE_Ring_Free( iostage_ring *ring ); 
+void IOSTAGE_Ring_Publish( iostage_ring *ring, int32u count ); 
+void IOSTAGE_Ring_Wait_Space( iostage_ring *ring ); 
+void IOSTAGE_Ring_Release( iostage_ring *ring, int32u count ); 
+void* IOSTAGE_Sender_Thread( void *dummy ); 
+void* IOSTAGE_Receiver_Thread( void *sk ); 
+void IOSTAGE_Send_Slot( iostage_slot *slot ); 
+
+void IOSTAGE_Ring_Init( iostage_ring *ring, int32u size, int flags ) {
+
+    if ( size == 0 || (size & (size - 1)) ) {
+	Alarm(EXIT,"IOSTAGE_Ring_Init: Queue size %d is not a power of 2.\n",
+		size);
+    }
+
+    memset( ring, 0, sizeof(iostage_ring) );
+    ring->slots = (iostage_slot*)malloc( size * sizeof(iostage_slot) );
+    if ( ring->slots == NULL ) {
+	Alarm(EXIT,"IOSTAGE_Ring_Init: Could not allocate slots.\n");
+    }
+    ring->size = size;
+    ring->waiting = 1;
+
+    ring->event_fd = eventfd( 0, flags );
+    ring->space_fd = eventfd( 0, 0 );
+    if ( ring->event_fd < 0 || ring->space_fd < 0 ) {
+	Alarm(EXIT,"IOSTAGE_Ring_Init: Could not create eventfd.\n");
+    }
+}
+
+/* Called by the producer */
+int32u IOSTAGE_Ring_Free( iostage_ring *ring ) {
+
+    return ring->size - 
+	(ring->head - __atomic_load_n( &ring->tail, __ATOMIC_SEQ_CST ));
+}
+
+/* Called by the producer once count slots after head are filled. */
+void IOSTAGE_Ring_Publish( iostage_ring *ring, int32u count ) {
+
+    uint64_t one = 1;
+
+    __atomic_store_n( &ring->head, ring->head + count, __ATOMIC_SEQ_CST );
+    if ( __atomic_load_n( &ring->waiting, __ATOMIC_SEQ_CST ) ) {
+	__atomic_store_n( &ring->waiting, 0, __ATOMIC_SEQ_CST );
+	if ( write( ring->event_fd, &one, sizeof(one) ) < 0 ) {
+	    Alarm(EXIT,"IOSTAGE_Ring_Publish: eventfd write failed.\n");
+	}
+    }
+}
+
+/* Called by the producer when the ring is full. Returns once the consumer
+ * has taken a slot (or, rarely, early: the caller checks again). */
+void IOSTAGE_Ring_Wait_Space( iostage_ring *ring ) {
+
+    uint64_t count;
+
+    __atomic_store_n( &ring->space_waiting, 1, __ATOMIC_SEQ_CST );
+    if ( IOSTAGE_Ring_Free( ring ) == 0 ) {
+	if ( read( ring->space_fd, &count, sizeof(count) ) < 0 &&
+		errno != EINTR ) {
+	    Alarm(EXIT,"IOSTAGE_Ring_Wait_Space: eventfd read failed.\n");
+	}
+    }
+    __atomic_store_n( &ring->space_waiting, 0, __ATOMIC_SEQ_CST );
+}
+
+/* Called by the consumer once count slots after tail are taken. */
+void IOSTAGE_Ring_Release( iostage_ring *ring, int32u count ) {
+
+    uint64_t one = 1;
+
+    __atomic_store_n( &ring->tail, ring->tail + count, __ATOMIC_SEQ_CST );
+    if ( __atomic_load_n( &ring->space_waiting, __ATOMIC_SEQ_CST ) ) {
+	__atomic_store_n( &ring->space_waiting, 0, __ATOMIC_SEQ_CST );
+	if ( write( ring->space_fd, &one, sizeof(one) ) < 0 ) {
+	    Alarm(EXIT,"IOSTAGE_Ring_Release: eventfd write failed.\n");
+	}
+    }
+}
+
+void IOSTAGE_Start_Sender() {
+
+    pthread_t thread;
+
+    IOSTAGE_Ring_Init( &iostage_send_ring, IO_STAGE_QUEUE_SIZE, 0 );
+
+    if ( pthread_create( &thread, NULL, IOSTAGE_Sender_Thread, NULL ) ) {
+	Alarm(EXIT,"IOSTAGE_Start_Sender: Could not start thread.\n");
+    }
+    pthread_detach( thread );
+
+    iostage_sender_started = 1;
+}
+
+/* Start receiving on sk from a thread. Returns the fd that becomes readable
+ * when received packets are waiting for the event loop. */
+int IOSTAGE_Start_Receiver( channel sk ) {
+
+    pthread_t thread;
+
+    IOSTAGE_Ring_Init( &iostage_recv_ring, IO_STAGE_QUEUE_SIZE, 
+	    EFD_NONBLOCK );
+
+    if ( pthread_create( &thread, NULL, IOSTAGE_Receiver_Thread, 
+		(void*)(intptr_t)sk ) ) {
+	Alarm(EXIT,"IOSTAGE_Start_Receiver: Could not start thread.\n");
+    }
+    pthread_detach( thread );
+
+    return iostage_recv_ring.event_fd;
+}
+
+/* Queue a copy of buf to be sent to each address on the sender thread.
+ * Returns 0, and queues nothing, if there is no sender thread. */
+int32u IOSTAGE_Send( int32 fd, int32 *address, int32u num_dests, 
+	int16u port, byte *buf, int32u len ) {
+
+    iostage_ring *ring;
+    iostage_slot *slot;
+
+    ring = &iostage_send_ring;
+
+    if ( !iostage_sender_started ) {
+	return 0;
+    }
+
+    if ( num_dests > IOSTAGE_MAX_DESTS || len > sizeof(packet_body) ) {
+	Alarm(EXIT,"IOSTAGE_Send: %d bytes to %d destinations is too much.\n",
+		len, num_dests);
+    }
+
+    while ( IOSTAGE_Ring_Free( ring ) == 0 ) {
+	/* The sender is behind; wait for it to catch up */
+	IOSTAGE_Ring_Wait_Space( ring );
+    }
+
+    slot = &ring->slots[ring->head & (ring->size - 1)];
+    slot->fd = fd;
+    slot->num_dests = num_dests;
+    memcpy( slot->address, address, num_dests * sizeof(int32) );
+    slot->port = port;
+    slot->len = len;
+    memcpy( slot->data, buf, len );
+
+    IOSTAGE_Ring_Publish( ring, 1 );
+
+    return 1;
+}
+
+void* IOSTAGE_Sender_Thread( void *dummy ) {
+
+    iostage_ring *ring;
+    uint64_t count;
+
+    ring = &iostage_send_ring;
+
+    for ( ;; ) {
+	if ( ring->tail == __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) ) {
+	    __atomic_store_n( &ring->waiting, 1, __ATOMIC_SEQ_CST );
+	    if ( ring->tail == 
+		    __atomic_load_n( &ring->head, __ATOMIC_SEQ_CST ) ) {
+		if ( read( ring->event_fd, &count, sizeof(count) ) < 0 &&
+			errno != EINTR ) {
+		    Alarm(EXIT,"IOSTAGE_Sender_Thread: eventfd read failed.\n");
+		}
+	    }
+	    __atomic_store_n( &ring->waiting, 0, __ATOMIC_SEQ_CST );
+	    continue;
+	}
+
+	IOSTAGE_Send_Slot( &ring->slots[ring->tail & (ring->size - 1)] );
+	IOSTAGE_Ring_Release( ring, 1 );
+    }
+
+    return NULL;
+}
+
+void IOSTAGE_Send_Slot( iostage_slot *slot ) {
+
+    struct sockaddr_in dest[IOSTAGE_MAX_DESTS];
+    struct mmsghdr msgs[IOSTAGE_MAX_DESTS];
+    struct iovec iov;
+    struct pollfd pfd;
+    int32u i, sent, num_try;
+    int ret;
+
+    iov.iov_base = slot->data;
+    iov.iov_len  = slot->len;
+
+    memset( dest, 0, sizeof(dest) );
+    memset( msgs, 0, sizeof(msgs) );
+    for ( i = 0; i < slot->num_dests; i++ ) {
+	dest[i].sin_family      = AF_INET;
+	dest[i].sin_port        = htons(slot->port);
+	dest[i].sin_addr.s_addr = htonl(slot->address[i]);
+	msgs[i].msg_hdr.msg_name    = &dest[i];
+	msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	msgs[i].msg_hdr.msg_iov     = &iov;
+	msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    /* Retry transient failures a few times, as DL_send does. Between tries,
+     * wait until the socket can take more, for at most 10 ms. */
+    pfd.fd     = slot->fd;
+    pfd.events = POLLOUT;
+    sent = 0;
+    for ( num_try = 0; sent < slot->num_dests && num_try < 10; num_try++ ) {
+	ret = sendmmsg( slot->fd, &msgs[sent], slot->num_dests - sent, 0 );
+	if ( ret > 0 ) {
+	    sent += ret;
+	    num_try = 0;
+	} else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+	    poll( &pfd, 1, 10 );
+	} else if ( errno != EINTR ) {
+	    /* Out of buffers: the socket still polls writable, so back off */
+	    poll( NULL, 0, 10 );
+	}
+    }
+
+    if ( sent < slot->num_dests ) {
+	Alarm(EXIT, "IOSTAGE_Send_Slot: socket error: %s\n", strerror(errno));
+    }
+}
+
+void* IOSTAGE_Receiver_Thread( void *sk ) {
+
+    iostage_ring *ring;
+    struct mmsghdr msgs[RECV_BATCH_SIZE];
+    struct iovec iov[RECV_BATCH_SIZE];
+    iostage_slot *slot;
+    int32u i, num;
+    int ret;
+
+    ring = &iostage_recv_ring;
+
+    for ( ;; ) {
+	num = IOSTAGE_Ring_Free( ring );
+	if ( num == 0 ) {
+	    /* Leave the packets in the socket until the event loop catches
+	     * up */
+	    IOSTAGE_Ring_Wait_Space( ring );
+	    continue;
+	}
+	if ( num > RECV_BATCH_SIZE ) {
+	    num = RECV_BATCH_SIZE;
+	}
+
+	memset( msgs, 0, num * sizeof(struct mmsghdr) );
+	for ( i = 0; i < num; i++ ) {
+	    slot = &ring->slots[(ring->head + i) & (ring->size - 1)];
+	    iov[i].iov_base = slot->data;
+	    iov[i].iov_len  = sizeof(packet_body);
+	    msgs[i].msg_hdr.msg_iov    = &iov[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	/* Block for the first datagram, then take whatever else is there */
+	ret = recvmmsg( (int)(intptr_t)sk, msgs, num, MSG_WAITFORONE, NULL );
+	if ( ret <= 0 ) {
+	    continue;
+	}
+
+	for ( i = 0; i < (int32u)ret; i++ ) {
+	    ring->slots[(ring->head + i) & (ring->size - 1)].len = 
+		msgs[i].msg_len;
+	}
+	IOSTAGE_Ring_Publish( ring, ret );
+    }
+
+    return NULL;
+}
+
+/* Called on the event loop when the receive fd is readable, before taking
+ * packets with IOSTAGE_Receive. */
+void IOSTAGE_Receive_Begin() {
+
+    uint64_t count;
+
+    if ( read( iostage_recv_ring.event_fd, &count, sizeof(count) ) < 0 &&
+	    errno != EAGAIN ) {
+	Alarm(EXIT,"IOSTAGE_Receive_Begin: eventfd read failed.\n");
+    }
+}
+
+/* Copy the next received packet into buf. Returns its length, or 0 if there
+ * are no packets waiting. */
+int32u IOSTAGE_Receive( byte *buf ) {
+
+    iostage_ring *ring;
+    iostage_slot *slot;
+    int32u len;
+
+    ring = &iostage_recv_ring;
+
+    if ( ring->tail == __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) ) {
+	return 0;
+    }
+
+    slot = &ring->slots[ring->tail & (ring->size - 1)];
+    len = slot->len;
+    memcpy( buf, slot->data, len );
+    IOSTAGE_Ring_Release( ring, 1 );
+
+    return len;
+}
+
+/* Called on the event loop after taking packets. If packets are still
+ * waiting, the receive fd is made readable again so that the event loop
+ * comes back for them; otherwise the receiver is asked to signal the next
+ * one. */
+void IOSTAGE_Receive_End() {
+
+    iostage_ring *ring;
+    uint64_t one = 1;
+
+    ring = &iostage_recv_ring;
+
+    if ( ring->tail == __atomic_load_n( &ring->head, __ATOMIC_SEQ_CST ) ) {
+	__atomic_store_n( &ring->waiting, 1, __ATOMIC_SEQ_CST );
+	if ( ring->tail == __atomic_load_n( &ring->head, __ATOMIC_SEQ_CST ) ) {
+	    return;
+	}
+	__atomic_store_n( &ring->waiting, 0, __ATOMIC_SEQ_CST );
+    }
+
+    if ( write( ring->event_fd, &one, sizeof(one) ) < 0 ) {
+	Alarm(EXIT,"IOSTAGE_Receive_End: eventfd write failed.\n");
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* I/O stage threads. With IO_STAGE_THREADS set, datagrams are received on a
+ * receiver thread and sent on a sender thread, so that the event loop spends
+ * its time on the protocol instead of in system calls. Each stage is joined
+ * to the event loop by a single producer, single consumer ring of packet
+ * slots. Packets are copied into and out of the rings, so the threads never
+ * touch ref counted messages or protocol state. */
+
+#ifndef IOSTAGE_K8WQ3NZ5RD2MXT7PA4JE
+#define IOSTAGE_K8WQ3NZ5RD2MXT7PA4JE 1
+
+#include "data_structs.h"
+#include "util/arch.h"
+
+/* Public functions */
+
+void IOSTAGE_Start_Sender(void); 
+
+int IOSTAGE_Start_Receiver( channel sk ); 
+
+int32u IOSTAGE_Send( int32 fd, int32 *address, int32u num_dests, 
+	int16u port, byte *buf, int32u len ); 
+
+void IOSTAGE_Receive_Begin(void); 
+
+int32u IOSTAGE_Receive( byte *buf ); 
+
+void IOSTAGE_Receive_End(void); 
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+/* The keyring file is a header, then one index entry for every key that the
+ * configuration allows (server keys by site and server, then client keys by
+ * site and client, then the threshold key of each site), then the key bytes.
+ * Each key is its modulus and public exponent, big endian. The file is in
+ * host byte order; it is written by gen_keys for the machines that run it.
+ * A keyring made for a different configuration is not used. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "keyring.h"
+#include "data_structs.h"
+#include "util/alarm.h"
+
+#define KEYRING_MAGIC    0x4b595753  /* "SWYK" */
+#define KEYRING_VERSION  1
+
+#define KEYRING_ENTRIES  ( NUM_SITES * NUM_SERVERS_IN_SITE + \
+	                   NUM_SITES * NUM_CLIENTS + NUM_SITES )
+
+typedef struct dummy_keyring_header {
+    int32u magic;
+    int32u version;
+    int32u num_sites;
+    int32u num_servers;      /* in each site */
+    int32u num_clients;      /* in each site */
+    int32u num_entries;
+} keyring_header;
+
+typedef struct dummy_keyring_entry {
+    int32u offset;           /* of the modulus, from the start of the file */
+    int32u n_len;            /* 0 if the key is missing */
+    int32u e_len;            /* the exponent follows the modulus */
+} keyring_entry;
+
+/* The mapped file */
+byte *keyring_map;
+size_t keyring_map_size;
+
+/* Keys added by gen_keys, in index order */
+byte *keyring_new_n[KEYRING_ENTRIES];
+byte *keyring_new_e[KEYRING_ENTRIES];
+int32u keyring_new_n_len[KEYRING_ENTRIES];
+int32u keyring_new_e_len[KEYRING_ENTRIES];
+
+/* Local Functions */
+int32 KEYRING_Index( int32u kind, int32u site, int32u number ); 
+keyring_entry* KEYRING_Entry( byte *map, size_t size, int32u index ); 
+
+/* Position of a key in the index, or -1 if there is no such key */
+int32 KEYRING_Index( int32u kind, int32u site, int32u number ) {
+
+    if ( site < 1 || site > NUM_SITES ) {
+	return -1;
+    }
+
+    if ( kind == KEYRING_SERVER_RSA && 
+	 number >= 1 && number <= NUM_SERVERS_IN_SITE ) {
+	return (site - 1) * NUM_SERVERS_IN_SITE + (number - 1);
+    }
+
+    if ( kind == KEYRING_CLIENT_RSA && 
+	 number >= 1 && number <= NUM_CLIENTS ) {
+	return NUM_SITES * NUM_SERVERS_IN_SITE + 
+	    (site - 1) * NUM_CLIENTS + (number - 1);
+    }
+
+    if ( kind == KEYRING_SITE_TC && number == 0 ) {
+	return NUM_SITES * NUM_SERVERS_IN_SITE + NUM_SITES * NUM_CLIENTS + 
+	    (site - 1);
+    }
+
+    return -1;
+}
+
+/* The index entry of a key in a mapped keyring, or NULL if the key is
+ * missing or does not lie inside the file */
+keyring_entry* KEYRING_Entry( byte *map, size_t size, int32u index ) {
+
+    keyring_entry *entry;
+
+    entry = ((keyring_entry*)(map + sizeof(keyring_header))) + index;
+    if ( entry->n_len == 0 || entry->e_len == 0 ||
+	 entry->offset > size ||
+	 entry->n_len > size - entry->offset ||
+	 entry->e_len > size - entry->offset - entry->n_len ) {
+	return NULL;
+    }
+
+    return entry;
+}
+
+/* Map the keyring. Returns 1 if it is mapped, matches the configuration, and
+ * has the key of every server, client, and site, and 0 if keys must be read
+ * from their own files instead. Checking every key here means a bad keyring
+ * is found at start up rather than when some key is first used. */
+int32u KEYRING_Open() {
+
+    keyring_header *h;
+    struct stat st;
+    void *map;
+    int32u i;
+    int fd;
+
+    if ( keyring_map != NULL ) {
+	return 1;
+    }
+
+    fd = open( KEYRING_FILE, O_RDONLY );
+    if ( fd < 0 ) {
+	return 0;
+    }
+
+    if ( fstat( fd, &st ) < 0 || 
+	 st.st_size < sizeof(keyring_header) + 
+	 KEYRING_ENTRIES * sizeof(keyring_entry) ) {
+	close( fd );
+	Alarm(PRINT,"KEYRING_Open: %s is too short.\n", KEYRING_FILE );
+	return 0;
+    }
+
+    map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( map == MAP_FAILED ) {
+	return 0;
+    }
+
+    h = (keyring_header*)map;
+    if ( h->magic != KEYRING_MAGIC || h->version != KEYRING_VERSION ||
+	 h->num_sites != NUM_SITES || 
+	 h->num_servers != NUM_SERVERS_IN_SITE ||
+	 h->num_clients != NUM_CLIENTS || 
+	 h->num_entries != KEYRING_ENTRIES ) {
+	munmap( map, st.st_size );
+	Alarm(PRINT,"KEYRING_Open: %s was made for another configuration.\n",
+		KEYRING_FILE );
+	return 0;
+    }
+
+    for ( i = 0; i < KEYRING_ENTRIES; i++ ) {
+	if ( KEYRING_Entry( map, st.st_size, i ) == NULL ) {
+	    munmap( map, st.st_size );
+	    Alarm(PRINT,"KEYRING_Open: %s is missing key %d.\n", 
+		    KEYRING_FILE, i );
+	    return 0;
+	}
+    }
+
+    keyring_map = map;
+    keyring_map_size = st.st_size;
+    return 1;
+}
+
+/* Decode a key from the keyring into n and e. Returns 1 on success and 0 if
+ * the keyring is not open or does not have the key. The mapping is only
+ * read, so any thread may call this. */
+int32u KEYRING_Lookup( int32u kind, int32u site, int32u number, BIGNUM *n,
+	BIGNUM *e ) {
+
+    keyring_entry *entry;
+    int32 index;
+
+    index = KEYRING_Index( kind, site, number );
+    if ( keyring_map == NULL || index < 0 ) {
+	return 0;
+    }
+
+    entry = KEYRING_Entry( keyring_map, keyring_map_size, index );
+    if ( entry == NULL ) {
+	return 0;
+    }
+
+    if ( BN_bin2bn( keyring_map + entry->offset, entry->n_len, n ) == NULL ||
+	 BN_bin2bn( keyring_map + entry->offset + entry->n_len, 
+		 entry->e_len, e ) == NULL ) {
+	return 0;
+    }
+
+    return 1;
+}
+
+/* Remember a public key for KEYRING_Write. */
+void KEYRING_Add( int32u kind, int32u site, int32u number, const BIGNUM *n,
+	const BIGNUM *e ) {
+
+    int32 index;
+
+    index = KEYRING_Index( kind, site, number );
+    if ( index < 0 ) {
+	Alarm(EXIT,"KEYRING_Add: No slot for key %d %d %d.\n", 
+		kind, site, number );
+    }
+
+    free( keyring_new_n[index] );
+    free( keyring_new_e[index] );
+    keyring_new_n_len[index] = BN_num_bytes( n );
+    keyring_new_e_len[index] = BN_num_bytes( e );
+    keyring_new_n[index] = malloc( keyring_new_n_len[index] );
+    keyring_new_e[index] = malloc( keyring_new_e_len[index] );
+    if ( keyring_new_n[index] == NULL || keyring_new_e[index] == NULL ) {
+	Alarm(EXIT,"KEYRING_Add: Out of memory.\n");
+    }
+    BN_bn2bin( n, keyring_new_n[index] );
+    BN_bn2bin( e, keyring_new_e[index] );
+}
+
+/* Write every key added so far to the keyring file. */
+void KEYRING_Write() {
+
+    keyring_header h;
+    keyring_entry entry;
+    FILE *f;
+    int32u i, offset;
+
+    f = fopen( KEYRING_FILE, "wb" );
+    if ( f == NULL ) {
+	Alarm(EXIT,"   ERROR: Could not open the key file: %s\n", 
+		KEYRING_FILE );
+    }
+
+    memset( &h, 0, sizeof(h) );
+    h.magic       = KEYRING_MAGIC;
+    h.version     = KEYRING_VERSION;
+    h.num_sites   = NUM_SITES;
+    h.num_servers = NUM_SERVERS_IN_SITE;
+    h.num_clients = NUM_CLIENTS;
+    h.num_entries = KEYRING_ENTRIES;
+    fwrite( &h, sizeof(h), 1, f );
+
+    offset = sizeof(h) + KEYRING_ENTRIES * sizeof(keyring_entry);
+    for ( i = 0; i < KEYRING_ENTRIES; i++ ) {
+	entry.offset = offset;
+	entry.n_len  = keyring_new_n_len[i];
+	entry.e_len  = keyring_new_e_len[i];
+	fwrite( &entry, sizeof(entry), 1, f );
+	offset += entry.n_len + entry.e_len;
+    }
+
+    for ( i = 0; i < KEYRING_ENTRIES; i++ ) {
+	fwrite( keyring_new_n[i], 1, keyring_new_n_len[i], f );
+	fwrite( keyring_new_e[i], 1, keyring_new_e_len[i], f );
+    }
+
+    if ( fclose( f ) != 0 ) {
+	Alarm(EXIT,"KEYRING_Write: Could not write %s\n", KEYRING_FILE );
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+/* Keyring of public keys. gen_keys writes the public RSA keys of every server
+ * and client, and the public threshold key of every site, into one binary
+ * file with a fixed index. A program maps the file and decodes a key only
+ * when it is first asked for, instead of parsing one key file per server and
+ * client at start up. Private keys stay in their own files. */
+
+#ifndef KEYRING_T6WD2NQ8ZJ4HX1MB7RKC
+#define KEYRING_T6WD2NQ8ZJ4HX1MB7RKC 1
+
+#include <openssl/bn.h>
+#include "util/arch.h"
+
+#define KEYRING_FILE        "./keys/keyring.bin"
+
+/* Kinds of keys in the keyring */
+#define KEYRING_SERVER_RSA  1    /* numbered by server in the site */
+#define KEYRING_CLIENT_RSA  2    /* numbered by client in the site */
+#define KEYRING_SITE_TC     3    /* one per site, number 0 */
+
+/* Public functions */
+
+int32u KEYRING_Open(); 
+
+int32u KEYRING_Lookup( int32u kind, int32u site, int32u number, BIGNUM *n,
+	BIGNUM *e ); 
+
+void KEYRING_Add( int32u kind, int32u site, int32u number, const BIGNUM *n,
+	const BIGNUM *e ); 
+
+void KEYRING_Write(); 
+
+#endif
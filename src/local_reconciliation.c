@@ -150,8 +150,8 @@ void LRECON_Do_Reconciliation() {
    
     Alarm(DEBUG,"elapsed: %f\n",UTIL_Stopwatch_Elapsed( &request_stopwatch ));
     
-    if ( GLOBAL.Max_ordered < GLOBAL.ARU + LOCAL_WINDOW && 
-	 PENDING.Max_ordered < PENDING.ARU + LOCAL_WINDOW &&
+    if ( GLOBAL.Max_ordered < GLOBAL.ARU + LOCAL_WINDOW_MAX && 
+	 PENDING.Max_ordered < PENDING.ARU + LOCAL_WINDOW_MAX &&
 	 UTIL_Stopwatch_Elapsed( &request_stopwatch ) < 0.050 ) {
 	return;
     }
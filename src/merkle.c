@@ -0,0 +1,413 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* Merkle tree signature aggregation. Messages of the aggregated types are not
+ * signed when UTIL_RSA_Sign_Message is called. They are held, along with any
+ * sends of them, until MERKLE_Flush_Pending runs. The flush is queued as a
+ * zero timeout, and the event system only runs timeouts once the sockets are
+ * drained, so every message generated while processing a burst of incoming
+ * packets ends up under the same root. */
+
+#include <string.h>
+#include "merkle.h"
+#include "auth.h"
+#include "utility.h"
+#include "timeouts.h"
+#include "util/memory.h"
+#include "util/alarm.h"
+
+extern server_variables VAR;
+
+/* A send of a message that is waiting for its signature */
+typedef struct dummy_merkle_send {
+    signed_message *mess;
+    int32u dest;
+    int32u site_id;
+    int32u server_id;
+} merkle_send;
+
+#define MERKLE_MAX_SENDS ( MERKLE_MAX_LEAVES * (NUM_SITES + 1) )
+
+#define MERKLE_LEAF_PREFIX 0
+#define MERKLE_NODE_PREFIX 1
+
+#if MERKLE_MAX_LEAVES > (1 << MERKLE_MAX_DEPTH) 
+#error MERKLE_MAX_LEAVES is larger than a tree of MERKLE_MAX_DEPTH levels
+#endif
+
+/* Messages waiting for the root signature */
+signed_message *merkle_pending[MERKLE_MAX_LEAVES];
+int32u merkle_num_pending;
+
+merkle_send merkle_sends[MERKLE_MAX_SENDS];
+int32u merkle_num_sends;
+
+/* Tree levels, level 0 holding the leaves */
+byte merkle_tree[MERKLE_MAX_DEPTH + 1][MERKLE_MAX_LEAVES][DIGEST_SIZE];
+
+/* Recently verified roots, indexed by site and server */
+byte merkle_root_cache[NUM_SITES + 1][NUM_SERVERS_IN_SITE + 1]
+                      [MERKLE_ROOT_CACHE_SIZE][DIGEST_SIZE];
+int32u merkle_root_cache_valid[NUM_SITES + 1][NUM_SERVERS_IN_SITE + 1]
+                              [MERKLE_ROOT_CACHE_SIZE];
+int32u merkle_root_cache_next[NUM_SITES + 1][NUM_SERVERS_IN_SITE + 1];
+
+/* Local Functions */
+void MERKLE_Leaf_Digest( signed_message *mess, byte *leaf ); 
+void MERKLE_Node_Digest( byte *left, byte *right, byte *node ); 
+void MERKLE_Sign_Single( signed_message *mess ); 
+int32u MERKLE_Is_Pending( signed_message *mess ); 
+int32u MERKLE_Root_Is_Cached( int32u site_id, int32u sender_id, byte *root ); 
+void MERKLE_Cache_Root( int32u site_id, int32u sender_id, byte *root ); 
+
+/* Messages of these types are signed under a Merkle root. These are the
+ * messages that each server generates once per sequence number. */
+int32u MERKLE_Is_Aggregated_Type( int32u type ) {
+
+#if MERKLE_AGGREGATION
+    if ( AUTH_Scheme( type ) == AUTH_SCHEME_MAC ) {
+	/* Authenticated with MACs rather than signed */
+	return 0;
+    }
+
+    if ( type == PRE_PREPARE_TYPE ||
+	 type == PREPARE_TYPE ||
+	 type == SIG_SHARE_TYPE ||
+	 type == ORDERED_PROOF_TYPE ) {
+	return 1;
+    }
+#endif
+    return 0;
+}
+
+void MERKLE_Leaf_Digest( signed_message *mess, byte *leaf ) {
+
+    byte buf[1 + DIGEST_SIZE];
+
+    /* Digest the same bytes that a plain RSA signature covers */
+    buf[0] = MERKLE_LEAF_PREFIX;
+    OPENSSL_RSA_Make_Digest( ((byte*)mess) + SIGNATURE_SIZE, 
+	    mess->len + sizeof(signed_message) - SIGNATURE_SIZE, 
+	    buf + 1 ); 
+    OPENSSL_RSA_Make_Digest( buf, sizeof(buf), leaf );
+}
+
+void MERKLE_Node_Digest( byte *left, byte *right, byte *node ) {
+
+    byte buf[1 + 2 * DIGEST_SIZE];
+
+    buf[0] = MERKLE_NODE_PREFIX;
+    memcpy( buf + 1, left, DIGEST_SIZE );
+    memcpy( buf + 1 + DIGEST_SIZE, right, DIGEST_SIZE );
+    OPENSSL_RSA_Make_Digest( buf, sizeof(buf), node );
+}
+
+/* Sign a message as the only leaf of its own tree. */
+void MERKLE_Sign_Single( signed_message *mess ) {
+
+    merkle_path *path;
+    byte root[DIGEST_SIZE];
+
+    MERKLE_Leaf_Digest( mess, root );
+    OPENSSL_RSA_Make_Signature( root, mess->sig );
+
+    path = (merkle_path*)(((byte*)(mess + 1)) + mess->len);
+    path->leaf_index = 0;
+    path->depth = 0;
+}
+
+int32u MERKLE_Is_Pending( signed_message *mess ) {
+
+    int32u i;
+
+    for ( i = 0; i < merkle_num_pending; i++ ) {
+	if ( merkle_pending[i] == mess ) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/* Called in place of signing a message. Returns 1 if the message will be
+ * signed under a Merkle root, 0 if the caller should sign it normally. */
+int32u MERKLE_Aggregate_Message( signed_message *mess ) {
+
+    if ( !MERKLE_Is_Aggregated_Type( mess->type ) ) {
+	return 0;
+    }
+
+    if ( MERKLE_Is_Pending( mess ) ) {
+	return 1;
+    }
+
+    if ( mess->len + sizeof(signed_message) + MERKLE_MAX_PATH_BYTES >
+	 MAX_PACKET_SIZE ) {
+	/* No room for a full path. An empty path always fits. */
+	MERKLE_Sign_Single( mess );
+	return 1;
+    }
+
+    if ( merkle_num_pending == MERKLE_MAX_LEAVES ) {
+	MERKLE_Flush_Pending( 0, NULL );
+    }
+
+    if ( merkle_num_pending == 0 ) {
+	E_queue( MERKLE_Flush_Pending, 0, NULL, timeout_zero );
+    }
+
+    inc_ref_cnt( mess );
+    merkle_pending[merkle_num_pending++] = mess;
+
+    return 1;
+}
+
+/* Hold a send of a message that is waiting for its signature. Returns 1 if
+ * the send was deferred, 0 if the caller should send the message now. */
+int32u MERKLE_Defer_Send( signed_message *mess, int32u dest, int32u site_id,
+	int32u server_id ) {
+
+    merkle_send *s;
+
+    if ( merkle_num_pending == 0 || !MERKLE_Is_Pending( mess ) ) {
+	return 0;
+    }
+
+    if ( merkle_num_sends == MERKLE_MAX_SENDS ) {
+	/* Sign now; the message is no longer pending afterwards. */
+	MERKLE_Flush_Pending( 0, NULL );
+	return 0;
+    }
+
+    s = &merkle_sends[merkle_num_sends++];
+    s->mess = mess;
+    s->dest = dest;
+    s->site_id = site_id;
+    s->server_id = server_id;
+    inc_ref_cnt( mess );
+
+    return 1;
+}
+
+/* Build the tree over the pending messages, sign its root, attach the
+ * authentication paths, and perform the sends that were held back. */
+void MERKLE_Flush_Pending( int dummy, void *dummyp ) {
+
+    int32u i, level, width, depth, index, num_sends;
+    byte *right;
+    byte *sibling;
+    byte sig[SIGNATURE_SIZE];
+    merkle_path *path;
+    signed_message *mess;
+    util_stopwatch w;
+
+    if ( merkle_num_pending == 0 ) {
+	return;
+    }
+
+    UTIL_Stopwatch_Start( &w );
+
+    for ( i = 0; i < merkle_num_pending; i++ ) {
+	MERKLE_Leaf_Digest( merkle_pending[i], merkle_tree[0][i] );
+    }
+
+    /* An odd node at the end of a level is paired with itself. */
+    depth = 0;
+    for ( width = merkle_num_pending; width > 1; width = (width + 1) / 2 ) {
+	for ( i = 0; i < width; i += 2 ) {
+	    right = ( i + 1 < width ) ? merkle_tree[depth][i + 1] :
+					merkle_tree[depth][i];
+	    MERKLE_Node_Digest( merkle_tree[depth][i], right,
+		    merkle_tree[depth + 1][i / 2] );
+	}
+	depth++;
+    }
+
+    OPENSSL_RSA_Make_Signature( merkle_tree[depth][0], sig );
+
+    for ( i = 0; i < merkle_num_pending; i++ ) {
+	mess = merkle_pending[i];
+	memcpy( mess->sig, sig, SIGNATURE_SIZE );
+
+	path = (merkle_path*)(((byte*)(mess + 1)) + mess->len);
+	path->leaf_index = i;
+	path->depth = depth;
+	sibling = (byte*)(path + 1);
+
+	index = i;
+	width = merkle_num_pending;
+	for ( level = 0; level < depth; level++ ) {
+	    if ( (index ^ 1) < width ) {
+		memcpy( sibling, merkle_tree[level][index ^ 1], DIGEST_SIZE );
+	    } else {
+		memcpy( sibling, merkle_tree[level][index], DIGEST_SIZE );
+	    }
+	    sibling += DIGEST_SIZE;
+	    index /= 2;
+	    width = (width + 1) / 2;
+	}
+    }
+
+    UTIL_Stopwatch_Stop( &w );
+    Alarm(DEBUG,"%d %d Merkle sign %f leaves %d\n",
+	    VAR.My_Site_ID, VAR.My_Server_ID, UTIL_Stopwatch_Elapsed( &w ),
+	    merkle_num_pending );
+
+    /* Nothing is pending while the held sends go out. */
+    num_sends = merkle_num_sends;
+    merkle_num_sends = 0;
+    for ( i = 0; i < merkle_num_pending; i++ ) {
+	dec_ref_cnt( merkle_pending[i] );
+    }
+    merkle_num_pending = 0;
+
+    for ( i = 0; i < num_sends; i++ ) {
+	if ( merkle_sends[i].dest == MERKLE_SEND_SITE ) {
+	    UTIL_Site_Broadcast( merkle_sends[i].mess );
+	} else {
+	    UTIL_Send_To_Server( merkle_sends[i].mess, 
+		    merkle_sends[i].site_id, merkle_sends[i].server_id );
+	}
+	dec_ref_cnt( merkle_sends[i].mess );
+    }
+}
+
+/* Returns the number of bytes of the authentication path that follows the
+ * content of the message. The path must already be in place. */
+int32u MERKLE_Path_Bytes( signed_message *mess ) {
+
+    merkle_path *path;
+
+    if ( !MERKLE_Is_Aggregated_Type( mess->type ) ) {
+	return 0;
+    }
+
+    path = (merkle_path*)(((byte*)(mess + 1)) + mess->len);
+    return sizeof(merkle_path) + path->depth * DIGEST_SIZE;
+}
+
+/* Returns the number of bytes to send for a message. */
+int32u MERKLE_Message_Bytes( signed_message *mess ) {
+
+    return mess->len + sizeof(signed_message) + MERKLE_Path_Bytes( mess );
+}
+
+/* Check that a received message of an aggregated type is exactly the
+ * content plus a well formed authentication path. */
+int32u MERKLE_Validate_Path_Length( signed_message *mess, int32u num_bytes ) {
+
+    merkle_path *path;
+
+    if ( num_bytes < sizeof(signed_message) + sizeof(merkle_path) ||
+	 mess->len > num_bytes - sizeof(signed_message) - 
+	             sizeof(merkle_path) ) {
+	return 0;
+    }
+
+    path = (merkle_path*)(((byte*)(mess + 1)) + mess->len);
+
+    if ( path->depth > MERKLE_MAX_DEPTH ||
+	 path->leaf_index >= (1 << path->depth) ) {
+	return 0;
+    }
+
+    if ( num_bytes != mess->len + sizeof(signed_message) + 
+	    sizeof(merkle_path) + path->depth * DIGEST_SIZE ) {
+	return 0;
+    }
+
+    return 1;
+}
+
+int32u MERKLE_Root_Is_Cached( int32u site_id, int32u sender_id, byte *root ) {
+
+    int32u i;
+
+    for ( i = 0; i < MERKLE_ROOT_CACHE_SIZE; i++ ) {
+	if ( merkle_root_cache_valid[site_id][sender_id][i] &&
+	     OPENSSL_RSA_Digests_Equal( 
+		 merkle_root_cache[site_id][sender_id][i], root ) ) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+void MERKLE_Cache_Root( int32u site_id, int32u sender_id, byte *root ) {
+
+    int32u slot;
+
+    slot = merkle_root_cache_next[site_id][sender_id];
+    memcpy( merkle_root_cache[site_id][sender_id][slot], root, DIGEST_SIZE );
+    merkle_root_cache_valid[site_id][sender_id][slot] = 1;
+    merkle_root_cache_next[site_id][sender_id] = 
+	(slot + 1) % MERKLE_ROOT_CACHE_SIZE;
+}
+
+/* Verify a message signed under a Merkle root: recompute the root from the
+ * leaf and the authentication path, then check the RSA signature on the
+ * root unless the same root was already verified for this server. Assumes
+ * that MERKLE_Validate_Path_Length passed and the sender is in range. */
+int32u MERKLE_Verify_Message( signed_message *mess, int32u sender_id, 
+	int32u site_id ) {
+
+    merkle_path *path;
+    byte *sibling;
+    byte node[DIGEST_SIZE];
+    int32u level, index;
+
+    if ( site_id < 1 || site_id > NUM_SITES ) {
+	return 0;
+    }
+
+    path = (merkle_path*)(((byte*)(mess + 1)) + mess->len);
+    sibling = (byte*)(path + 1);
+
+    MERKLE_Leaf_Digest( mess, node );
+
+    index = path->leaf_index;
+    for ( level = 0; level < path->depth; level++ ) {
+	if ( index & 1 ) {
+	    MERKLE_Node_Digest( sibling, node, node );
+	} else {
+	    MERKLE_Node_Digest( node, sibling, node );
+	}
+	sibling += DIGEST_SIZE;
+	index /= 2;
+    }
+
+    if ( MERKLE_Root_Is_Cached( site_id, sender_id, node ) ) {
+	return 1;
+    }
+
+    if ( !OPENSSL_RSA_Verify_Signature( node, mess->sig, sender_id, site_id,
+		RSA_SERVER ) ) {
+	return 0;
+    }
+
+    MERKLE_Cache_Root( site_id, sender_id, node );
+    return 1;
+}
@@ -0,0 +1,77 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* Merkle tree aggregation of server RSA signatures. A burst of messages is
+ * signed with one RSA operation on the root of a Merkle tree built over the
+ * digests of the messages. Each message carries an authentication path
+ * (a merkle_path header followed by the sibling digests) right after its
+ * content, so the len field of the signed_message is unchanged. */
+
+#ifndef MERKLE_V7QX2LD9KA4MZ8RT3PWE
+#define MERKLE_V7QX2LD9KA4MZ8RT3PWE 1
+
+#include "data_structs.h"
+#include "openssl_rsa.h"
+
+#define MERKLE_MAX_DEPTH       6   /* Supports up to 64 leaves */
+
+#define MERKLE_MAX_PATH_BYTES  ( sizeof(merkle_path) + \
+	                         MERKLE_MAX_DEPTH * DIGEST_SIZE )
+
+#define MERKLE_ROOT_CACHE_SIZE 8   /* Verified roots remembered per server */
+
+/* Destinations of a send that is waiting for the root signature */
+#define MERKLE_SEND_SITE       1
+#define MERKLE_SEND_SERVER     2
+
+typedef struct dummy_merkle_path {
+    int32u leaf_index;  /* position of the message among the leaves */
+    int32u depth;       /* number of sibling digests that follow */
+    /* sibling digests follow, starting at the leaf level */
+} merkle_path;
+
+/* Public functions */
+
+int32u MERKLE_Is_Aggregated_Type( int32u type );
+
+int32u MERKLE_Aggregate_Message( signed_message *mess ); 
+
+int32u MERKLE_Defer_Send( signed_message *mess, int32u dest, int32u site_id,
+	int32u server_id ); 
+
+void MERKLE_Flush_Pending( int dummy, void *dummyp ); 
+
+int32u MERKLE_Path_Bytes( signed_message *mess ); 
+
+int32u MERKLE_Message_Bytes( signed_message *mess ); 
+
+int32u MERKLE_Validate_Path_Length( signed_message *mess, int32u num_bytes ); 
+
+int32u MERKLE_Verify_Message( signed_message *mess, int32u sender_id, 
+	int32u site_id ); 
+
+#endif
@@ -36,6 +36,8 @@
 #include "util/memory.h"
 #include "assign_sequence.h"
 #include "construct_collective_state_protocol.h"
+#include "checkpoint.h"
+#include "window.h"
 #include <stdlib.h>
 
 extern server_variables VAR;
@@ -45,7 +47,6 @@ extern pending_data_struct PENDING;
 util_stopwatch stopwatch;
 
 signed_message* GLOBO_Construct_Accept( signed_message *proposal ); 
-int32u GLOBO_Update_ARU(); 
 
 util_stopwatch global_progress_stopwatch;
 
@@ -82,7 +83,7 @@ void GLOBO_Emulate_Send_Accept( int dummy, void *proposal ) {
 int32u GLOBO_Within_Response_Window(int32u seq_num) {
 
   /* FINAL added plus 10 */
-    if (seq_num > GLOBAL.ARU + GLOBAL_WINDOW + 10) {
+    if (seq_num > GLOBAL.ARU + GLOBAL_WINDOW_MAX + 10) {
       Alarm(GLO_PRINT, "***Not Responding, garu = %d, seq = %d\n", 
 	    GLOBAL.ARU, seq_num);
 	return 0;
@@ -194,7 +195,10 @@ void GLOBO_Process_Proposal( signed_message *proposal ) {
 	/* Already ordered */
 	ordered_proof = 
 	  GRECON_Construct_Ordered_Proof_Message( proposal_specific->seq_num);
-	UTIL_Send_To_Site_Representatives( ordered_proof );
+	if ( ordered_proof != NULL ) {
+	    UTIL_Send_To_Site_Representatives( ordered_proof );
+	    dec_ref_cnt( ordered_proof );
+	}
 	return;
     }
 
@@ -288,7 +292,7 @@ signed_message* GLOBO_Construct_Accept( signed_message *proposal ) {
  
     proposal_specific = (proposal_message*)(proposal+1);
     
-    accept = UTIL_New_Signed_Message();
+    accept = UTIL_New_Signed_Message_Size( sizeof(accept_message) );
     accept_specific = (accept_message*)(accept+1);
     
     accept->machine_id = 0;
@@ -332,7 +336,6 @@ void GLOBO_Handle_Global_Ordering( global_slot_struct *slot) {
     signed_message *proposal;
     proposal_message *proposal_specific;
     signed_message *update;
-    update_message *update_specific;
 
     double elapsed;
 
@@ -364,8 +367,8 @@ void GLOBO_Handle_Global_Ordering( global_slot_struct *slot) {
 
     CCS_Union_Decider( GLOBAL_CONTEXT );     
 
-    update = (signed_message*)(proposal_specific+1);
-    update_specific = (update_message*)(update+1);
+    update = UTIL_Next_Batched_Update( (byte*)(proposal_specific+1),
+	    proposal->len - sizeof(proposal_message), NULL );
 
     if ( proposal_specific->seq_num % 1000 == 1 && 
 	 proposal_specific->seq_num == 2001 ) {
@@ -383,7 +386,12 @@ void GLOBO_Handle_Global_Ordering( global_slot_struct *slot) {
 	LRECON_Do_Reconciliation();
     }
 
-    UTIL_CLIENT_Respond_To_Client(update, proposal_specific->seq_num);
+    /* Respond to each client whose update was in the ordered batch */
+    for ( ; update != NULL; 
+	  update = UTIL_Next_Batched_Update( (byte*)(proposal_specific+1),
+	      proposal->len - sizeof(proposal_message), update ) ) {
+	UTIL_CLIENT_Respond_To_Client(update, proposal_specific->seq_num);
+    }
 
     /* JUST PRINT SOME RESULTS IF I AM REP at LEADER SITE */
     if ( !UTIL_I_Am_Representative() || !UTIL_I_Am_In_Leader_Site() ) {
@@ -445,13 +453,9 @@ void GLOBO_Dump_Test_Results( double updates_per_sec ) {
 void GLOBO_Garbage_Collect_Global_Slot( global_slot_struct *slot ) {
 
     int32u si;
-    signed_message *m;
 
     for ( si = 1; si <= NUM_SERVERS_IN_SITE; si++ ) {
-	m = slot->accept_share[si];
-	if ( m != NULL ) {
-	    dec_ref_cnt(m);
-	}
+	UTIL_PURGE( &slot->accept_share[si] );
     }
 
 }
@@ -463,6 +467,7 @@ int32u GLOBO_Update_ARU() {
     int32u prev_aru;
     int32u update;
     global_slot_struct *slot;
+    pending_slot_struct *p_slot;
  
     prev_aru = GLOBAL.ARU;
  
@@ -482,6 +487,12 @@ int32u GLOBO_Update_ARU() {
 	    UTIL_Apply_Update_To_State_Machine( slot->proposal );
 	    GLOBO_Garbage_Collect_Global_Slot(slot);
 	    GLOBAL.ARU++;
+	    UTIL_Refresh_Alarm_Prefix();
+	    CKPT_Process_Executed_Proposal( slot->proposal );
+	    p_slot = UTIL_Get_Pending_Slot_If_Exists( GLOBAL.ARU );
+	    if ( p_slot != NULL ) {
+		WIN_Ordered( GLOBAL_CONTEXT, p_slot->time_proposal_sent );
+	    }
 	}
     }
     
@@ -507,9 +518,9 @@ int32u GLOBO_Update_ARU() {
     }
 
 
-    if ( UTIL_I_Am_In_Leader_Site() && UTIL_I_Am_Representative() ) {
-	Alarm(PRINT,"\n");
-    } else if ( GLOBAL.ARU % 20 == 0 ) {
+    /* Progress line every 20 ordered sequence numbers. The ARU can move by
+     * more than one, so print when it crosses a multiple of 20. */
+    if ( prev_aru / 20 != GLOBAL.ARU / 20 ) {
 	Alarm(PRINT,"\n");
     }
 
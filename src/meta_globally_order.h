@@ -37,6 +37,8 @@ void GLOBO_Process_Proposal( signed_message *proposal );
 void GLOBO_Dispatcher( signed_message *mess );
 void GLOBO_Handle_Accept( signed_message *accept ); 
 void GLOBO_Handle_Global_Ordering( global_slot_struct *slot);
+int32u GLOBO_Update_ARU(); 
+void GLOBO_Garbage_Collect_Global_Slot( global_slot_struct *slot ); 
 void GLOBO_Initialize(); 
 void GLOBO_Reset_Global_Progress_Bookkeeping_For_Global_View_Change(); 
 void GLOBO_Reset_Global_Progress_Bookkeeping_For_Local_View_Change();  
@@ -25,6 +25,10 @@
  *
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  /* recvmmsg */
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -56,6 +60,10 @@
 #include "network.h"
 #include "construct_collective_state_protocol.h"
 #include "global_reconciliation.h"
+#include "merkle.h"
+#include "worker_pool.h"
+#include "io_stage.h"
+#include "error_wrapper.h"
 
 #ifdef SET_USE_SPINES
 #include "spines/spines_lib.h"
@@ -63,10 +71,23 @@
 
 #define UDP_SOURCE    1
 #define SPINES_SOURCE 2
+#define STAGE_SOURCE  3
 
 #include "utility.h"
 #include "sys/socket.h"
 
+/* The stage timings in Net_Srv_Process_Message are only printed at DEBUG
+ * level, so they are only taken when DEBUG alarms are compiled in. */
+#if ( ALARM_COMPILED_MASK & DEBUG )
+#define NET_STAGE_TIMING 1
+#define NET_STOPWATCH_START( w )  UTIL_Stopwatch_Start( w )
+#define NET_STOPWATCH_STOP( w )   UTIL_Stopwatch_Stop( w )
+#else
+#define NET_STAGE_TIMING 0
+#define NET_STOPWATCH_START( w )
+#define NET_STOPWATCH_STOP( w )
+#endif
+
 
 /* Global variables */
 extern network_variables NET;
@@ -82,6 +103,37 @@ static sys_scatter ses_recv_scat;
 
 extern int32 sd;
 
+#if VERIFY_THREADS
+worker_pool *net_verify_pool;
+#endif
+
+#if RECV_BATCH_SIZE > 1 && defined(__linux__)
+#define NET_RECV_BATCH 1
+/* Packet buffers and headers for reading a batch with recvmmsg */
+static char          *srv_batch_buf[RECV_BATCH_SIZE];
+static struct iovec   srv_batch_iov[RECV_BATCH_SIZE];
+static struct mmsghdr srv_batch_msgs[RECV_BATCH_SIZE];
+#else
+#define NET_RECV_BATCH 0
+#endif
+
+/* Local functions */
+void Net_Srv_Handle_Packet( char **buf, int32u received_bytes ); 
+
+#if NET_RECV_BATCH
+void Net_Srv_Recv_Batch( channel sk ); 
+#endif
+
+#if IO_STAGE_THREADS
+void Net_Srv_Recv_Stage(void); 
+#endif
+
+void Net_Srv_Process_Message( signed_message *mess, int32u received_bytes, 
+	int32u verify_signature ); 
+
+void Net_Srv_Deliver_Verified( signed_message *mess, int32u received_bytes, 
+	int32u result ); 
+
 /***********************************************************/
 /* void Init_Network(void)                                 */
 /*                                                         */
@@ -150,6 +202,19 @@ void Init_Network(void)
 	Alarm(EXIT, "Init_Network: Cannot allocate packet object\n");
     }
 
+#if NET_RECV_BATCH
+    {
+	int32u i;
+
+	for ( i = 0; i < RECV_BATCH_SIZE; i++ ) {
+	    srv_batch_buf[i] = (char *) new_ref_cnt(PACK_BODY_OBJ);
+	    if(srv_batch_buf[i] == NULL) {
+		Alarm(EXIT, "Init_Network: Cannot allocate packet object\n");
+	    }
+	}
+    }
+#endif
+
     ses_recv_scat.num_elements = 1;
     ses_recv_scat.elements[0].len = sizeof(packet);
     ses_recv_scat.elements[0].buf = (char *) new_ref_cnt(PACK_BODY_OBJ);
@@ -161,8 +226,17 @@ void Init_Network(void)
     srv_recv_sk = DL_init_channel(RECV_CHANNEL, NET.Port, NET.Mcast_Address, 0);
     NET.Send_Channel = DL_init_channel(SEND_CHANNEL, NET.Port, 0, 0);
 
+#if IO_STAGE_THREADS
+    /* The socket is read on the receiver thread, which signals the event
+     * loop through its own fd. */
+    IOSTAGE_Start_Sender();
+    E_attach_fd(IOSTAGE_Start_Receiver(srv_recv_sk), READ_FD, Net_Srv_Recv, 
+	        STAGE_SOURCE, NULL, MEDIUM_PRIORITY );
+    Alarm(PRINT,"Started the receive and send threads.\n");
+#else
     E_attach_fd(srv_recv_sk, READ_FD, Net_Srv_Recv, 
 	        UDP_SOURCE, NULL, MEDIUM_PRIORITY );
+#endif
 
     getsockopt( srv_recv_sk, SOL_SOCKET, SO_RCVBUF, &rcvbuf_size, &size  );
 
@@ -176,6 +250,13 @@ void Init_Network(void)
 
     Alarm(DEBUG,"Buff size set to: %d %d\n", rcvbuf_size, size );
 
+#if VERIFY_THREADS
+    net_verify_pool = WPOOL_Create( VERIFY_THREADS, VERIFY_QUEUE_SIZE,
+	    VAL_Check_Packet_Signature, Net_Srv_Deliver_Verified );
+    Alarm(PRINT,"Started %d signature verification threads.\n",
+	    VERIFY_THREADS );
+#endif
+
 #ifdef SET_USE_SPINES
     spines_addr.sin_family = AF_INET;
     spines_addr.sin_port   = htons(SPINES_PORT);
@@ -253,31 +334,120 @@ int32u loss_count;
 void Net_Srv_Recv(channel sk, int source, void *dummy_p) 
 {
     int	received_bytes;
-    util_stopwatch w;
-    signed_message *mess;
-    int32u caller_is_client;
-    signed_message *dummy_prop;
-    //proposal_message *proposal_specific;
 
+#if VERIFY_THREADS
+    if ( WPOOL_Is_Full( net_verify_pool ) ) {
+	/* Leave the packet in the socket until verifiers catch up */
+	WPOOL_Hold_Fd( net_verify_pool, sk );
+	return;
+    }
+#endif
+
+#if IO_STAGE_THREADS
+    if(source == STAGE_SOURCE) {
+	Net_Srv_Recv_Stage();
+	return;
+    }
+#endif
+
+#if NET_RECV_BATCH
+    if(source == UDP_SOURCE) {
+	Net_Srv_Recv_Batch(sk);
+	return;
+    }
+#endif
 
     if(source == UDP_SOURCE) {
 	received_bytes = DL_recv(sk, &srv_recv_scat);  
-	mess = (signed_message*)srv_recv_scat.elements[0].buf;
     }
 #ifdef SET_USE_SPINES
     else if(source == SPINES_SOURCE) {
 	received_bytes = spines_recvfrom(sk, srv_recv_scat.elements[0].buf, MAX_PACKET_SIZE, 0, NULL, 0);
-	mess = (signed_message*)srv_recv_scat.elements[0].buf;
     }
 #endif    
     else {
 	return;
     }
 
-    
+    Net_Srv_Handle_Packet( &srv_recv_scat.elements[0].buf, received_bytes );
+}
+
+#if NET_RECV_BATCH
+/* Read up to RECV_BATCH_SIZE datagrams with one system call and handle each
+ * of them in the order they were received. */
+void Net_Srv_Recv_Batch( channel sk ) 
+{
+    int32u max_batch, i;
+    int ret;
+
+    max_batch = RECV_BATCH_SIZE;
+#if VERIFY_THREADS
+    /* Do not read more than the verifiers can take */
+    if ( WPOOL_Free_Slots( net_verify_pool ) < max_batch ) {
+	max_batch = WPOOL_Free_Slots( net_verify_pool );
+    }
+#endif
+
+    for ( i = 0; i < max_batch; i++ ) {
+	srv_batch_iov[i].iov_base = srv_batch_buf[i];
+	srv_batch_iov[i].iov_len  = sizeof(packet);
+	memset( &srv_batch_msgs[i].msg_hdr, 0, sizeof(struct msghdr) );
+	srv_batch_msgs[i].msg_hdr.msg_iov    = &srv_batch_iov[i];
+	srv_batch_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    ret = recvmmsg( sk, srv_batch_msgs, max_batch, MSG_DONTWAIT, NULL );
+    if ( ret <= 0 ) {
+	Alarm(DEBUG,"Net_Srv_Recv_Batch: recvmmsg returned %d\n", ret);
+	return;
+    }
+
+    for ( i = 0; i < (int32u)ret; i++ ) {
+	Net_Srv_Handle_Packet( &srv_batch_buf[i], srv_batch_msgs[i].msg_len );
+    }
+}
+#endif
+
+#if IO_STAGE_THREADS
+/* Take up to RECV_BATCH_SIZE packets that the receiver thread has read and
+ * handle each of them in the order they were received. */
+void Net_Srv_Recv_Stage() 
+{
+    int32u max_batch, i, received_bytes;
+
+    max_batch = RECV_BATCH_SIZE;
+#if VERIFY_THREADS
+    /* Do not take more than the verifiers can take */
+    if ( WPOOL_Free_Slots( net_verify_pool ) < max_batch ) {
+	max_batch = WPOOL_Free_Slots( net_verify_pool );
+    }
+#endif
+
+    IOSTAGE_Receive_Begin();
+    for ( i = 0; i < max_batch; i++ ) {
+	received_bytes = IOSTAGE_Receive( 
+		(byte*)srv_recv_scat.elements[0].buf );
+	if ( received_bytes == 0 ) {
+	    break;
+	}
+	Net_Srv_Handle_Packet( &srv_recv_scat.elements[0].buf, 
+		received_bytes );
+    }
+    IOSTAGE_Receive_End();
+}
+#endif
+
+/* Handle one received packet held in *buf. If the packet is kept by the
+ * protocol, *buf is replaced by a new packet buffer for the next receive. */
+void Net_Srv_Handle_Packet( char **buf, int32u received_bytes ) 
+{
+    signed_message *mess;
+    int32u caller_is_client;
+    signed_message *dummy_prop;
+
     /* Process the packet */
     
-    mess = (signed_message*)srv_recv_scat.elements[0].buf;
+    mess = (signed_message*)*buf;
 
 
 /* TEST */
@@ -300,18 +470,83 @@ void Net_Srv_Recv(channel sk, int source, void *dummy_p)
 
     UTIL_Add_To_Mess_Count( mess->type ); 
 
+#if VERIFY_THREADS
+    /* Hand the packet to the verifier threads; it comes back through
+     * Net_Srv_Deliver_Verified. */
+    WPOOL_Submit( net_verify_pool, mess, received_bytes );
+    if((*buf = (char *) new_ref_cnt(PACK_BODY_OBJ)) == NULL) {
+	Alarm(EXIT, "Net_Srv_Recv: Could not allocate packet body obj\n");
+    }
+    return;
+#endif
+
+    Net_Srv_Process_Message( mess, received_bytes, 1 );
+
+    /* The following checks to see if the packet has been stored and, if so, it
+     * allocates a new packet for the next incoming message. */
+    /* Allocate another packet if needed */
+    if(get_ref_cnt(*buf) > 1) {
+	dec_ref_cnt(*buf);
+	if ( mess->type == PREPARE_TYPE ) {
+	    Alarm(DEBUG,"YES dec_ref_cnt %d\n",mess, 
+		    get_ref_cnt(mess) );
+	}
+	if((*buf = (char *) new_ref_cnt(PACK_BODY_OBJ)) == NULL) {
+	    Alarm(EXIT, "Net_Srv_Recv: Could not allocate packet body obj\n");
+	}
+    } else {
+	if ( mess->type == PREPARE_TYPE ) {
+	    Alarm(DEBUG,"NO dec_ref_cnt %d\n",mess, 
+		    get_ref_cnt(mess) );
+	}
+    }
+}
+
+/* Called on the event loop, in receive order, once a verifier thread has
+ * checked the signature of a packet. Drops the pool's reference when done. */
+void Net_Srv_Deliver_Verified( signed_message *mess, int32u received_bytes, 
+	int32u result ) 
+{
+    if ( result == VAL_SIG_INVALID ) {
+	VALIDATE_FAILURE_LOG( mess, received_bytes );
+    } else {
+	Net_Srv_Process_Message( mess, received_bytes, 
+		result == VAL_SIG_UNCHECKED );
+    }
+    dec_ref_cnt( mess );
+}
+
+/* Validate, conflict check, apply, and dispatch a received message. */
+void Net_Srv_Process_Message( signed_message *mess, int32u received_bytes, 
+	int32u verify_signature ) 
+{
+#if NET_STAGE_TIMING
+    util_stopwatch w;
+#endif
+    int32u valid;
+    //proposal_message *proposal_specific;
+
     /* 1) Validate the Packet */
 #if 1 
-    UTIL_Stopwatch_Start(&w);
-    if ( ! VAL_Validate_Message( 
-		(signed_message*)srv_recv_scat.elements[0].buf, 
-		received_bytes) ) {
+    NET_STOPWATCH_START(&w);
+    if ( verify_signature ) {
+	valid = VAL_Validate_Message( mess, received_bytes );
+    } else {
+	valid = VAL_Validate_Presigned_Message( mess, received_bytes );
+    }
+    if ( !valid ) {
 	return;
     }
-    UTIL_Stopwatch_Stop(&w);
+    NET_STOPWATCH_STOP(&w);
+#if NET_STAGE_TIMING
     Alarm(DEBUG,"%d %d Validate %f\n",VAR.My_Site_ID, VAR.My_Server_ID,
 	    UTIL_Stopwatch_Elapsed(&w) ); 
 #endif
+#endif
+
+    /* From here on the message is kept in a buffer of its own size, so that
+     * what the protocol stores does not pin a whole packet each. */
+    mess = UTIL_Compact_Message( mess, received_bytes );
 
 #if 0 
     if ( mess->type == PROPOSAL_TYPE ) {
@@ -330,14 +565,13 @@ void Net_Srv_Recv(channel sk, int source, void *dummy_p)
 #endif
 
     /* Process Messages that are needed even if the generate conflicts. */
-    DIS_Dispatch_Message_Pre_Conflict_Checking( 
-	    (signed_message*)(srv_recv_scat.elements[0].buf) 
-	    );
+    DIS_Dispatch_Message_Pre_Conflict_Checking( mess );
 
     /* 2) Check for conflicts with our data structure */
      
 #if 1    
-    if ( CONFL_Check_Message( mess, received_bytes )
+    if ( CONFL_Check_Message( mess, 
+		received_bytes - MERKLE_Path_Bytes( mess ) )
 	    ) {
 	Alarm(NET_PRINT,"CONFLICT FAILED type:%d p.view %d g.view %d site %d server %d con %d  \n", 
 		mess->type,
@@ -351,44 +585,26 @@ void Net_Srv_Recv(channel sk, int source, void *dummy_p)
 	/* No Conflict */
 
 	/* Apply */
-	UTIL_Stopwatch_Start(&w);
-	APPLY_Message_To_Data_Structs( 
-		(signed_message*)(srv_recv_scat.elements[0].buf)
-		); 
-	UTIL_Stopwatch_Stop(&w);
+	NET_STOPWATCH_START(&w);
+	APPLY_Message_To_Data_Structs( mess ); 
+	NET_STOPWATCH_STOP(&w);
+#if NET_STAGE_TIMING
 	if ( mess->type == PREPARE_TYPE ) 
 	   Alarm(DEBUG,"%d %d Apply %f\n",VAR.My_Site_ID, VAR.My_Server_ID,
 		UTIL_Stopwatch_Elapsed(&w) ); 
+#endif
 
 	/* Now dispatch the mesage so that is will be processed by the
 	 * appropriate protocol */
-	UTIL_Stopwatch_Start(&w);
-	DIS_Dispatch_Message( 
-		(signed_message*)(srv_recv_scat.elements[0].buf) 
-		);
-	UTIL_Stopwatch_Stop(&w);
+	NET_STOPWATCH_START(&w);
+	DIS_Dispatch_Message( mess );
+	NET_STOPWATCH_STOP(&w);
+#if NET_STAGE_TIMING
 	Alarm(DEBUG,"%d %d Dispatch %f\n",VAR.My_Site_ID, VAR.My_Server_ID,
 		UTIL_Stopwatch_Elapsed(&w) ); 
+#endif
     }
 
-    /* The following checks to see if the packet has been stored and, if so, it
-     * allocates a new packet for the next incoming message. */
-    /* Allocate another packet if needed */
-    if(get_ref_cnt(srv_recv_scat.elements[0].buf) > 1) {
-	dec_ref_cnt(srv_recv_scat.elements[0].buf);
-	if ( mess->type == PREPARE_TYPE ) {
-	    Alarm(DEBUG,"YES dec_ref_cnt %d\n",mess, 
-		    get_ref_cnt(mess) );
-	}
-	if((srv_recv_scat.elements[0].buf = 
-	    (char *) new_ref_cnt(PACK_BODY_OBJ)) == NULL) {
-	    Alarm(EXIT, "Net_Srv_Recv: Could not allocate packet body obj\n");
-	}
-    } else {
-	if ( mess->type == PREPARE_TYPE ) {
-	    Alarm(DEBUG,"NO dec_ref_cnt %d\n",mess, 
-		    get_ref_cnt(mess) );
-	}
-    }
+    dec_ref_cnt( mess );
 }
 
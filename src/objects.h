@@ -59,8 +59,12 @@
 /* CCS Union object*/
 #define UNION_ENTRY_OBJ         14
 
+/* Signed messages smaller than a packet body */
+#define MESS_SMALL_OBJ          15
+#define MESS_MEDIUM_OBJ         16
+
 /* Special objects */
-#define UNKNOWN_OBJ             15      /* This should be the last one */ 
+#define UNKNOWN_OBJ             17      /* This should be the last one */ 
 
 /* Global Functions to manipulate objects */
 int     Is_Valid_Object(int32u oid);
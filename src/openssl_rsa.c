@@ -36,8 +36,10 @@
 #include <openssl/bn.h>
 #include <openssl/evp.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include "data_structs.h"
+#include "keyring.h"
 #include "util/arch.h"
 #include "util/alarm.h"
 #include "util/sp_events.h"
@@ -60,8 +62,13 @@
 
 /* Globals */
 RSA *private_rsa; /* My Private Key */
+
+/* Public keys, decoded the first time each is needed. Verification threads
+ * may decode them too, so a key is published only once it is complete. */
 RSA *public_rsa_by_server[NUM_SITES+1][NUMBER_OF_SERVERS + 1];
 RSA *public_rsa_by_client[NUM_SITES+1][NUMBER_OF_CLIENTS + 1];
+pthread_mutex_t public_rsa_lock = PTHREAD_MUTEX_INITIALIZER;
+int32u public_rsa_from_keyring; /* Else every key was read at start up */
 const EVP_MD *message_digest;
 void *pt;
 
@@ -186,6 +193,7 @@ void OPENSSL_RSA_Generate_Keys() {
 	    RSA_print_fp( stdout, rsa, 4 );
 	    Write_RSA( RSA_TYPE_PUBLIC, s, nsite, rsa ); 
 	    Write_RSA( RSA_TYPE_PRIVATE, s, nsite, rsa ); 
+	    KEYRING_Add( KEYRING_SERVER_RSA, nsite, s, rsa->n, rsa->e );
 	} 
 	/* Generate Keys For Clients */
  	for ( s = 1; s <= NUMBER_OF_CLIENTS; s++ ) {
@@ -193,37 +201,124 @@ void OPENSSL_RSA_Generate_Keys() {
 	    RSA_print_fp( stdout, rsa, 4 );
 	    Write_RSA( RSA_TYPE_CLIENT_PUBLIC, s, nsite, rsa ); 
 	    Write_RSA( RSA_TYPE_CLIENT_PRIVATE, s, nsite, rsa ); 
+	    KEYRING_Add( KEYRING_CLIENT_RSA, nsite, s, rsa->n, rsa->e );
 	} 
     }
 }
 
-/* Read all of the keys for servers or clients. All of the public keys
- * should be read and the private key for this server should be read. */
+/* OpenSSL builds the Montgomery contexts of a key the first time the key is
+ * used, and keeps them on the key. Building them before the key is shared
+ * saves the first signature or verification that cost and leaves the
+ * verification threads only reading the key. */
+void Precompute_RSA( RSA *rsa, int32u rsa_type ) {
+
+    BN_CTX *ctx;
+
+    ctx = BN_CTX_new();
+    if ( ctx == NULL ) {
+	return;
+    }
+
+    rsa->flags |= RSA_FLAG_CACHE_PUBLIC;
+    BN_MONT_CTX_set_locked( &rsa->_method_mod_n, CRYPTO_LOCK_RSA,
+	    rsa->n, ctx );
+
+    if ( ( rsa_type == RSA_TYPE_PRIVATE || 
+	   rsa_type == RSA_TYPE_CLIENT_PRIVATE ) &&
+	 rsa->p != NULL && rsa->q != NULL ) {
+	rsa->flags |= RSA_FLAG_CACHE_PRIVATE;
+	BN_MONT_CTX_set_locked( &rsa->_method_mod_p, CRYPTO_LOCK_RSA,
+		rsa->p, ctx );
+	BN_MONT_CTX_set_locked( &rsa->_method_mod_q, CRYPTO_LOCK_RSA,
+		rsa->q, ctx );
+    }
+
+    BN_CTX_free( ctx );
+}
+
+/* Return the public key of a server or client, decoding it from the keyring
+ * (or, without one, reading its key file) the first time. Returns NULL if
+ * there is no such server or client. */
+RSA* Public_RSA( int32u number, int32u site, int32u type ) {
+
+    RSA **slot;
+    RSA *rsa;
+    int32u rt;
+
+    if ( site < 1 || site > NUM_SITES ) {
+	return NULL;
+    }
+
+    if ( type == RSA_CLIENT ) {
+	if ( number < 1 || number > NUMBER_OF_CLIENTS ) {
+	    return NULL;
+	}
+	slot = &public_rsa_by_client[site][number];
+	rt = RSA_TYPE_CLIENT_PUBLIC;
+    } else {
+	if ( number < 1 || number > NUMBER_OF_SERVERS ) {
+	    return NULL;
+	}
+	slot = &public_rsa_by_server[site][number];
+	rt = RSA_TYPE_PUBLIC;
+    }
+
+    rsa = __atomic_load_n( slot, __ATOMIC_ACQUIRE );
+    if ( rsa != NULL ) {
+	return rsa;
+    }
+
+    pthread_mutex_lock( &public_rsa_lock );
+    rsa = *slot;
+    if ( rsa == NULL ) {
+	rsa = RSA_new();
+	if ( rsa == NULL ) {
+	    Alarm(PRINT,"Public_RSA: Could not allocate the key of %d %d.\n",
+		    site, number );
+	} else if ( public_rsa_from_keyring ) {
+	    rsa->n = BN_new();
+	    rsa->e = BN_new();
+	    if ( rsa->n == NULL || rsa->e == NULL ||
+		 !KEYRING_Lookup( type == RSA_CLIENT ? KEYRING_CLIENT_RSA : 
+		     KEYRING_SERVER_RSA, site, number, rsa->n, rsa->e ) ) {
+		Alarm(PRINT,"Public_RSA: Could not decode the key of %d %d.\n",
+			site, number );
+		RSA_free( rsa );
+		rsa = NULL;
+	    }
+	} else {
+	    /* Only at start up: see OPENSSL_RSA_Read_Keys */
+	    Read_RSA( rt, number, site, rsa );
+	}
+	if ( rsa != NULL ) {
+	    Precompute_RSA( rsa, rt );
+	    __atomic_store_n( slot, rsa, __ATOMIC_RELEASE );
+	}
+    }
+    pthread_mutex_unlock( &public_rsa_lock );
+
+    return rsa;
+}
+
+/* Read the private key of this server or client. Public keys are decoded
+ * from the keyring when they are first used. Without a usable keyring they
+ * are all read from their own files now, so that a missing file stops the
+ * program before it starts rather than in a verification thread. */
  void OPENSSL_RSA_Read_Keys(  int32u my_number, int32u my_site,  int32u type )
 {
 
-    int32u s; 
-    int32u rt;
-    int32u nsite;
-    
-    for ( nsite = 1; nsite <= NUM_SITES; nsite++ ) {    
-	/* Read all public keys for servers. */
-	for ( s = 1; s <= NUMBER_OF_SERVERS; s++ ) {
-	    public_rsa_by_server[nsite][s] = RSA_new();
-	    Read_RSA( RSA_TYPE_PUBLIC, s, nsite, public_rsa_by_server[nsite][s] );
-#if 0
-	    RSA_print_fp( stdout, public_rsa_by_server[nsite][s], 4 );
-#endif
-	} 
-	/* Read all public keys for clients. */
-	for ( s = 1; s <= NUMBER_OF_CLIENTS; s++ ) {
-	    public_rsa_by_client[nsite][s] = RSA_new();
-	    Read_RSA( RSA_TYPE_CLIENT_PUBLIC, s,
-		    nsite, public_rsa_by_client[nsite][s] );
-#if 0
-	    RSA_print_fp( stdout, public_rsa_by_server[nsite][s], 4 );
-#endif
-	} 
+    int32u rt, s, i;
+
+    public_rsa_from_keyring = KEYRING_Open();
+    if ( !public_rsa_from_keyring ) {
+	for ( s = 1; s <= NUM_SITES; s++ ) {
+	    for ( i = 1; i <= NUMBER_OF_SERVERS; i++ ) {
+		Public_RSA( i, s, RSA_SERVER );
+	    }
+	    for ( i = 1; i <= NUMBER_OF_CLIENTS; i++ ) {
+		Public_RSA( i, s, RSA_CLIENT );
+	    }
+	}
     }
     
     if ( type == RSA_SERVER ) {
@@ -238,6 +333,7 @@ void OPENSSL_RSA_Generate_Keys() {
     /* Read my private key. */
     private_rsa = RSA_new();
     Read_RSA( rt, my_number, my_site, private_rsa );
+    Precompute_RSA( private_rsa, rt );
 #if 0
     RSA_print_fp( stdout, private_rsa, 4 );
 #endif
@@ -355,16 +451,9 @@ int32u OPENSSL_RSA_Verify_Signature( const byte *digest_value, unsigned
     return 1;
 #endif
     
-    if ( type == RSA_CLIENT ) {
-	if (number < 1 || number > NUMBER_OF_CLIENTS ) {
-	    return 0;
-	}
-	rsa = public_rsa_by_client[site][number];
-    } else {
-	if (number < 1 || number > NUMBER_OF_SERVERS ) {
-	    return 0;
-	}
-        rsa = public_rsa_by_server[site][number];
+    rsa = Public_RSA( number, site, type );
+    if ( rsa == NULL ) {
+	return 0;
     }
     
     ret = RSA_verify(NID_sha1, digest_value, 20, signature, SIGNATURE_SIZE,
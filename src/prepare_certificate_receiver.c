@@ -61,7 +61,7 @@ typedef struct dummy_pcert_receiver_slot {
     byte update_digest[ DIGEST_SIZE ];
 } pcert_slot_struct;
 
-#define NUM_PCERT_SLOTS (NUM_SERVER_SLOTS)*(5+LOCAL_WINDOW)
+#define NUM_PCERT_SLOTS (NUM_SERVER_SLOTS)*(5+LOCAL_WINDOW_MAX)
 
 /* For each server, we keep the following structure which contains a holder for
  * the prepare certificates that this server must send. */
@@ -213,6 +213,7 @@ void REP_Update_Preinstall_Status() {
 	PENDING.Is_preinstalled = 1;
 	if ( pview > PENDING.View ) {
 	    PENDING.View = pview;
+	    UTIL_Refresh_Alarm_Prefix();
 	    Alarm(PRINT, "Local view jump: %d\n", 
 	          PENDING.View );
 	    /* Changed pending view, so we need to reset ccs prending context.
@@ -269,6 +270,7 @@ void REP_Suggest_New_Local_Representative() {
     CCS_Reset_Data_Structures( GLOBAL_CONTEXT );
     GLOBO_Reset_Global_Progress_Bookkeeping_For_Local_View_Change();
     ASEQ_Reset_For_Pending_View_Change(); 
+    UTIL_Refresh_Alarm_Prefix();
  
     Alarm(PRINT,"Suggest new local view: %d\n"
 	    , PENDING.View); 
@@ -0,0 +1,363 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* State machine output. The event loop appends to the current chunk, and
+ * hands it over when it fills or once the current pass of the event loop is
+ * done (through a zero timeout). Handed over chunks are kept on a list, which
+ * the writer thread empties with one writev per pass. Written chunks go back
+ * on a free list; when the free list is empty a new chunk is allocated, so the
+ * event loop never waits for the disk. The lock only covers the two lists.
+ *
+ * With STATE_MACHINE_SYNC_MSEC set, the writer syncs the file at most once
+ * per that many milliseconds, and no later than that after a write, so one
+ * fdatasync covers all of the updates written in the meantime. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "data_structs.h"
+#include "sm_output.h"
+#include "timeouts.h"
+#include "util/alarm.h"
+#include "util/sp_events.h"
+
+#define SMOUT_MAX_IOV  64    /* Chunks written per writev */
+
+typedef struct dummy_smout_chunk {
+    struct dummy_smout_chunk *next;
+    int32u len;
+    char data[STATE_MACHINE_CHUNK_SIZE];
+} smout_chunk;
+
+static int smout_fd = -1;
+static smout_chunk *smout_current;	    /* Event loop only */
+static int32u smout_submit_queued;	    /* Event loop only */
+static int32u smout_sync_queued;	    /* Event loop only */
+
+static pthread_mutex_t smout_lock;
+static pthread_cond_t smout_work_cond;	    /* Chunks were handed over */
+static pthread_cond_t smout_idle_cond;	    /* Writer caught up */
+static smout_chunk *smout_queue_head;
+static smout_chunk *smout_queue_tail;
+static smout_chunk *smout_free;
+static int32u smout_writing;
+static int32u smout_dirty;		    /* Written but not synced */
+static int64_t smout_last_sync;		    /* Msec, monotonic */
+
+#if !STATE_MACHINE_ASYNC
+static const sp_time smout_sync_delay = { STATE_MACHINE_SYNC_MSEC / 1000,
+    (STATE_MACHINE_SYNC_MSEC % 1000) * 1000 };
+#endif
+
+/* Local Functions */
+smout_chunk* SMOUT_Get_Chunk(void); 
+void SMOUT_Submit( int dummy, void *dummyp ); 
+void SMOUT_Write_Chunks( smout_chunk *list ); 
+void SMOUT_Sync_If_Due(void); 
+void SMOUT_Sync_Timeout( int dummy, void *dummyp ); 
+int64_t SMOUT_Now(void); 
+void* SMOUT_Writer_Thread( void *dummy ); 
+
+void SMOUT_Initialize( char *file_name ) {
+
+    pthread_condattr_t attr;
+#if STATE_MACHINE_ASYNC
+    pthread_t thread;
+#endif
+
+    smout_fd = open( file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if ( smout_fd < 0 ) {
+	Alarm(PRINT,"Failed to open state machine output file.\n");
+	return;
+    }
+
+    pthread_mutex_init( &smout_lock, NULL );
+    pthread_condattr_init( &attr );
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+    pthread_cond_init( &smout_work_cond, &attr );
+    pthread_cond_init( &smout_idle_cond, NULL );
+    pthread_condattr_destroy( &attr );
+    smout_last_sync = SMOUT_Now();
+
+    smout_current = SMOUT_Get_Chunk();
+
+#if STATE_MACHINE_ASYNC
+    if ( pthread_create( &thread, NULL, SMOUT_Writer_Thread, NULL ) ) {
+	Alarm(EXIT,"SMOUT_Initialize: Could not start thread.\n");
+    }
+    pthread_detach( thread );
+#endif
+
+    atexit( SMOUT_Flush );
+}
+
+/* Add data to the output. Called from the event loop. */
+void SMOUT_Append( char *data, int32u len ) {
+
+    int32u n;
+
+    if ( smout_fd < 0 ) {
+	return;
+    }
+
+    while ( len > 0 ) {
+	n = STATE_MACHINE_CHUNK_SIZE - smout_current->len;
+	if ( n > len ) {
+	    n = len;
+	}
+	memcpy( smout_current->data + smout_current->len, data, n );
+	smout_current->len += n;
+	data += n;
+	len -= n;
+
+	if ( smout_current->len == STATE_MACHINE_CHUNK_SIZE ) {
+	    SMOUT_Submit( 0, NULL );
+	}
+    }
+
+    if ( smout_current->len > 0 && !smout_submit_queued ) {
+	smout_submit_queued = 1;
+	E_queue( SMOUT_Submit, 0, NULL, timeout_zero );
+    }
+}
+
+/* Write out everything appended so far, and sync it if syncing is on. Waits
+ * for the writer thread. Called at exit. */
+void SMOUT_Flush() {
+
+    if ( smout_fd < 0 ) {
+	return;
+    }
+
+    SMOUT_Submit( 0, NULL );
+
+#if STATE_MACHINE_ASYNC
+    pthread_mutex_lock( &smout_lock );
+    while ( smout_queue_head != NULL || smout_writing ) {
+	pthread_cond_wait( &smout_idle_cond, &smout_lock );
+    }
+    pthread_mutex_unlock( &smout_lock );
+#endif
+
+    if ( STATE_MACHINE_SYNC_MSEC != 0 && fdatasync( smout_fd ) < 0 ) {
+	Alarm(PRINT,"SMOUT_Flush: fdatasync failed, errno %d.\n", errno);
+    }
+}
+
+smout_chunk* SMOUT_Get_Chunk() {
+
+    smout_chunk *chunk;
+
+    pthread_mutex_lock( &smout_lock );
+    chunk = smout_free;
+    if ( chunk != NULL ) {
+	smout_free = chunk->next;
+    }
+    pthread_mutex_unlock( &smout_lock );
+
+    if ( chunk == NULL ) {
+	chunk = (smout_chunk*)malloc( sizeof(smout_chunk) );
+	if ( chunk == NULL ) {
+	    Alarm(EXIT,"SMOUT_Get_Chunk: Could not allocate chunk.\n");
+	}
+    }
+    chunk->next = NULL;
+    chunk->len = 0;
+
+    return chunk;
+}
+
+/* Hand the current chunk over to be written. */
+void SMOUT_Submit( int dummy, void *dummyp ) {
+
+    smout_chunk *chunk;
+
+    smout_submit_queued = 0;
+    chunk = smout_current;
+    if ( chunk->len == 0 ) {
+	return;
+    }
+
+#if STATE_MACHINE_ASYNC
+    smout_current = SMOUT_Get_Chunk();
+
+    pthread_mutex_lock( &smout_lock );
+    if ( smout_queue_tail == NULL ) {
+	smout_queue_head = chunk;
+    } else {
+	smout_queue_tail->next = chunk;
+    }
+    smout_queue_tail = chunk;
+    pthread_cond_signal( &smout_work_cond );
+    pthread_mutex_unlock( &smout_lock );
+#else
+    SMOUT_Write_Chunks( chunk );
+    chunk->len = 0;
+    if ( STATE_MACHINE_SYNC_MSEC != 0 && !smout_sync_queued ) {
+	smout_sync_queued = 1;
+	E_queue( SMOUT_Sync_Timeout, 0, NULL, smout_sync_delay );
+    }
+#endif
+}
+
+/* Write a list of chunks, in order, with as few writev calls as possible. */
+void SMOUT_Write_Chunks( smout_chunk *list ) {
+
+    struct iovec iov[SMOUT_MAX_IOV];
+    int32u count, i;
+    ssize_t ret;
+
+    if ( list != NULL ) {
+	smout_dirty = 1;
+    }
+
+    while ( list != NULL ) {
+	for ( count = 0; list != NULL && count < SMOUT_MAX_IOV; count++ ) {
+	    iov[count].iov_base = list->data;
+	    iov[count].iov_len = list->len;
+	    list = list->next;
+	}
+
+	i = 0;
+	while ( i < count ) {
+	    ret = writev( smout_fd, &iov[i], count - i );
+	    if ( ret < 0 ) {
+		if ( errno == EINTR ) {
+		    continue;
+		}
+		Alarm(PRINT,"SMOUT_Write_Chunks: write failed, errno %d.\n",
+			errno);
+		return;
+	    }
+	    /* Skip what was written, which may end inside an iovec */
+	    while ( i < count && (size_t)ret >= iov[i].iov_len ) {
+		ret -= iov[i].iov_len;
+		i++;
+	    }
+	    if ( i < count ) {
+		iov[i].iov_base = (char*)iov[i].iov_base + ret;
+		iov[i].iov_len -= ret;
+	    }
+	}
+    }
+}
+
+/* Sync the file if something was written and a sync is due. Called by the
+ * writer thread. */
+void SMOUT_Sync_If_Due() {
+
+    int64_t now;
+
+    if ( STATE_MACHINE_SYNC_MSEC == 0 || !smout_dirty ) {
+	return;
+    }
+
+    now = SMOUT_Now();
+    if ( now - smout_last_sync < STATE_MACHINE_SYNC_MSEC ) {
+	return;
+    }
+
+    if ( fdatasync( smout_fd ) < 0 ) {
+	Alarm(PRINT,"SMOUT_Sync_If_Due: fdatasync failed, errno %d.\n", errno);
+    }
+    smout_dirty = 0;
+    smout_last_sync = now;
+}
+
+/* Without the writer thread, the event loop syncs the file
+ * STATE_MACHINE_SYNC_MSEC after the first write that followed the last
+ * sync. */
+void SMOUT_Sync_Timeout( int dummy, void *dummyp ) {
+
+    smout_sync_queued = 0;
+    if ( fdatasync( smout_fd ) < 0 ) {
+	Alarm(PRINT,"SMOUT_Sync_Timeout: fdatasync failed, errno %d.\n",
+		errno);
+    }
+}
+
+int64_t SMOUT_Now() {
+
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void* SMOUT_Writer_Thread( void *dummy ) {
+
+    smout_chunk *list, *last;
+    struct timespec deadline;
+    int64_t due;
+
+    pthread_mutex_lock( &smout_lock );
+    for (;;) {
+	while ( smout_queue_head == NULL ) {
+	    if ( STATE_MACHINE_SYNC_MSEC != 0 && smout_dirty ) {
+		/* Wake up in time for the pending sync */
+		due = smout_last_sync + STATE_MACHINE_SYNC_MSEC;
+		if ( SMOUT_Now() >= due ) {
+		    break;
+		}
+		deadline.tv_sec = due / 1000;
+		deadline.tv_nsec = (due % 1000) * 1000000;
+		pthread_cond_timedwait( &smout_work_cond, &smout_lock,
+			&deadline );
+	    } else {
+		pthread_cond_wait( &smout_work_cond, &smout_lock );
+	    }
+	}
+
+	list = smout_queue_head;
+	smout_queue_head = NULL;
+	smout_queue_tail = NULL;
+	smout_writing = 1;
+	pthread_mutex_unlock( &smout_lock );
+
+	SMOUT_Write_Chunks( list );
+	SMOUT_Sync_If_Due();
+
+	pthread_mutex_lock( &smout_lock );
+	if ( list != NULL ) {
+	    for ( last = list; last->next != NULL; last = last->next ) {
+		last->len = 0;
+	    }
+	    last->len = 0;
+	    last->next = smout_free;
+	    smout_free = list;
+	}
+	smout_writing = 0;
+	pthread_cond_broadcast( &smout_idle_cond );
+    }
+
+    return NULL;
+}
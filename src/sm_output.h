@@ -0,0 +1,46 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* State machine output. The ordered stream of updates is gathered into large
+ * chunks, which are written to the output file with writev, either by a
+ * writer thread of their own (STATE_MACHINE_ASYNC) or from the event loop.
+ * The file can also be synced in groups (STATE_MACHINE_SYNC_MSEC). */
+
+#ifndef SMOUT_R6TB2QW9XH4LKC8ZN3VF
+#define SMOUT_R6TB2QW9XH4LKC8ZN3VF 1
+
+#include "util/arch.h"
+
+/* Public functions */
+
+void SMOUT_Initialize( char *file_name ); 
+
+void SMOUT_Append( char *data, int32u len ); 
+
+void SMOUT_Flush(void); 
+
+#endif
@@ -48,6 +48,9 @@
 #include "error_wrapper.h"
 #include "global_reconciliation.h"
 #include "meta_globally_order.h"
+#include "checkpoint.h"
+#include "window.h"
+#include "auth.h"
 
 #ifdef	ARCH_PC_WIN95
 #include	<winsock.h>
@@ -61,6 +64,10 @@ extern network_variables NET;
 static void 	Usage(int argc, char *argv[]);
 static void     Init_Memory_Objects(void);
 
+/* Windows fixed on the command line, 0 if adaptive */
+static int32u   Fixed_local_window;
+static int32u   Fixed_global_window;
+
 /***********************************************************/
 /* int main(int argc, char* argv[])                        */
 /*                                                         */
@@ -116,6 +123,9 @@ int main(int argc, char* argv[])
 
     OPENSSL_RSA_Init();
     OPENSSL_RSA_Read_Keys( VAR.My_Server_ID, VAR.My_Site_ID, RSA_SERVER ); 
+#if LOCAL_AUTH_MACS
+    AUTH_Read_Keys( VAR.My_Server_ID, VAR.My_Site_ID );
+#endif
 
     TC_Read_Partial_Key( VAR.My_Server_ID, VAR.My_Site_ID );
     TC_Read_Public_Key();
@@ -131,12 +141,15 @@ int main(int argc, char* argv[])
     GVC_Initialize();
 
     CCS_Initialize();
+    UTIL_Refresh_Alarm_Prefix();
    
     GVC_Suggest_New_Global_View(); 
     REP_Suggest_New_Local_Representative(); 
     
     GLOBO_Initialize(); 
     GRECON_Init();
+    CKPT_Initialize();
+    WIN_Initialize( Fixed_local_window, Fixed_global_window );
 
     fflush(0);
 
@@ -178,6 +191,7 @@ static void Init_Memory_Objects(void)
 {
     /* initilize memory object types  */
     Mem_init_object_abort(PACK_BODY_OBJ, sizeof(packet), 100, 1);
+    Mem_init_slab(PACK_BODY_OBJ, 64);
     Mem_init_object_abort(SYS_SCATTER, sizeof(sys_scatter), 100, 1);
 }
 
@@ -270,18 +284,36 @@ static  void    Usage(int argc, char *argv[])
 		      NUM_SITES);
 	    }
 	    argc--; argv++;
+	}else if((argc > 1)&&(!strncmp(*argv, "-w", 2))) {
+	    sscanf(argv[1], "%d", &tmp);
+	    if(tmp < 1 || tmp > LOCAL_WINDOW_MAX) {
+		Alarm(EXIT, "The local window must be between 1 and %d\n",
+		      LOCAL_WINDOW_MAX);
+	    }
+	    Fixed_local_window = tmp;
+	    argc--; argv++;
+	}else if((argc > 1)&&(!strncmp(*argv, "-g", 2))) {
+	    sscanf(argv[1], "%d", &tmp);
+	    if(tmp < 1 || tmp > GLOBAL_WINDOW_MAX) {
+		Alarm(EXIT, "The global window must be between 1 and %d\n",
+		      GLOBAL_WINDOW_MAX);
+	    }
+	    Fixed_global_window = tmp;
+	    argc--; argv++;
 	}else{
 
 	    /* Commented out command line args that will be used in the release
 	     * version. */
 		Alarm(PRINT, "ERR: %d | %s\n", argc, *argv);	
-		Alarm(PRINT, "Usage: \n%s\n%s\n%s\n%s\n%s\n%s\n",
+		Alarm(PRINT, "Usage: \n%s\n%s\n%s\n%s\n",
 		      /*"\t[-l <IP address>   ] : local address,",*/
 		      /*"\t[-p <port number>  ] : local port, default is 7100,",*/
 		      /*"\t[-m <mcast address>] : multicast address,",*/
 		      /*"\t[-f <faults>       ] : number of faults, default is 1,",*/
-		      "\t[-i <local ID>     ] : local ID, indexed base 1, default is 1"
-		      "\t[-s <site  ID>     ] : site  ID, indexed base 1, default is 1"
+		      "\t[-i <local ID>     ] : local ID, indexed base 1, default is 1",
+		      "\t[-s <site  ID>     ] : site  ID, indexed base 1, default is 1",
+		      "\t[-w <local window> ] : fix the local window, default is adaptive",
+		      "\t[-g <global window>] : fix the global window, default is adaptive"
 		);
 		Alarm(EXIT, "Bye...\n");
 	}
@@ -25,9 +25,12 @@
  *
  */
 
+#include <string.h>
+#include <pthread.h>
 #include "../OpenTC-1.1/TC-lib-1.0/TC.h" 
 #include "util/arch.h"
 #include "openssl_rsa.h"
+#include "keyring.h"
 #include "data_structs.h"
 #include "util/arch.h"
 #include "util/alarm.h"
@@ -39,9 +42,51 @@ extern server_variables VAR;
 
 #define TIME_GENERATE_SIG_SHARE 0
 
+/* A proof of a signature share is stored as c (the hash, left padded to
+ * TC_PROOF_C_SIZE bytes) followed by z (left padded to the rest of the
+ * SIG_SHARE_PROOF_SIZE bytes). */
+#define TC_PROOF_C_SIZE   20
+#define TC_PROOF_Z_SIZE   (SIG_SHARE_PROOF_SIZE - TC_PROOF_C_SIZE)
+
+#define TC_PROOF_L1       128  /* Bit length of the randomness of a proof
+				  beyond the modulus */
+
+/* The key material below is read and precomputed once at start up and only
+ * read afterwards, including the per key caches OpenTC keeps (Montgomery
+ * contexts, powers of v). Share generation, combination, and verification
+ * keep all of their intermediate values in the BN_CTX OpenTC keeps for the
+ * calling thread, so they may run on several threads at once. */
+
 TC_IND *tc_partial_key; /* My Partial Key */
-TC_PK *tc_public_key[NUM_SITES+1];   /* Public Key of Site */
-TC_IND_SIG **tc_partial_signatures; /* A list of Partial Signatures */
+
+/* Public keys of the sites, decoded and precomputed the first time each is
+ * needed (see TC_Public_Key). */
+TC_PK *tc_public_key[NUM_SITES+1];
+pthread_mutex_t tc_public_key_lock = PTHREAD_MUTEX_INITIALIZER;
+
+BIGNUM *tc_share_exponent;  /* 2*si mod n: the exponent of my shares */
+BIGNUM *tc_u_to_e;          /* u^e mod n: jacobi correction of a digest */
+BIGNUM *tc_euclid_p;        /* p and q satisfy 4p + eq = 1 */
+BIGNUM *tc_euclid_q;
+BIGNUM *tc_u_exp;           /* e*q - 1: exponent of u in a corrected result */
+BN_MONT_CTX *tc_mont_n;     /* Montgomery context of my site's modulus,
+			       owned by tc_partial_key */
+
+/* Lagrange coefficients at 0, scaled by 2*delta*p, for every subset of k
+ * servers. The subset is a bit mask of server numbers (bit 0 is server 1);
+ * entry j of a subset is the exponent for the share of server j+1. */
+BIGNUM **tc_lagrange[1 << NUM_SERVERS_IN_SITE];
+
+int jacobi(BIGNUM* p, BIGNUM* q); /* OpenTC */
+
+/* Local functions */
+BN_CTX* TC_Thread_Ctx(); 
+void TC_Precompute_Combine_Constants(); 
+void TC_Precompute_Lagrange( int32u mask ); 
+void TC_Store_Padded( BIGNUM *bn, byte *dest, int32u size ); 
+TC_PK* TC_Public_Key( int32u site ); 
+void TC_Make_Share_Proof( BIGNUM *x, BIGNUM *sig, byte *proof, 
+	BN_CTX *ctx ); 
 
 void assert(int ret, int expect, char *s) {
   if (ret != expect) {
@@ -61,6 +106,33 @@ void assert_except(int ret, int except, char *s) {
   }
 }
 
+/* Returns the BN_CTX of the calling thread, which it shares with OpenTC. */
+BN_CTX* TC_Thread_Ctx() {
+
+    BN_CTX *ctx;
+
+    ctx = TC_Thread_BN_CTX();
+    if ( ctx == NULL ) {
+	Alarm(EXIT,"TC_Thread_Ctx: Could not allocate BN_CTX.\n");
+    }
+    return ctx;
+}
+
+/* Store bn in size bytes, big endian, padded with leading zeroes */
+void TC_Store_Padded( BIGNUM *bn, byte *dest, int32u size ) {
+
+    int32u length;
+
+    length = BN_num_bytes( bn );
+    if ( length > size ) {
+	Alarm(EXIT,"TC_Store_Padded: %d bytes do not fit in %d.\n",
+		length, size );
+    }
+
+    memset( dest, 0, size - length );
+    BN_bn2bin( bn, dest + (size - length) );
+}
+
 void TC_Read_Partial_Key( int32u server_no, int32u site_id ) {
 
     char buf[100];
@@ -68,73 +140,238 @@ void TC_Read_Partial_Key( int32u server_no, int32u site_id ) {
  
     sprintf(buf, "%s/share%d_%d.pem", dir, server_no - 1, site_id );
     tc_partial_key = (TC_IND *)TC_read_share(buf);
- 
+
+    /* Before any thread can use the key */
+    if ( !TC_IND_Precompute( tc_partial_key ) ) {
+	Alarm(EXIT,"TC_Read_Partial_Key: Precomputation failed.\n");
+    }
+
+    TC_Precompute_Combine_Constants();
 }
 
+/* The public keys are decoded from the keyring when they are first used.
+ * Without a usable keyring they are all read now, so that a missing file
+ * stops the program at start up. */
 void TC_Read_Public_Key() {
 
-    int32u nsite;
-    
+    int32u s;
+
+    if ( !KEYRING_Open() ) {
+	for ( s = 1; s <= NUM_SITES; s++ ) {
+	    TC_Public_Key( s );
+	}
+    }
+}
+
+/* Returns the public key of a site, reading it the first time. Verification
+ * threads may get here, so a key is published only once it is precomputed. */
+TC_PK* TC_Public_Key( int32u site ) {
+
+    TC_PK *pk;
+    BIGNUM *n, *e;
     char buf[100];
     char dir[100] = "./keys";
 
-    for ( nsite = 1; nsite <= NUM_SITES; nsite++ ) {
-	sprintf(buf,"%s/pubkey_%d.pem", dir, nsite);
-	tc_public_key[nsite] = (TC_PK *)TC_read_public_key(buf);
+    pk = __atomic_load_n( &tc_public_key[site], __ATOMIC_ACQUIRE );
+    if ( pk != NULL ) {
+	return pk;
     }
+
+    pthread_mutex_lock( &tc_public_key_lock );
+    pk = tc_public_key[site];
+    if ( pk == NULL ) {
+	n = BN_new();
+	e = BN_new();
+	if ( n == NULL || e == NULL ) {
+	    pk = NULL;
+	} else if ( KEYRING_Lookup( KEYRING_SITE_TC, site, 0, n, e ) ) {
+	    pk = TC_PK_new( e, n );
+	} else {
+	    sprintf(buf,"%s/pubkey_%d.pem", dir, site);
+	    pk = (TC_PK *)TC_read_public_key(buf);
+	}
+	BN_free( n );
+	BN_free( e );
+	if ( pk == NULL || !TC_PK_Precompute( pk ) ) {
+	    Alarm(EXIT,"TC_Public_Key: Could not read the key of site %d.\n",
+		    site );
+	}
+	__atomic_store_n( &tc_public_key[site], pk, __ATOMIC_RELEASE );
+    }
+    pthread_mutex_unlock( &tc_public_key_lock );
+
+    return pk;
 }
 
-int32u TC_Generate_Sig_Share( byte* destination, byte* hash  ) { 
+/* Compute everything that share generation and combination would otherwise
+ * recompute for every message: the share exponent, the jacobi corrections,
+ * the extended Euclid coefficients of (4, e), the Montgomery context of n,
+ * and the Lagrange coefficients of every subset of k servers. */
+void TC_Precompute_Combine_Constants() {
+
+    BN_CTX *ctx;
+    BIGNUM *a, *b, *quot, *rem, *r, *s, *t;
+    int32u mask, bits, m;
+
+    ctx = TC_Thread_Ctx();
+
+    tc_share_exponent = BN_new();
+    tc_u_to_e = BN_new();
+    tc_euclid_p = BN_new();
+    tc_euclid_q = BN_new();
+    tc_u_exp = BN_new();
+    tc_mont_n = TC_IND_Mont( tc_partial_key, ctx );
+
+    BN_set_word( tc_share_exponent, 2 );
+    BN_mod_mul( tc_share_exponent, tc_share_exponent, tc_partial_key->si,
+	    tc_partial_key->n, ctx );
+    BN_mod_exp_mont( tc_u_to_e, tc_partial_key->u, tc_partial_key->e, 
+	    tc_partial_key->n, ctx, tc_mont_n );
+
+    /* Extended Euclid on (4, e), as in TC_Combine_Sigs */
+    BN_CTX_start( ctx );
+    a = BN_CTX_get( ctx );
+    b = BN_CTX_get( ctx );
+    quot = BN_CTX_get( ctx );
+    rem = BN_CTX_get( ctx );
+    r = BN_CTX_get( ctx );
+    s = BN_CTX_get( ctx );
+    t = BN_CTX_get( ctx );
+
+    BN_set_word( a, 4 );
+    BN_copy( b, tc_partial_key->e );
+    BN_one( tc_euclid_p );
+    BN_zero( tc_euclid_q );
+    BN_zero( r );
+    BN_one( s );
+
+    while ( !BN_is_zero( b ) ) {
+	BN_div( quot, rem, a, b, ctx );
+	BN_copy( a, b );
+	BN_copy( b, rem );
+
+	BN_mul( t, quot, r, ctx );
+	BN_sub( t, tc_euclid_p, t );
+	BN_copy( tc_euclid_p, r );
+	BN_copy( r, t );
+
+	BN_mul( t, quot, s, ctx );
+	BN_sub( t, tc_euclid_q, t );
+	BN_copy( tc_euclid_q, s );
+	BN_copy( s, t );
+    }
+    BN_CTX_end( ctx );
+
+    BN_mul( tc_u_exp, tc_partial_key->e, tc_euclid_q, ctx );
+    BN_sub_word( tc_u_exp, 1 );
+
+    /* Lagrange coefficients for each subset of exactly k servers */
+    for ( mask = 0; mask < (1 << NUM_SERVERS_IN_SITE); mask++ ) {
+	bits = 0;
+	for ( m = mask; m != 0; m >>= 1 ) {
+	    bits += m & 1;
+	}
+	if ( bits == tc_partial_key->k ) {
+	    TC_Precompute_Lagrange( mask );
+	}
+    }
+}
 
-    /* Generate a signature share without the proof. */
+/* 2 * delta * p * prod_{s != j} (0 - s) / (j - s) for each server j in
+ * mask, where delta = l!. The division is exact, and p is folded in because
+ * the combined shares are only ever used raised to p. */
+void TC_Precompute_Lagrange( int32u mask ) {
+
+    BN_CTX *ctx;
+    BIGNUM *delta, *term;
+    BIGNUM **coef;
+    int32u j, s;
+
+    ctx = TC_Thread_Ctx();
+
+    coef = (BIGNUM**)malloc( NUM_SERVERS_IN_SITE * sizeof(BIGNUM*) );
+    if ( coef == NULL ) {
+	Alarm(EXIT,"TC_Precompute_Lagrange: Could not allocate memory.\n");
+    }
+
+    BN_CTX_start( ctx );
+    delta = BN_CTX_get( ctx );
+    term = BN_CTX_get( ctx );
+
+    BN_one( delta );
+    for ( j = 2; j <= tc_partial_key->l; j++ ) {
+	BN_mul_word( delta, j );
+    }
+
+    for ( j = 1; j <= NUM_SERVERS_IN_SITE; j++ ) {
+	coef[j - 1] = NULL;
+	if ( !(mask & (1 << (j - 1))) ) {
+	    continue;
+	}
+	coef[j - 1] = BN_new();
+	BN_copy( coef[j - 1], delta );
+	for ( s = 1; s <= NUM_SERVERS_IN_SITE; s++ ) {
+	    if ( s != j && (mask & (1 << (s - 1))) ) {
+		BN_set_word( term, s );
+		BN_set_negative( term, 1 );
+		BN_mul( coef[j - 1], coef[j - 1], term, ctx );
+	    }
+	}
+	for ( s = 1; s <= NUM_SERVERS_IN_SITE; s++ ) {
+	    if ( s != j && (mask & (1 << (s - 1))) ) {
+		BN_set_word( term, (j > s) ? j - s : s - j );
+		BN_set_negative( term, j < s );
+		BN_div( coef[j - 1], NULL, coef[j - 1], term, ctx );
+	    }
+	}
+	BN_lshift1( coef[j - 1], coef[j - 1] );
+	BN_mul( coef[j - 1], coef[j - 1], tc_euclid_p, ctx );
+    }
+    BN_CTX_end( ctx );
+
+    tc_lagrange[mask] = coef;
+}
+
+int32u TC_Generate_Sig_Share( byte* destination, byte *proof, byte* hash ) { 
+
+    /* Generate a signature share, x^(2*si) mod n, where x is the digest,
+     * corrected by u^e when its jacobi symbol is -1, and the proof that the
+     * share is correct. This is genIndSig, using the precomputed
+     * constants. */
     
-    TC_IND_SIG *signature;
+    BN_CTX *ctx;
+    BIGNUM *x, *sig;
     int32u length;
-    BIGNUM *hash_bn;
-    int32u ret;
-    /*BIGNUM *bn;*/
-    int32u pad;
  #if TIME_GENERATE_SIG_SHARE
     sp_time start, end, diff;
 
     start = E_get_time();
 #endif
 
-    hash_bn = BN_bin2bn( hash, DIGEST_SIZE, NULL );
+    ctx = TC_Thread_Ctx();
+    BN_CTX_start( ctx );
+    x = BN_CTX_get( ctx );
+    sig = BN_CTX_get( ctx );
 
-    signature = TC_IND_SIG_new();
-    ret = genIndSig( tc_partial_key, hash_bn, signature, 0);
-    //assert(ret, TC_NOERROR, "genIndSig");
+    BN_bin2bn( hash, DIGEST_SIZE, x );
 
-  
-    BN_free( hash_bn );
-    
-    /* Made the signature share. Now take the bn sig and store it in the
-     * destination in OPENSSL mpi format. */
+    if ( jacobi( x, tc_partial_key->n ) == -1 ) {
+	BN_mod_mul( x, x, tc_u_to_e, tc_partial_key->n, ctx );
+    }
 
-    //length = BN_bn2bin( signature->sig, (destination + 4) );
+    BN_mod_exp_mont( sig, x, tc_share_exponent, tc_partial_key->n, ctx,
+	    tc_mont_n );
 
-    //*((int32u*)destination) = length;
-    
-    //bn = BN_bin2bn( destination + 4, *((int32u*)destination), NULL );
+    TC_Make_Share_Proof( x, sig, proof, ctx );
 
-    length = BN_num_bytes( signature->sig );
-	
-    BN_bn2bin( signature->sig, destination + (128 - length) );
+    /* Made the signature share. Now store it in the destination as a
+     * 128 byte big endian number, padded with leading zeroes. */
+    length = BN_num_bytes( sig );
 
-    /* The length should be around 128 bytes if it is not 128 then we need to
-     * pad with zeroes */
-    for ( pad = 0; pad < (128 - length); pad++ ) {
-	destination[pad] = 0;
-    }
-      
-#if 0
-    printf("Sig Share: %s\n", BN_bn2hex( signature->sig ));
-    printf("Sig Share Read Back: %s\n", BN_bn2hex( bn ));
-#endif
+    TC_Store_Padded( sig, destination, 128 );
 
-    TC_IND_SIG_free( signature );
-    
+    BN_CTX_end( ctx );
+      
 #if TIME_GENERATE_SIG_SHARE
     end = E_get_time();
 
@@ -146,108 +383,205 @@ int32u TC_Generate_Sig_Share( byte* destination, byte* hash  ) {
 
 }
 
-void TC_Initialize_Combine_Phase( int32u number ) {
-
-    tc_partial_signatures = TC_SIG_Array_new( number );
-
+/* Make the proof that sig = x^(2*si) for the corrected digest x, as in
+ * genIndSig: pick a random r of L(n) + 2*L1 bits, and set
+ *   c = H'(v, x^4, vi, sig^2, v^r, x^(4r)),  z = si*c + r. */
+void TC_Make_Share_Proof( BIGNUM *x, BIGNUM *sig, byte *proof, 
+	BN_CTX *ctx ) {
+
+    BIGNUM *r, *xt, *xi_sq, *vp, *xp, *c, *z;
+    BIGNUM *n;
+    EVP_MD_CTX md_ctx;
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len;
+
+    n = tc_partial_key->n;
+
+    BN_CTX_start( ctx );
+    r = BN_CTX_get( ctx );
+    xt = BN_CTX_get( ctx );
+    xi_sq = BN_CTX_get( ctx );
+    vp = BN_CTX_get( ctx );
+    xp = BN_CTX_get( ctx );
+    c = BN_CTX_get( ctx );
+    z = BN_CTX_get( ctx );
+
+    BN_rand( r, BN_num_bits( n ) + 2 * TC_PROOF_L1, -1, 0 );
+
+    BN_mod_sqr( xt, x, n, ctx );
+    BN_mod_sqr( xt, xt, n, ctx );
+    BN_mod_sqr( xi_sq, sig, n, ctx );
+    TC_Exp_v( vp, r, tc_partial_key, ctx );
+    BN_mod_exp_mont( xp, xt, r, n, ctx, tc_mont_n );
+
+    /* TC_Check_Proof hashes the BIGNUM words, so we must do the same */
+    EVP_MD_CTX_init( &md_ctx );
+    EVP_DigestInit_ex( &md_ctx, tc_partial_key->Hp, NULL );
+    EVP_DigestUpdate( &md_ctx, tc_partial_key->v->d, 
+	    tc_partial_key->v->top * sizeof(BN_ULONG) );
+    EVP_DigestUpdate( &md_ctx, xt->d, xt->top * sizeof(BN_ULONG) );
+    EVP_DigestUpdate( &md_ctx, 
+	    tc_partial_key->vki[tc_partial_key->mynum]->d,
+	    tc_partial_key->vki[tc_partial_key->mynum]->top * sizeof(BN_ULONG) );
+    EVP_DigestUpdate( &md_ctx, xi_sq->d, xi_sq->top * sizeof(BN_ULONG) );
+    EVP_DigestUpdate( &md_ctx, vp->d, vp->top * sizeof(BN_ULONG) );
+    EVP_DigestUpdate( &md_ctx, xp->d, xp->top * sizeof(BN_ULONG) );
+    EVP_DigestFinal_ex( &md_ctx, md, &md_len );
+    EVP_MD_CTX_cleanup( &md_ctx );
+
+    BN_bin2bn( md, md_len, c );
+
+    BN_mul( z, tc_partial_key->si, c, ctx );
+    BN_add( z, z, r );
+
+    TC_Store_Padded( c, proof, TC_PROOF_C_SIZE );
+    TC_Store_Padded( z, proof + TC_PROOF_C_SIZE, TC_PROOF_Z_SIZE );
+
+    BN_CTX_end( ctx );
 }
 
-void TC_Add_Share_To_Be_Combined( int server_no, byte *share ) {
+/* Check the proof that share is the signature share of server server_no on
+ * digest. This is only needed when a combined signature does not verify.
+ * Returns 1 if the share is correct. */
+int32u TC_Verify_Share_Proof( int32u server_no, byte *share, byte *proof,
+	byte *digest ) {
 
-    /* Convert share to bignum. */
-
-    TC_IND_SIG *signature;
+    TC_IND_SIG ind_sig;
+    BIGNUM *hash_bn;
+    BN_CTX *ctx;
+    int32u ret;
 
-    signature = TC_IND_SIG_new();
+    if ( server_no == 0 || server_no > tc_partial_key->l ) {
+	return 0;
+    }
 
-    //BN_bin2bn( share + 4, *((int32u*)share), signature->sig );
+    /* The share is read into scratch BIGNUMs rather than a new TC_IND_SIG */
+    ctx = TC_Thread_Ctx();
+    BN_CTX_start( ctx );
+    hash_bn = BN_CTX_get( ctx );
+    ind_sig.sig = BN_CTX_get( ctx );
+    ind_sig.proof_c = BN_CTX_get( ctx );
+    ind_sig.proof_z = BN_CTX_get( ctx );
 
-    BN_bin2bn( share, 128, signature->sig );
+    BN_bin2bn( digest, DIGEST_SIZE, hash_bn );
+    BN_bin2bn( share, 128, ind_sig.sig );
+    BN_bin2bn( proof, TC_PROOF_C_SIZE, ind_sig.proof_c );
+    BN_bin2bn( proof + TC_PROOF_C_SIZE, TC_PROOF_Z_SIZE, ind_sig.proof_z );
 
-#if 0    
-    printf("ADD: %d; %s\n", server_no, BN_bn2hex( signature->sig ));
-#endif
+    ret = ( TC_Check_Proof( tc_partial_key, hash_bn, &ind_sig, 
+		server_no ) == 1 );
 
-    set_TC_SIG(server_no, signature, tc_partial_signatures );
+    BN_CTX_end( ctx );
 
+    return ret;
 }
 
-void TC_Destruct_Combine_Phase( int32u number ) {
-    
-    TC_SIG_Array_free( tc_partial_signatures, number );
-    
-}
-    
-void TC_Combine_Shares( byte *signature_dest, byte *digest ) {
+/* Combine the signature shares of my site into a threshold signature.
+ * shares[i] points to the 128 byte share of server i, or is NULL. As in
+ * TC_Combine_Sigs, the first k shares present are used. Returns 1 if the
+ * combined signature verifies under the site public key. */
+int32u TC_Combine_Shares( byte *signature_dest, byte *digest, byte **shares ) {
  
-    TC_SIG combined_signature;
-    BIGNUM *hash_bn;
+    BN_CTX *ctx;
+    BIGNUM *hash_bn, *w;
+    BIGNUM **coef;
+    BIGNUM *bases[NUM_SERVERS_IN_SITE + 2];
+    BIGNUM *exps[NUM_SERVERS_IN_SITE + 2];
+    BIGNUM *n;
+    int32u i, count, mask, length, pad;
     int32u ret;
-    int32u length;
-    BIGNUM *bn;
-    int32u pad;
-    
-    hash_bn = BN_bin2bn( digest, DIGEST_SIZE, NULL );
 
-    ret = TC_Combine_Sigs( tc_partial_signatures, tc_partial_key, 
-	    hash_bn, &combined_signature, 0);
+    ctx = TC_Thread_Ctx();
+    n = tc_partial_key->n;
 
-    /* There is a probable security error here. We need to make sure
-     * that we don't exit if there is an arithmetic error in the
-     * combining, and then enter the proof phase, during which we
-     * identify the malicious server that sent a message which caused
-     * the arithmetic error. This is related to the blacklisting code,
-     * which is not currently coded.*/
+    /* Choose the subset */
+    mask = 0;
+    count = 0;
+    for ( i = 1; i <= NUM_SERVERS_IN_SITE && count < tc_partial_key->k; i++ ) {
+	if ( shares[i] != NULL ) {
+	    mask |= 1 << (i - 1);
+	    count++;
+	}
+    }
+    if ( count < tc_partial_key->k ) {
+	return 0;
+    }
+    coef = tc_lagrange[mask];
+
+    /* The signature is
+     *   (prod share_j^(2*lambda_j))^p * x^q,  or that times u^-1 when the
+     * jacobi symbol of the digest is -1 and x is the digest times u^e. The
+     * powers of p are folded into the coefficients, so this is one product
+     * of powers of the shares, the digest, and u, computed together. */
+    BN_CTX_start( ctx );
+    hash_bn = BN_CTX_get( ctx );
+    w = BN_CTX_get( ctx );
+
+    count = 0;
+    for ( i = 1; i <= NUM_SERVERS_IN_SITE; i++ ) {
+	if ( mask & (1 << (i - 1)) ) {
+	    bases[count] = BN_CTX_get( ctx );
+	    BN_bin2bn( shares[i], 128, bases[count] );
+	    exps[count++] = coef[i - 1];
+	}
+    }
 
-    ret = TC_verify(hash_bn, combined_signature, 
-		    tc_public_key[VAR.My_Site_ID]);
+    BN_bin2bn( digest, DIGEST_SIZE, hash_bn );
+    bases[count] = hash_bn;
+    exps[count++] = tc_euclid_q;
+    if ( jacobi( hash_bn, n ) == -1 ) {
+	bases[count] = tc_partial_key->u;
+	exps[count++] = tc_u_exp;
+    }
 
-    length = BN_num_bytes( combined_signature );
+    /* Fails only on a bad share (one with no inverse), which the check
+     * below then catches */
+    if ( !TC_Multi_Exp( w, bases, exps, count, n, tc_mont_n, ctx ) ) {
+	BN_zero( w );
+    }
+
+    /* If this does not verify, the caller checks the share proofs to find
+     * the server that sent a bad share. */
+
+    ret = ( TC_verify(hash_bn, w, TC_Public_Key( VAR.My_Site_ID )) == 1 );
+
+    length = BN_num_bytes( w );
 	
-    BN_bn2bin( combined_signature, signature_dest + (128 - length) );
+    BN_bn2bin( w, signature_dest + (128 - length) );
 
     /* The length should be approx 128 bytes if it is not 128 then we need to
      * pad with zeroes */
     for ( pad = 0; pad < (128 - length); pad++ ) {
 	signature_dest[pad] = 0;
     }
-    
-    bn = BN_bin2bn( signature_dest, 128, NULL );
-
-#if 0 
-    if ( length < 128 ) {
-	printf("Combined Sig: %s\n", BN_bn2hex( combined_signature ));
-	printf("Read Back: %s\n", BN_bn2hex( bn ));
-	printf("Size: %d\n", length );
-	ret = TC_verify(hash_bn, bn, tc_public_key);
-	assert(ret, 1, "TC_verify");
-	exit(0);
-    }
-#endif
 
-    BN_free( combined_signature );
-    BN_free( bn );
-    BN_free( hash_bn );
+    BN_CTX_end( ctx );
 
+    return ret;
 }
 
 int32u TC_Verify_Signature( int32u site, byte *signature, byte *digest ) {
 
+    BN_CTX *ctx;
     BIGNUM *hash_bn;
     int32u ret;
     BIGNUM *sig_bn;
-    
-    hash_bn = BN_bin2bn( digest, DIGEST_SIZE, NULL );
-    sig_bn = BN_bin2bn( signature, SIGNATURE_SIZE, NULL );
 
     if ( site == 0 || site > NUM_SITES ) {
-	ret = 0;
-    } else {
-	ret = TC_verify(hash_bn, sig_bn, tc_public_key[site]);
+	return 0;
     }
 
-    BN_free( sig_bn );
-    BN_free( hash_bn );
+    ctx = TC_Thread_Ctx();
+    BN_CTX_start( ctx );
+    hash_bn = BN_CTX_get( ctx );
+    sig_bn = BN_CTX_get( ctx );
+    
+    BN_bin2bn( digest, DIGEST_SIZE, hash_bn );
+    BN_bin2bn( signature, SIGNATURE_SIZE, sig_bn );
+
+    ret = TC_verify(hash_bn, sig_bn, TC_Public_Key( site ));
+
+    BN_CTX_end( ctx );
 
     return ret;
 }
@@ -274,6 +608,7 @@ void TC_Generate()
 		dealer = TC_generate(keysize/2, n, k, 17);
 
 		TC_write_shares(dealer, "./keys", nsite);
+		KEYRING_Add( KEYRING_SITE_TC, nsite, 0, dealer->n, dealer->e );
 		TC_DEALER_free(dealer);
 	}
 
@@ -32,15 +32,12 @@ void TC_Read_Partial_Key( int32u server_no, int32u site_id );
 
 void TC_Read_Public_Key();
 
-int32u TC_Generate_Sig_Share( byte* destination, byte* hash  ); 
+int32u TC_Generate_Sig_Share( byte* destination, byte *proof, byte* hash ); 
 
-void TC_Initialize_Combine_Phase( int32u number );
+int32u TC_Combine_Shares( byte *signature_dest, byte *digest, byte **shares );
 
-void TC_Add_Share_To_Be_Combined( int server_no, byte *share );
-
-void TC_Destruct_Combine_Phase( int32u number );
-
-void TC_Combine_Shares( byte *signature_dest, byte *digest );
+int32u TC_Verify_Share_Proof( int32u server_no, byte *share, byte *proof,
+	byte *digest ); 
 
 int32u TC_Verify_Signature( int32u site, byte *signature, byte *digest );
 
@@ -36,18 +36,32 @@
 #include "construct_collective_state_protocol.h"
 #include "validate.h"
 #include "util/memory.h"
+#include "tc_wrapper.h"
+#include "worker_pool.h"
 #include <string.h>
 
 extern server_variables VAR;
 
 util_stopwatch combine_stopwatch;
 
+/* Servers that have sent a signature share that does not match its proof */
+int32u thresh_blacklisted[NUM_SERVER_SLOTS];
+
+#if THRESH_THREADS
+worker_pool *thresh_share_pool;
+#endif
+
 /* Local funtctions */
 void THRESH_Proposal_Share( signed_message *mess ); 
 void THRESH_Accept_Share( signed_message *mess );
 void THRESH_Union_Share( signed_message *mess);
 void THRESH_Global_View_Change_Share(signed_message *mess); 
 void THRESH_Local_View_Proof_Share( signed_message *mess ); 
+int32u THRESH_Generate_Share( signed_message *share, int32u num_bytes ); 
+void THRESH_Send_Share( signed_message *share, int32u num_bytes,
+	int32u dummy ); 
+void THRESH_Check_Share_Proofs( signed_message **sig_share, byte **shares,
+	byte *digest ); 
 
 void THRESH_Process_Threshold_Share( signed_message *mess ) {
 
@@ -78,6 +92,9 @@ void THRESH_Process_Threshold_Share( signed_message *mess ) {
         case SITE_LOCAL_VIEW_PROOF_TYPE:
 	    THRESH_Local_View_Proof_Share(mess);
 	    return;
+	case CHECKPOINT_TYPE:
+	    /* Stored and combined by APPLY_Sig_Share */
+	    return;
 	default:
 	    Alarm(DEBUG,"sig share message with type %d\n",
 		    content->type );
@@ -93,9 +110,9 @@ void THRESH_Invoke_Threshold_Signature( signed_message *mess ) {
     signed_message *share;
     sig_share_message *share_specific;
     signed_message *content;
-    byte digest[DIGEST_SIZE];
 
-    share = UTIL_New_Signed_Message();
+    share = UTIL_New_Signed_Message_Size( sizeof(sig_share_message) + 
+	    sizeof(signed_message) + mess->len );
 
     share_specific = (sig_share_message*)(share+1);
     content = (signed_message*)(share_specific+1);
@@ -111,9 +128,35 @@ void THRESH_Invoke_Threshold_Signature( signed_message *mess ) {
     memcpy( (void*)content, (void*)mess, 
 	    mess->len + sizeof(signed_message) );
     
-    /* The signature share is on all of mess except the signature */     
-    UTIL_Stopwatch_Start( &combine_stopwatch );
+#if THRESH_THREADS
+    /* Generate the share on a threshold thread; it comes back through
+     * THRESH_Send_Share. If the threads are backed up, generate it here. */
+    if ( thresh_share_pool == NULL ) {
+	thresh_share_pool = WPOOL_Create( THRESH_THREADS, THRESH_QUEUE_SIZE,
+		THRESH_Generate_Share, THRESH_Send_Share );
+    }
+    if ( !WPOOL_Is_Full( thresh_share_pool ) ) {
+	WPOOL_Submit( thresh_share_pool, share, 
+		share->len + sizeof(signed_message) );
+	return;
+    }
+#endif
+
+    THRESH_Send_Share( share, share->len + sizeof(signed_message),
+	    THRESH_Generate_Share( share, share->len + sizeof(signed_message) ) );
+}
+
+/* Compute the signature share on the message carried in a sig share message,
+ * storing it in the signature field of the carried message. This only reads
+ * the share and the key material, so it may run on a threshold thread. */
+int32u THRESH_Generate_Share( signed_message *share, int32u num_bytes ) {
 
+    signed_message *content;
+    byte digest[DIGEST_SIZE];
+
+    content = (signed_message*)(((sig_share_message*)(share+1))+1);
+
+    /* The signature share is on all of mess except the signature */     
     OPENSSL_RSA_Make_Digest( 
 	    (char*)content + SIGNATURE_SIZE, 
 	    content->len + sizeof(signed_message) - SIGNATURE_SIZE, 
@@ -121,16 +164,8 @@ void THRESH_Invoke_Threshold_Signature( signed_message *mess ) {
 
     //OPENSSL_RSA_Print_Digest(digest);
     
-    TC_Generate_Sig_Share((byte*)content, digest); 
-
-    UTIL_Stopwatch_Stop( &combine_stopwatch );
-
-    if ( VAR.My_Site_ID == 1 && VAR.My_Server_ID == 2) {
-	Alarm(DEBUG,"%d %d sig_share_gen: %f type: %d seq: %d\n",
-		VAR.My_Site_ID,VAR.My_Server_ID,
-		UTIL_Stopwatch_Elapsed( &combine_stopwatch ),
-		mess->type, ((proposal_message*)(mess+1))->seq_num ); 
-    }
+    TC_Generate_Sig_Share( (byte*)content, 
+	    ((sig_share_message*)(share+1))->sig_share_proof, digest ); 
 
     /* Print share */
 #if 0 
@@ -140,7 +175,15 @@ void THRESH_Invoke_Threshold_Signature( signed_message *mess ) {
     }
     Alarm(PRINT,"\n");
 #endif
-    
+
+    return 1;
+}
+
+/* Sign, apply, and send a sig share message whose share has been generated.
+ * Drops the caller's reference to the share. */
+void THRESH_Send_Share( signed_message *share, int32u num_bytes,
+	int32u dummy ) {
+
     UTIL_RSA_Sign_Message( share );
     APPLY_Message_To_Data_Structs( share );
     UTIL_Site_Broadcast( share );
@@ -185,12 +228,13 @@ util_stopwatch combine_stopwatch;
 /* Construct a new threshold signed message, if possible. Takes an array of
  * signed_messages that are signature shares. The array should contain the
  * number of shares necessary to create a signature share. The function
- * combines these signature shares. If the resulting threshold signature
- * verifies, the function returns 1 and stores the signature in the provided
- * destination. If the resulting signature does not verify, then the function
- * returns 0 and blacklists all of the servers that contributed invalid
- * signature shares. It also removes any invalid signature shares from the
- * array. */
+ * combines these signature shares and verifies the result once. If the
+ * resulting threshold signature verifies, the function returns 1 and stores
+ * the signature in the provided destination. If it does not verify, the
+ * function checks the proof on each share, blacklists all of the servers
+ * that contributed invalid signature shares, and combines the remaining
+ * shares. Shares from blacklisted servers are ignored from then on. The
+ * function returns 0 if there are not enough good shares. */
 int32u THRESH_Attempt_To_Combine( signed_message **sig_share, 
       signed_message *dest_mess ) { //byte *signature_dest ) {
 
@@ -199,6 +243,8 @@ int32u THRESH_Attempt_To_Combine( signed_message **sig_share,
     signed_message *content;
     byte digest[DIGEST_SIZE];
     byte *signature_dest;
+    byte *shares[NUM_SERVERS_IN_SITE + 1];
+    int32u verified;
 
     signature_dest = (byte*)dest_mess;
     
@@ -209,10 +255,10 @@ int32u THRESH_Attempt_To_Combine( signed_message **sig_share,
 	    VAR.My_Site_ID, VAR.My_Server_ID, 
 	    NUM_SERVERS_IN_SITE );
 
-    TC_Initialize_Combine_Phase( NUM_SERVERS_IN_SITE + 1 );
- 
+    shares[0] = NULL;
     for ( si = 1; si <= NUM_SERVERS_IN_SITE; si++ ) {
-	if ( sig_share[si] != NULL ) {
+	shares[si] = NULL;
+	if ( sig_share[si] != NULL && !thresh_blacklisted[si] ) {
 	    /* Add the share. */
 	    share = sig_share[si]; /* pointer to share */
 	    if ( share->site_id != VAR.My_Site_ID )  {
@@ -227,15 +273,20 @@ int32u THRESH_Attempt_To_Combine( signed_message **sig_share,
 	    }
 	    Alarm(PRINT,"\n");
 #endif
-	    TC_Add_Share_To_Be_Combined( si, 
-				/* location of actual signature share */ 
-					 (byte*)content );
+	    /* location of actual signature share */ 
+	    shares[si] = (byte*)content;
 	}
     }
 
     if ( share == NULL || content == NULL ) {
 	return 0;
     }
+
+    /* Combine on the content of my own share if I have one, so that a bad
+     * share cannot choose the content. */
+    if ( shares[VAR.My_Server_ID] != NULL ) {
+	content = (signed_message*)shares[VAR.My_Server_ID];
+    }
     
     /* Make a digest based on one of the signature shares */
     OPENSSL_RSA_Make_Digest( 
@@ -248,31 +299,73 @@ int32u THRESH_Attempt_To_Combine( signed_message **sig_share,
     
     /* Combine the shares */    
     UTIL_Stopwatch_Start( &combine_stopwatch );
-    TC_Combine_Shares( signature_dest, digest );
+    verified = TC_Combine_Shares( signature_dest, digest, shares );
+
+    if ( !verified ) {
+	/* Some share is bad. Find it with the share proofs and combine the
+	 * good ones. */
+	THRESH_Check_Share_Proofs( sig_share, shares, digest );
+	verified = TC_Combine_Shares( signature_dest, digest, shares );
+    }
+
+    UTIL_Stopwatch_Stop( &combine_stopwatch );
+
+    if ( !verified ) {
+	Alarm(DEBUG, "Not enough good shares to combine!\n");
+	return 0;
+    }
   
     /* Copy the data into the new message */
     memcpy( (byte*)(dest_mess) + SIGNATURE_SIZE,
 	    (byte*)content + SIGNATURE_SIZE,
 	    content->len + sizeof(signed_message) - SIGNATURE_SIZE );
 
-    UTIL_Stopwatch_Stop( &combine_stopwatch );
-
-    /* Check if the proposal verifies */
-    if(!VAL_Validate_Message(dest_mess, sizeof(signed_message) + 
+    /* Check if the proposal verifies. The combine already checked the
+     * threshold signature, so only the contents are left to validate. */
+    if( !VAL_Validate_Presigned_Message(dest_mess, sizeof(signed_message) + 
 			     dest_mess->len)) {
       Alarm(DEBUG, "Combined one doesn't validate!\n");
+      return 0;
     }
-    else 
-      Alarm(DEBUG, "Combined message passes validation!\n");
 
-    /* If the proof does not verifiy, we must enter a phase where we
-     * check all shares to make sure that they are valid. Any share
-     * that is not valid must be removed from the sig_shares array AND
-     * the server that contributed the invalid share sould be
-     * blacklisted. This is not currently coded. */
+    Alarm(DEBUG, "Combined message passes validation!\n");
 
-    /* Clean up */
-    TC_Destruct_Combine_Phase( NUM_SERVERS_IN_SITE + 1 );
-  
     return 1;
 }
+
+/* Check the proof on each share in shares, which are the signature shares of
+ * sig_share, against the share's own content. Blacklist the servers whose
+ * shares are invalid, and remove from shares both those and the valid shares
+ * on content other than digest. */
+void THRESH_Check_Share_Proofs( signed_message **sig_share, byte **shares,
+	byte *digest ) {
+
+    int32u si;
+    signed_message *content;
+    byte *proof;
+    byte share_digest[DIGEST_SIZE];
+
+    for ( si = 1; si <= NUM_SERVERS_IN_SITE; si++ ) {
+	if ( shares[si] == NULL ) {
+	    continue;
+	}
+
+	content = (signed_message*)shares[si];
+	proof = ((sig_share_message*)(sig_share[si]+1))->sig_share_proof;
+
+	OPENSSL_RSA_Make_Digest( 
+		(byte*)(content) + SIG_SHARE_SIZE, 
+		content->len + sizeof(signed_message) - SIG_SHARE_SIZE,
+		share_digest );
+
+	if ( !TC_Verify_Share_Proof( si, shares[si], proof, share_digest ) ) {
+	    Alarm(PRINT,"%d %d Blacklisting server %d for a bad signature "
+		    "share\n", VAR.My_Site_ID, VAR.My_Server_ID, si );
+	    thresh_blacklisted[si] = 1;
+	    shares[si] = NULL;
+	} else if ( memcmp( share_digest, digest, DIGEST_SIZE ) != 0 ) {
+	    /* A good share, but on other content */
+	    shares[si] = NULL;
+	}
+    }
+}
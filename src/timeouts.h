@@ -54,6 +54,10 @@ static const sp_time timeout_attempt_to_send_proposal = { 0, 6000 };
 
 static const sp_time timeout_global_view_change_send_proof = { 1, 100000 };
 
+/* How long the leader site representative may hold a partial batch of client
+ * updates waiting for more. Zero sends whatever is queued right away. */
+static const sp_time timeout_update_batch_linger = { 0, 0 };
+
 static const sp_time timeout_zero = { 0, 0 }; 
 
 static const sp_time timeout_client = { 1, 0 }; 
@@ -48,11 +48,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-
-/* JK Alarm */
-#include "../data_structs.h"
-#include "../construct_collective_state_protocol.h"
-#include "../utility.h"
+#include <unistd.h>
+#include <pthread.h>
 
 
 
@@ -71,74 +68,84 @@ static const char *DEFAULT_TIMESTAMP_FORMAT="[%a %d %b %Y %H:%M:%S]";
 
 static int      AlarmInteractiveProgram = FALSE;
 
+/* Server state shown before each line. Only the event loop changes it (see
+ * Alarm_set_prefix), so a line logged from any thread costs a copy of it
+ * rather than a look at the protocol state. Alarm_prefix_seq is odd while an
+ * update is in progress; readers copy again if it moved under them. */
+static char            Alarm_prefix[ALARM_PREFIX_SIZE];
+static volatile int32u Alarm_prefix_seq;
+
 #ifdef HAVE_GOOD_VARGS
 
 /* Probably should work on all platforms, but just in case, I leave it to the
    developers...
 */
 
-extern server_variables VAR;
-extern global_data_struct GLOBAL;
-extern pending_data_struct PENDING;
-extern client_data_struct CLIENT;
+/* Local Functions */
+static int  Alarm_copy_prefix( char *buf, int size );
+static int  Alarm_format( char *buf, int size, char *message, va_list ap );
+static void Alarm_write_now( char *message, va_list ap );
+#if ALARM_ASYNC
+static void  Alarm_enqueue( char *message, va_list ap );
+static int   Alarm_drain( void );
+static void  Alarm_start_writer( void );
+static void *Alarm_writer( void *arg );
+#endif
+
+#if ALARM_ASYNC
+/* Ring of formatted lines. Any thread may add a line: it claims the slot at
+ * Alarm_ring_tail with a compare-and-swap, formats into it, and then
+ * publishes it by advancing the slot's sequence number. The writer thread (or
+ * Alarm_flush) takes lines from Alarm_ring_head under Alarm_drain_lock, which
+ * only the consumers share. */
+typedef struct dummy_alarm_slot {
+	volatile int32u seq;
+	int32u          len;
+	char            line[ALARM_LINE_SIZE];
+} alarm_slot;
+
+static alarm_slot      Alarm_ring[ALARM_RING_SIZE];
+static volatile int32u Alarm_ring_tail;
+static int32u          Alarm_ring_head;
+static volatile int32u Alarm_dropped;
+static pthread_mutex_t Alarm_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The writer thread sleeps on Alarm_wake while the ring is empty, with
+ * Alarm_writer_waiting set. A producer that sees the flag after publishing
+ * its line wakes it, so only the line that ends an idle period pays for the
+ * signal. */
+static volatile int32u Alarm_writer_waiting;
+static pthread_mutex_t Alarm_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  Alarm_wake = PTHREAD_COND_INITIALIZER;
+static pthread_once_t  Alarm_writer_once = PTHREAD_ONCE_INIT;
+#endif
 
-void Alarm( int32 mask, char *message, ...)
+void Alarm_log( int32 mask, char *message, ...)
 {
 	if ( Alarm_mask & mask )
         {
 	    va_list ap;
 
-	    if ( Alarm_timestamp_format )
-            {
-	        char timestamp[42];
-		struct tm *tm_now;
-		time_t time_now;
-		size_t length;
-		
-		time_now = time(NULL);
-		tm_now = localtime(&time_now);
-		length = strftime(timestamp, 40,
-				  Alarm_timestamp_format, tm_now);
-		timestamp[length] = ' ';
-		fwrite(timestamp, length+1, sizeof(char), stdout);
-            }
-	   
-#if 1 
-	    if(UTIL_I_Am_Representative())
-	      printf("R");
-	    else
-	      printf(" ");
-
-	    if(UTIL_I_Am_In_Leader_Site())
-	      printf("L");
-	    else
-	      printf(" ");
-
-	    if( CCS_Am_I_Constrained_In_Pending_Context() ) {
-	      if( CCS_Is_Globally_Constrained() )
-		printf("B");
-	      else
-		printf("P");
+	    va_start(ap,message);
+#if ALARM_ASYNC
+	    if ( !(EXIT & mask) ) {
+		Alarm_enqueue(message, ap);
+	    } else {
+		/* Keep the order of the log: the last line comes last */
+		Alarm_flush();
+		Alarm_write_now(message, ap);
 	    }
-	    else if( CCS_Is_Globally_Constrained() )
-	      printf("G");
-	    else
-	      printf(" ");
-
-	    printf(" %d %d %d ", 
-		   GLOBAL.View, 
-		   PENDING.View,
-		   GLOBAL.ARU);
+#else
+	    Alarm_write_now(message, ap);
 #endif
-
-	    va_start(ap,message);
-	    vprintf(message, ap);
 	    va_end(ap);
-	    fflush(stdout);
         }
 
 	if ( EXIT & mask )
 	{
+#if ALARM_ASYNC
+	    Alarm_flush();
+#endif
 #ifndef	_WIN32_WCE
 	    perror("errno say:");
 #endif
@@ -148,6 +155,197 @@ void Alarm( int32 mask, char *message, ...)
 	}
 }
 
+/* Copies the current prefix into buf. Returns its length. */
+static int Alarm_copy_prefix( char *buf, int size )
+{
+	int32u seq;
+	int len;
+
+	do {
+	    seq = Alarm_prefix_seq;
+	    __sync_synchronize();
+	    for ( len = 0; len < size - 1 && Alarm_prefix[len] != '\0'; len++ )
+		buf[len] = Alarm_prefix[len];
+	    __sync_synchronize();
+	} while ( (seq & 1) || seq != Alarm_prefix_seq );
+
+	return len;
+}
+
+/* Formats a complete line (timestamp, server state prefix, and the message)
+ * into buf, cutting it short if needed. Returns the length of the line. */
+static int Alarm_format( char *buf, int size, char *message, va_list ap )
+{
+	int len, ret;
+
+	len = 0;
+	if ( Alarm_timestamp_format )
+	{
+	    struct tm tm_now;
+	    time_t time_now;
+
+	    time_now = time(NULL);
+	    localtime_r(&time_now, &tm_now);
+	    len = strftime(buf, 40, Alarm_timestamp_format, &tm_now);
+	    buf[len++] = ' ';
+	}
+
+	len += Alarm_copy_prefix(buf + len, size - len);
+
+	ret = vsnprintf(buf + len, size - len, message, ap);
+	if ( ret > 0 )
+	    len = (len + ret < size) ? len + ret : size - 1;
+
+	return len;
+}
+
+static void Alarm_write_now( char *message, va_list ap )
+{
+	char line[4 * ALARM_LINE_SIZE];
+	int len;
+
+	len = Alarm_format(line, sizeof(line), message, ap);
+	fwrite(line, 1, len, stdout);
+	fflush(stdout);
+}
+
+#if ALARM_ASYNC
+
+static void Alarm_enqueue( char *message, va_list ap )
+{
+	alarm_slot *slot;
+	int32u pos;
+	int32 diff;
+
+	pthread_once(&Alarm_writer_once, Alarm_start_writer);
+
+	pos = Alarm_ring_tail;
+	for (;;) {
+	    slot = &Alarm_ring[pos & (ALARM_RING_SIZE - 1)];
+	    diff = (int32)(slot->seq - pos);
+	    if ( diff == 0 ) {
+		if ( __sync_bool_compare_and_swap(&Alarm_ring_tail, pos, pos + 1) )
+		    break;
+		pos = Alarm_ring_tail;
+	    } else if ( diff < 0 ) {
+		/* Full: the writer is behind, so drop the line */
+		__sync_fetch_and_add(&Alarm_dropped, 1);
+		return;
+	    } else {
+		pos = Alarm_ring_tail;
+	    }
+	}
+
+	slot->len = Alarm_format(slot->line, ALARM_LINE_SIZE, message, ap);
+	__sync_synchronize();
+	slot->seq = pos + 1;
+	__sync_synchronize();
+
+	if ( Alarm_writer_waiting ) {
+	    pthread_mutex_lock(&Alarm_wake_lock);
+	    pthread_cond_signal(&Alarm_wake);
+	    pthread_mutex_unlock(&Alarm_wake_lock);
+	}
+}
+
+/* Writes out every published line. The lines are gathered into one buffer
+ * first, since stdout is often unbuffered (see Alarm_set_output). Returns the
+ * number of lines written. */
+static int Alarm_drain( void )
+{
+	static char batch[16 * ALARM_LINE_SIZE];
+	alarm_slot *slot;
+	int32u dropped, used;
+	int count;
+
+	count = 0;
+	used  = 0;
+	pthread_mutex_lock(&Alarm_drain_lock);
+	for (;;) {
+	    slot = &Alarm_ring[Alarm_ring_head & (ALARM_RING_SIZE - 1)];
+	    if ( slot->seq != Alarm_ring_head + 1 )
+		break;
+	    __sync_synchronize();
+	    if ( used + slot->len > sizeof(batch) ) {
+		fwrite(batch, 1, used, stdout);
+		used = 0;
+	    }
+	    memcpy(batch + used, slot->line, slot->len);
+	    used += slot->len;
+	    __sync_synchronize();
+	    slot->seq = Alarm_ring_head + ALARM_RING_SIZE;
+	    Alarm_ring_head++;
+	    count++;
+	}
+	if ( used != 0 )
+	    fwrite(batch, 1, used, stdout);
+
+	dropped = Alarm_dropped;
+	if ( dropped != 0 ) {
+	    __sync_fetch_and_sub(&Alarm_dropped, dropped);
+	    fprintf(stdout, "Alarm: dropped %u lines, log ring full\n", dropped);
+	    count++;
+	}
+
+	if ( count != 0 )
+	    fflush(stdout);
+	pthread_mutex_unlock(&Alarm_drain_lock);
+
+	return count;
+}
+
+static void Alarm_start_writer( void )
+{
+	pthread_t tid;
+	int32u i;
+
+	for ( i = 0; i < ALARM_RING_SIZE; i++ )
+	    Alarm_ring[i].seq = i;
+
+	if ( pthread_create(&tid, NULL, Alarm_writer, NULL) != 0 ) {
+	    perror("Alarm: could not start the writer thread");
+	    exit( 0 );
+	}
+	pthread_detach(tid);
+	atexit(Alarm_flush);
+}
+
+static void *Alarm_writer( void *arg )
+{
+	int32u ready;
+
+	for (;;) {
+	    if ( Alarm_drain() != 0 )
+		continue;
+
+	    /* Announce the wait before the last look at the ring, so that
+	     * a producer either sees the flag or its line is seen here */
+	    pthread_mutex_lock(&Alarm_wake_lock);
+	    Alarm_writer_waiting = 1;
+	    __sync_synchronize();
+	    pthread_mutex_lock(&Alarm_drain_lock);
+	    ready = ( Alarm_ring[Alarm_ring_head & (ALARM_RING_SIZE - 1)].seq
+		      == Alarm_ring_head + 1 ) || Alarm_dropped != 0;
+	    pthread_mutex_unlock(&Alarm_drain_lock);
+	    if ( !ready )
+		pthread_cond_wait(&Alarm_wake, &Alarm_wake_lock);
+	    Alarm_writer_waiting = 0;
+	    pthread_mutex_unlock(&Alarm_wake_lock);
+	}
+	return NULL;
+}
+
+#endif /* ALARM_ASYNC */
+
+void Alarm_flush( void )
+{
+#if ALARM_ASYNC
+	Alarm_drain();
+#else
+	fflush(stdout);
+#endif
+}
+
 #else
 
 void Alarm( int32 mask, char *message, 
@@ -191,6 +389,11 @@ void Alarm( int32 mask, char *message,
 	}
 }
 
+void Alarm_flush( void )
+{
+	fflush(stdout);
+}
+
 #endif /* HAVE_GOOD_VARGS */
 
 void Alarm_set_interactive(void) 
@@ -238,6 +441,16 @@ void Alarm_disable_timestamp(void)
         Alarm_timestamp_format = NULL;
 }
 
+void Alarm_set_prefix( char *prefix )
+{
+	Alarm_prefix_seq++;
+	__sync_synchronize();
+	strncpy(Alarm_prefix, prefix, ALARM_PREFIX_SIZE - 1);
+	Alarm_prefix[ALARM_PREFIX_SIZE - 1] = '\0';
+	__sync_synchronize();
+	Alarm_prefix_seq++;
+}
+
 void Alarm_set(int32 mask)
 {
 	Alarm_mask = Alarm_mask | mask;
@@ -89,13 +89,47 @@
 #define		NONE		0x00000000
 
 
+/* Alarm masks compiled into the program. An Alarm whose mask has none of
+ * these bits (and is not EXIT) is removed by the compiler along with the
+ * evaluation of its arguments, so DEBUG calls cost nothing on hot paths.
+ * Build with -DALARM_COMPILED_MASK=ALL to get them back. */
+#ifndef ALARM_COMPILED_MASK
+#define ALARM_COMPILED_MASK	( ALL & ~DEBUG )
+#endif
+
+/* Asynchronous output. With ALARM_ASYNC set, an enabled Alarm formats its
+ * line into a ring of ALARM_RING_SIZE lines and returns, and a writer thread
+ * copies the lines to stdout. A line that finds the ring full is dropped and
+ * counted. An EXIT line is written directly, after whatever is queued. */
+#ifndef ALARM_ASYNC
+#define ALARM_ASYNC		1
+#endif
+
+#define ALARM_RING_SIZE		1024	/* Lines (power of 2) */
+#define ALARM_LINE_SIZE		512	/* Longer lines are cut short */
+
 #ifdef  HAVE_GOOD_VARGS
-void Alarm( int32 mask, char *message, ...);
+void Alarm_log( int32 mask, char *message, ...);
+
+#define Alarm( mask, ... ) \
+	do { \
+	    if ( (mask) & (ALARM_COMPILED_MASK | EXIT) ) { \
+		Alarm_log( (mask), __VA_ARGS__ ); \
+	    } \
+	} while ( 0 )
 
 #else
 void Alarm();
 #endif
 
+#define ALARM_PREFIX_SIZE	64	/* Server state shown before each line */
+
+/* Sets the text shown before each line. Called only from the event loop. */
+void Alarm_set_prefix( char *prefix );
+
+/* Writes out the lines queued so far */
+void Alarm_flush(void);
+
 void Alarm_set_output(char *filename);
 
 void Alarm_enable_timestamp(char *format);
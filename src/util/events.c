@@ -55,6 +55,14 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+
+/* On Linux the fd events are waited on with epoll, unless the build defines
+ * EVENTS_USE_SELECT. */
+#if defined(ARCH_PC_LINUX) && !defined(EVENTS_USE_SELECT)
+#define	EVENTS_USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #else 	/* ARCH_PC_WIN95 */
 
 #include <winsock.h>
@@ -68,17 +76,29 @@
 #endif	/* ARCH_PC_WIN95 */
 
 #include <string.h>
+#include <stdlib.h>
 #include "sp_events.h"
 #include "../objects.h"    /* For memory */
 #include "memory.h"     /* for memory */
 #include "alarm.h"
 
+/* Time events are kept in a binary min-heap ordered by time, and then by
+ * the order in which they were queued, so that events due at the same time
+ * run first-in first-out. Each event is also linked into a hash table on
+ * (func, code, data) so that E_queue and E_dequeue find an existing event
+ * without scanning the queue. */
+
+#define	TIME_HASH_SIZE		1024	/* power of 2 */
+#define	TIME_HEAP_INIT_SIZE	256
+
 typedef	struct dummy_t_event {
 	sp_time		t;
 	void		(* func)( int code, void *data );
         int             code;
         void            *data;
-	struct dummy_t_event	*next;
+	unsigned int	seq;
+	int		heap_index;
+	struct dummy_t_event	*hash_next;
 } time_event;
 
 typedef struct dummy_fd_event {
@@ -96,11 +116,32 @@ typedef struct dummy_fd_queue {
 	fd_event	events[MAX_FD_EVENTS];
 } fd_queue;
 
-static	time_event	*Time_queue;
+static	time_event	**Time_heap;
+static	int		Time_heap_size;
+static	int		Time_heap_max;
+static	time_event	*Time_hash[TIME_HASH_SIZE];
+static	unsigned int	Time_seq;
 static	sp_time		Now;
 
 static	fd_queue	Fd_queue[NUM_PRIORITY];
+#ifndef	EVENTS_USE_EPOLL
 static	fd_set		Fd_mask[NUM_FDTYPES];
+#else
+/* The epoll set holds the same fds that would be in Fd_mask: the active ones
+ * at or above Active_priority. Fd_interest[fd] is the set of fd types (one
+ * bit each) registered for fd, and Fd_ready[fd] the types that the last
+ * epoll_wait reported ready. Level triggered, because each pass of the loop
+ * only serves some of the ready fds and expects the rest to be reported
+ * again. */
+#define	MAX_EPOLL_EVENTS	256
+
+static	int		Epoll_fd;
+static	int		*Fd_interest;
+static	int		*Fd_ready;
+static	int		Fd_table_size;
+static	struct epoll_event	Epoll_events[MAX_EPOLL_EVENTS];
+static	int		Num_epoll_events;
+#endif
 static	int		Active_priority;
 static	int		Exit_events;
 
@@ -152,7 +193,15 @@ int 	E_init(void)
 	start_msec = GetTickCount();
 #endif
 
-	Time_queue = NULL;
+	Time_heap_size = 0;
+	Time_heap_max  = TIME_HEAP_INIT_SIZE;
+	Time_heap      = (time_event **) malloc( Time_heap_max * sizeof(time_event *) );
+	if ( Time_heap == NULL )
+	{
+		Alarm(EXIT, "E_Init: Failure to allocate the time event heap\n");
+	}
+	memset( Time_hash, 0, sizeof(Time_hash) );
+	Time_seq = 0;
 
         ret = Mem_init_object(TIME_EVENT, sizeof(time_event), 100,0);
         if (ret < 0)
@@ -165,10 +214,26 @@ int 	E_init(void)
 		Fd_queue[i].num_fds = 0;
                 Fd_queue[i].num_active_fds = 0;
         }
+#ifndef	EVENTS_USE_EPOLL
 	for ( i=0; i < NUM_FDTYPES; i++ )
         {
 		FD_ZERO( &Fd_mask[i] );
         }
+#else
+	Epoll_fd = epoll_create( MAX_FD_EVENTS );
+	if( Epoll_fd < 0 )
+	{
+		Alarm( EXIT, "E_init: epoll_create failed: %s\n", strerror(errno) );
+	}
+	Fd_table_size = 64;
+	Fd_interest = (int *) calloc( Fd_table_size, sizeof(int) );
+	Fd_ready    = (int *) calloc( Fd_table_size, sizeof(int) );
+	if( Fd_interest == NULL || Fd_ready == NULL )
+	{
+		Alarm( EXIT, "E_init: Failure to allocate the fd tables\n" );
+	}
+	Num_epoll_events = 0;
+#endif
 	Active_priority = LOW_PRIORITY;
 
 	E_get_time();
@@ -193,6 +258,18 @@ sp_time	E_get_time(void)
 	sp_time		dummy_tz;
 #endif
 	unsigned int		ret;
+#ifdef	CLOCK_MONOTONIC
+	struct timespec		ts;
+
+	/* Timers and latencies only need a clock that never steps back */
+	ret = clock_gettime( CLOCK_MONOTONIC, &ts );
+	if ( ret == 0 )
+	{
+		Now.sec  = ts.tv_sec;
+		Now.usec = ts.tv_nsec / 1000;
+		return ( Now );
+	}
+#endif
 
 	ret = gettimeofday((struct timeval *)((char*)&Now), (void *)&dummy_tz );
 	if ( ret < 0 ) Alarm( EXIT, "E_get_time: gettimeofday problems.\n" );
@@ -270,15 +347,126 @@ int	E_compare_time( sp_time t1, sp_time t2 )
 	else			      return (  0 );
 }
 
+static	int	Time_before( time_event *t1, time_event *t2 )
+{
+	int	compare;
+
+	compare = E_compare_time( t1->t, t2->t );
+	if ( compare != 0 ) return( compare < 0 );
+	return( (int)( t1->seq - t2->seq ) < 0 );
+}
+
+static	time_event	**Time_hash_bucket( void (* func)( int code, void *data ), int code,
+					    void *data )
+{
+	unsigned long	h;
+
+	h  = (unsigned long) func;
+	h ^= (unsigned long) data * 2654435761UL;
+	h ^= (unsigned long) code * 40503UL;
+	h ^= h >> 13;
+	return( &Time_hash[ h & ( TIME_HASH_SIZE - 1 ) ] );
+}
+
+/* Returns the link that points to the matching event, or NULL */
+static	time_event	**Time_hash_find( void (* func)( int code, void *data ), int code,
+					  void *data )
+{
+	time_event	**link;
+
+	for( link = Time_hash_bucket( func, code, data ); *link != NULL;
+	     link = &(*link)->hash_next )
+	{
+		if( (*link)->func == func &&
+                    (*link)->data == data &&
+                    (*link)->code == code )
+		{
+			return( link );
+		}
+	}
+	return( NULL );
+}
+
+static	void	Time_heap_set( int index, time_event *t_e )
+{
+	Time_heap[index] = t_e;
+	t_e->heap_index  = index;
+}
+
+static	void	Time_heap_up( int index )
+{
+	time_event	*t_e;
+	int		parent;
+
+	t_e = Time_heap[index];
+	while( index > 0 )
+	{
+		parent = ( index - 1 ) / 2;
+		if( !Time_before( t_e, Time_heap[parent] ) ) break;
+		Time_heap_set( index, Time_heap[parent] );
+		index = parent;
+	}
+	Time_heap_set( index, t_e );
+}
+
+static	void	Time_heap_down( int index )
+{
+	time_event	*t_e;
+	int		child;
+
+	t_e = Time_heap[index];
+	for(;;)
+	{
+		child = 2 * index + 1;
+		if( child >= Time_heap_size ) break;
+		if( child + 1 < Time_heap_size &&
+		    Time_before( Time_heap[child + 1], Time_heap[child] ) )
+			child++;
+		if( !Time_before( Time_heap[child], t_e ) ) break;
+		Time_heap_set( index, Time_heap[child] );
+		index = child;
+	}
+	Time_heap_set( index, t_e );
+}
+
+/* Takes the event out of the heap and the hash table, without disposing it */
+static	void	Time_remove( time_event **link )
+{
+	time_event	*t_e, *last;
+	int		index;
+
+	t_e   = *link;
+	*link = t_e->hash_next;
+
+	index = t_e->heap_index;
+	Time_heap_size--;
+	if( index < Time_heap_size )
+	{
+		last = Time_heap[Time_heap_size];
+		Time_heap_set( index, last );
+		Time_heap_up( index );
+		Time_heap_down( last->heap_index );
+	}
+}
+
 int 	E_queue( void (* func)( int code, void *data ), int code, void *data,
 		 sp_time delta_time )
 {
-	time_event *t_pre;
-	time_event *t_post;
+	time_event **link;
 	time_event *t_e;
-	int	   inserted;
-	int	   deleted;
-	int	   compare;
+
+	link = Time_hash_find( func, code, data );
+	if( link != NULL )
+	{
+		/* Move the simillar event to its new time */
+		t_e       = *link;
+		t_e->t    = E_add_time( E_get_time(), delta_time );
+		t_e->seq  = Time_seq++;
+		Time_heap_up( t_e->heap_index );
+		Time_heap_down( t_e->heap_index );
+		Alarm( EVENTS, "E_queue: requeued a simillar event func 0x%x code %d data 0x%x in future (%u:%u)\n",t_e->func,t_e->code, t_e->data, delta_time.sec, delta_time.usec );
+		return( 0 );
+	}
 
 	t_e       = new( TIME_EVENT );
 
@@ -286,76 +474,27 @@ int 	E_queue( void (* func)( int code, void *data ), int code, void *data,
 	t_e->func = func;
         t_e->code = code;
         t_e->data = data;
-	deleted   = 0;
-	inserted  = 0;
+	t_e->seq  = Time_seq++;
 
-	if( Time_queue != NULL )
-	{
-		if( Time_queue->func == t_e->func &&
-                    Time_queue->data == t_e->data &&
-                    Time_queue->code == t_e->code )
-		{
-			t_pre = Time_queue;
-			Time_queue = Time_queue->next;
-			dispose( t_pre );
-			deleted = 1;
-			Alarm( EVENTS, "E_queue: dequeued a (first) simillar event\n" );
-		}
-	}
-	if( Time_queue == NULL )
+	if( Time_heap_size == Time_heap_max )
 	{
-		t_e->next  = NULL;
-		Time_queue = t_e;
-		Alarm( EVENTS, "E_queue: (only) event queued func 0x%x code %d data 0x%x in future (%u:%u)\n",t_e->func,t_e->code, t_e->data, delta_time.sec, delta_time.usec );
-		return( 0 );
-	}else{
-		compare = E_compare_time ( t_e->t, Time_queue->t );
-		if( compare < 0 )
+		Time_heap_max *= 2;
+		Time_heap = (time_event **) realloc( Time_heap, Time_heap_max * sizeof(time_event *) );
+		if( Time_heap == NULL )
 		{
-			t_e->next   = Time_queue;
-			Time_queue  = t_e;
-			inserted    = 1;
-			Alarm( EVENTS, "E_queue: (first) event queued func 0x%x code %d data 0x%x in future (%u:%u)\n",t_e->func,t_e->code, t_e->data, delta_time.sec,delta_time.usec );
+			Alarm( EXIT, "E_queue: Failure to grow the time event heap\n" );
 		}
 	}
-	t_pre    = Time_queue ;
-	t_post   = Time_queue->next;
-	while ( t_post != NULL && ( !inserted || !deleted ) )
-	{
-		if( t_post->func == t_e->func &&
-                    t_post->data == t_e->data &&
-                    t_post->code == t_e->code )
-		{
-			t_pre->next = t_post->next;
-			dispose( t_post );
-			t_post = t_pre->next;
-			deleted = 1;
-			Alarm( EVENTS, "E_queue: dequeued a simillar event\n" );
-			continue;
-		}
 
-		if ( !inserted )
-		{
-			compare = E_compare_time ( t_e->t, t_post->t );
-			if( compare < 0 )
-			{
-				t_pre->next = t_e;
-				t_e->next   = t_post;
-				inserted    = 1;
-				Alarm( EVENTS, "E_queue: event queued for func 0x%x code %d data 0x%x in future (%u:%u)\n",t_e->func,t_e->code, t_e->data, delta_time.sec, delta_time.usec );
-			}
-		}
+	link = Time_hash_bucket( func, code, data );
+	t_e->hash_next = *link;
+	*link = t_e;
 
-		t_pre  = t_post;
-		t_post = t_post->next;
-	}
+	Time_heap_set( Time_heap_size, t_e );
+	Time_heap_size++;
+	Time_heap_up( t_e->heap_index );
 
-	if( !inserted )
-	{
-		t_pre->next = t_e;
-		t_e->next   = NULL;
-		Alarm( EVENTS, "E_queue: (last) event queued func 0x%x code %d data 0x%x in future (%u:%u)\n",t_e->func,t_e->code, t_e->data, delta_time.sec,delta_time.usec );
-	}
+	Alarm( EVENTS, "E_queue: event queued func 0x%x code %d data 0x%x in future (%u:%u)\n",t_e->func,t_e->code, t_e->data, delta_time.sec, delta_time.usec );
 
 	return( 0 );
 }
@@ -363,44 +502,21 @@ int 	E_queue( void (* func)( int code, void *data ), int code, void *data,
 int 	E_dequeue( void (* func)( int code, void *data ), int code,
 		   void *data )
 {
-	time_event *t_pre;
+	time_event **link;
 	time_event *t_ptr;
 
-	if( Time_queue == NULL )
+	link = Time_hash_find( func, code, data );
+	if( link == NULL )
 	{
 		Alarm( EVENTS, "E_dequeue: no such event\n" );
 		return( -1 );
 	}
 
-	if( Time_queue->func == func &&
-            Time_queue->data == data &&
-            Time_queue->code == code )
-	{
-		t_ptr = Time_queue;
-		Time_queue = Time_queue->next;
-		dispose( t_ptr );
-		Alarm( EVENTS, "E_dequeue: first event dequeued func 0x%x code %d data 0x%x\n",func,code, data);
-		return( 0 );
-	}
-
-	t_pre = Time_queue;
-	while ( t_pre->next != NULL )
-	{
-		t_ptr = t_pre->next;
-		if( t_ptr->func == func &&
-                    t_ptr->data == data &&
-                    t_ptr->code == code )
-		{
-			t_pre->next = t_ptr->next;
-			dispose( t_ptr );
-			Alarm( EVENTS, "E_dequeue: event dequeued func 0x%x code %d data 0x%x\n",func,code, data);
-			return( 0 );
-		}
-		t_pre = t_ptr;
-	}
-
-	Alarm( EVENTS, "E_dequeue: no such event\n" );
-	return( -1 );
+	t_ptr = *link;
+	Time_remove( link );
+	dispose( t_ptr );
+	Alarm( EVENTS, "E_dequeue: event dequeued func 0x%x code %d data 0x%x\n",func,code, data);
+	return( 0 );
 }
 
 void	E_delay( sp_time t )
@@ -427,6 +543,117 @@ void	E_delay( sp_time t )
 
 }
 
+#ifndef	EVENTS_USE_EPOLL
+
+#define	E_fd_is_ready( fd, fd_type )	FD_ISSET( fd, &current_mask[fd_type] )
+#define	E_mask_set( fd, fd_type )	FD_SET( fd, &Fd_mask[fd_type] )
+#define	E_mask_clr( fd, fd_type )	FD_CLR( fd, &Fd_mask[fd_type] )
+
+#else	/* EVENTS_USE_EPOLL */
+
+static	void	E_fd_table_grow( int fd )
+{
+	int	new_size;
+
+	new_size = Fd_table_size;
+	while( fd >= new_size ) new_size *= 2;
+
+	Fd_interest = (int *) realloc( Fd_interest, new_size * sizeof(int) );
+	Fd_ready    = (int *) realloc( Fd_ready, new_size * sizeof(int) );
+	if( Fd_interest == NULL || Fd_ready == NULL )
+		Alarm( EXIT, "E_fd_table_grow: out of memory for fd %d\n", fd );
+
+	memset( &Fd_interest[Fd_table_size], 0, ( new_size - Fd_table_size ) * sizeof(int) );
+	memset( &Fd_ready[Fd_table_size], 0, ( new_size - Fd_table_size ) * sizeof(int) );
+	Fd_table_size = new_size;
+}
+
+static	void	E_mask_update( int fd, int interest )
+{
+	struct epoll_event	ev;
+	int			op;
+
+	if( fd >= Fd_table_size ) E_fd_table_grow( fd );
+	if( Fd_interest[fd] == interest ) return;
+
+	if( Fd_interest[fd] == 0 )	op = EPOLL_CTL_ADD;
+	else if( interest == 0 )	op = EPOLL_CTL_DEL;
+	else				op = EPOLL_CTL_MOD;
+
+	memset( &ev, 0, sizeof(ev) );
+	ev.data.fd = fd;
+	if( interest & ( 1 << READ_FD ) )   ev.events |= EPOLLIN;
+	if( interest & ( 1 << WRITE_FD ) )  ev.events |= EPOLLOUT;
+	if( interest & ( 1 << EXCEPT_FD ) ) ev.events |= EPOLLPRI;
+
+	if( epoll_ctl( Epoll_fd, op, fd, &ev ) < 0 )
+	{
+		/* A closed fd has already left the epoll set */
+		if( op != EPOLL_CTL_DEL )
+			Alarm( PRINT, "E_mask_update: epoll_ctl %d failed for fd %d: %s\n",
+				op, fd, strerror(errno) );
+	}
+	Fd_interest[fd] = interest;
+	Fd_ready[fd]   &= interest;
+}
+
+static	void	E_mask_set( int fd, int fd_type )
+{
+	if( fd >= Fd_table_size ) E_fd_table_grow( fd );
+	E_mask_update( fd, Fd_interest[fd] | ( 1 << fd_type ) );
+}
+
+static	void	E_mask_clr( int fd, int fd_type )
+{
+	if( fd >= Fd_table_size ) E_fd_table_grow( fd );
+	E_mask_update( fd, Fd_interest[fd] & ~( 1 << fd_type ) );
+}
+
+/* Waits up to timeout for fd events and returns the number of (fd, fd type)
+ * pairs that are ready, as select would. */
+static	int	E_poll_fds( sp_time timeout )
+{
+	int	timeout_ms;
+	int	i, fd, ready, num_set;
+
+	for( i = 0; i < Num_epoll_events; i++ )
+		Fd_ready[ Epoll_events[i].data.fd ] = 0;
+
+	/* Round up, so that timers are not polled for early */
+	timeout_ms = timeout.sec * 1000 + ( timeout.usec + 999 ) / 1000;
+
+	Num_epoll_events = epoll_wait( Epoll_fd, Epoll_events, MAX_EPOLL_EVENTS, timeout_ms );
+	if( Num_epoll_events < 0 )
+	{
+		if( errno != EINTR )
+			Alarm( PRINT, "E_poll_fds: epoll_wait error: %s\n", strerror(errno) );
+		Num_epoll_events = 0;
+	}
+
+	num_set = 0;
+	for( i = 0; i < Num_epoll_events; i++ )
+	{
+		fd    = Epoll_events[i].data.fd;
+		ready = 0;
+		/* Errors and hangups wake up any reader or writer, as in select */
+		if( Epoll_events[i].events & ( EPOLLIN | EPOLLERR | EPOLLHUP ) )
+			ready |= ( 1 << READ_FD );
+		if( Epoll_events[i].events & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) )
+			ready |= ( 1 << WRITE_FD );
+		if( Epoll_events[i].events & EPOLLPRI )
+			ready |= ( 1 << EXCEPT_FD );
+		Fd_ready[fd] = ready & Fd_interest[fd];
+		if( Fd_ready[fd] & ( 1 << READ_FD ) )   num_set++;
+		if( Fd_ready[fd] & ( 1 << WRITE_FD ) )  num_set++;
+		if( Fd_ready[fd] & ( 1 << EXCEPT_FD ) ) num_set++;
+	}
+	return( num_set );
+}
+
+#define	E_fd_is_ready( fd, fd_type )	( Fd_ready[fd] & ( 1 << (fd_type) ) )
+
+#endif	/* EVENTS_USE_EPOLL */
+
 int	E_attach_fd( int fd, int fd_type,
 		     void (* func)( mailbox mbox, int code, void *data ),
 		     int code, void *data, int priority )
@@ -444,7 +671,13 @@ int	E_attach_fd( int fd, int fd_type,
 		Alarm( PRINT, "E_attach_fd: invalid fd_type %d for fd %d with priority %d\n", fd_type, fd, priority );
 		return( -1 );
 	}
-#ifndef	ARCH_PC_WIN95
+#ifdef	EVENTS_USE_EPOLL
+        if( fd < 0 )
+        {
+                Alarm( PRINT, "E_attach_fd: invalid fd %d with fd_type %d with priority %d\n", fd, fd_type, priority );
+                return( -1 );
+        }
+#elif	!defined(ARCH_PC_WIN95)
 	/* Windows bug: Reports FD_SETSIZE of 64 but select works on all
 	 * fd's even ones with numbers greater then 64.
 	 */
@@ -483,7 +716,7 @@ int	E_attach_fd( int fd, int fd_type,
         Fd_queue[priority].events[num_fds].active  = TRUE;
 	Fd_queue[priority].num_fds++;
         Fd_queue[priority].num_active_fds++;
-	if( Active_priority <= priority ) FD_SET( fd, &Fd_mask[fd_type] );
+	if( Active_priority <= priority ) E_mask_set( fd, fd_type );
 
 	Alarm( EVENTS, "E_attach_fd: fd %d, fd_type %d, code %d, data 0x%x, priority %d Active_priority %d\n",
 		fd, fd_type, code, data, priority, Active_priority );
@@ -513,7 +746,7 @@ int 	E_detach_fd( int fd, int fd_type )
 			Fd_queue[i].num_fds--;
 			Fd_queue[i].events[j] = Fd_queue[i].events[Fd_queue[i].num_fds];
 
-			FD_CLR( fd, &Fd_mask[fd_type] );
+			E_mask_clr( fd, fd_type );
 			found = 1;
 
 			break; /* from the j for only */
@@ -546,7 +779,7 @@ int     E_deactivate_fd( int fd, int fd_type )
                         if (Fd_queue[i].events[j].active)
                                 Fd_queue[i].num_active_fds--;
                         Fd_queue[i].events[j].active = FALSE;
-			FD_CLR( fd, &Fd_mask[fd_type] );
+			E_mask_clr( fd, fd_type );
 			found = 1;
 
 			break; /* from the j for only */
@@ -578,7 +811,7 @@ int     E_activate_fd( int fd, int fd_type )
                         if ( !(Fd_queue[i].events[j].active) )
                                 Fd_queue[i].num_active_fds++;
                         Fd_queue[i].events[j].active = TRUE;
-			if( i >= Active_priority ) FD_SET( fd, &Fd_mask[ fd_type ] );
+			if( i >= Active_priority ) E_mask_set( fd, fd_type );
 			found = 1;
 
 			break; /* from the j for only */
@@ -603,17 +836,23 @@ int 	E_set_active_threshold( int priority )
 	if( priority == Active_priority ) return( priority );
 
 	Active_priority = priority;
+#ifndef	EVENTS_USE_EPOLL
 	for ( i=0; i < NUM_FDTYPES; i++ )
         {
 		FD_ZERO( &Fd_mask[i] );
         }
+#else
+	for( i = 0; i < priority; i++ )
+	    for( j=0; j < Fd_queue[i].num_fds; j++ )
+		E_mask_clr( Fd_queue[i].events[j].fd, Fd_queue[i].events[j].fd_type );
+#endif
 
 	for( i = priority; i < NUM_PRIORITY; i++ )
 	    for( j=0; j < Fd_queue[i].num_fds; j++ )
 	    {
 		fd_type = Fd_queue[i].events[j].fd_type;
                 if (Fd_queue[i].events[j].active)
-                	FD_SET( Fd_queue[i].events[j].fd, &Fd_mask[fd_type] );
+                	E_mask_set( Fd_queue[i].events[j].fd, fd_type );
 	    }
 
 	Alarm( EVENTS, "E_set_active_threshold: changed to %d\n",Active_priority);
@@ -646,7 +885,9 @@ static	const sp_time		mili_sec 	= {     0, 1000};
 	int			fd_type;
 	int			i,j;
 	sp_time			timeout, wait_timeout;
+#ifndef	EVENTS_USE_EPOLL
 	fd_set			current_mask[NUM_FDTYPES];
+#endif
 	time_event		*temp_ptr;
         int                     first=1;
 #ifdef TESTTIME
@@ -666,7 +907,7 @@ static	const sp_time		mili_sec 	= {     0, 1000};
 #ifdef TESTTIME
         start = E_get_time();
 #endif
-	while( Time_queue != NULL )
+	while( Time_heap_size > 0 )
 	{
 #ifdef BADCLOCK
 		if ( clock_sync >= 0 )
@@ -677,13 +918,14 @@ static	const sp_time		mili_sec 	= {     0, 1000};
 #else
                 E_get_time();
 #endif
-		if ( !first && E_compare_time( Now, Time_queue->t ) >= 0 )
+		if ( !first && E_compare_time( Now, Time_heap[0]->t ) >= 0 )
 		{
 #ifdef TESTTIME
-                        tmp_late = E_sub_time( Now, Time_queue->t );
+                        tmp_late = E_sub_time( Now, Time_heap[0]->t );
 #endif
-			temp_ptr = Time_queue;
-			Time_queue = Time_queue->next;
+			temp_ptr = Time_heap[0];
+			Time_remove( Time_hash_find( temp_ptr->func, temp_ptr->code,
+						     temp_ptr->data ) );
 			Alarm( EVENTS, "E_handle_events: exec time event \n");
 #ifdef TESTTIME
                         Alarm( DEBUG, "Events: TimeEv is %d %d late\n",tmp_late.sec, tmp_late.usec);
@@ -698,7 +940,7 @@ static	const sp_time		mili_sec 	= {     0, 1000};
 #endif
                         if (Exit_events) goto end_handler;
 		}else{
-			timeout = E_sub_time( Time_queue->t, Now );
+			timeout = E_sub_time( Time_heap[0]->t, Now );
 			break;
 		}
 	}
@@ -710,33 +952,45 @@ static	const sp_time		mili_sec 	= {     0, 1000};
         Alarm(DEBUG, "Events: TimeEv's took %d %d to handle\n", tmp_late.sec, tmp_late.usec);
 #endif
 	/* Handle fd events   */
+#ifndef	EVENTS_USE_EPOLL
 	for( i=0; i < NUM_FDTYPES; i++ )
 	{
 		current_mask[i] = Fd_mask[i];
 	}
+#endif
 	Alarm( EVENTS, "E_handle_events: poll select\n");
 #ifdef TESTTIME
         req_time = zero_sec;
 #endif
         wait_timeout = zero_sec;
+#ifndef	EVENTS_USE_EPOLL
 	num_set = select( FD_SETSIZE, &current_mask[READ_FD], &current_mask[WRITE_FD], &current_mask[EXCEPT_FD],
 			  (struct timeval *)((char*)&wait_timeout) );
+#else
+	num_set = E_poll_fds( wait_timeout );
+#endif
 	if (num_set == 0 && !Exit_events)
 	{
 #ifdef BADCLOCK
 		clock_sync = 0;
 #endif
+#ifndef	EVENTS_USE_EPOLL
 		for( i=0; i < NUM_FDTYPES; i++ )
 		{
 			current_mask[i] = Fd_mask[i];
 		}
+#endif
 		Alarm( EVENTS, "E_handle_events: select with timeout (%d, %d)\n",
 			timeout.sec,timeout.usec );
 #ifdef TESTTIME
                 req_time = E_add_time(req_time, timeout);
 #endif
+#ifndef	EVENTS_USE_EPOLL
 		num_set = select( FD_SETSIZE, &current_mask[READ_FD], &current_mask[WRITE_FD],
 				  &current_mask[EXCEPT_FD], (struct timeval *)((char*)&timeout) );
+#else
+		num_set = E_poll_fds( timeout );
+#endif
 	}
 #ifdef TESTTIME
         start = E_get_time();
@@ -752,7 +1006,7 @@ static	const sp_time		mili_sec 	= {     0, 1000};
 	    {
 		fd      = Fd_queue[i].events[j].fd;
 		fd_type = Fd_queue[i].events[j].fd_type;
-		if( FD_ISSET( fd, &current_mask[fd_type] ) )
+		if( E_fd_is_ready( fd, fd_type ) )
 		{
 		    Alarm( EVENTS, "E_handle_events: exec handler for fd %d, fd_type %d, priority %d\n",
 					fd, fd_type, i );
@@ -798,7 +1052,7 @@ static	const sp_time		mili_sec 	= {     0, 1000};
 	    j = ( i + Round_robin ) % Fd_queue[LOW_PRIORITY].num_fds;
 	    fd      = Fd_queue[LOW_PRIORITY].events[j].fd;
 	    fd_type = Fd_queue[LOW_PRIORITY].events[j].fd_type;
-	    if( FD_ISSET( fd, &current_mask[fd_type] ) )
+	    if( E_fd_is_ready( fd, fd_type ) )
 	    {
 		Round_robin = ( j + 1 ) % Fd_queue[LOW_PRIORITY].num_fds;
 		/*
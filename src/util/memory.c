@@ -52,6 +52,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "errors.h"
 #include "memory.h"
 #include "alarm.h"
@@ -62,6 +63,16 @@
 #define NO_REF_CNT             -1
 #define MAX_MEM_OBJECTS         200
 
+/* Each thread keeps a cache of free objects of every type, and takes objects
+ * from or gives them back to the shared, locked pool of the type this many at
+ * a time (fewer for types with a lower threshold). */
+#define MEM_CACHE_BATCH         32
+
+#define Mem_atomic_inc(var)     __sync_add_and_fetch(&(var), 1)
+#define Mem_atomic_dec(var)     __sync_sub_and_fetch(&(var), 1)
+#define Mem_atomic_add(var, n)  __sync_add_and_fetch(&(var), (n))
+#define Mem_atomic_sub(var, n)  __sync_sub_and_fetch(&(var), (n))
+
 
 /* Define SPREAD_STATUS when Memory is compiled with the Spread Status system.
  * If memory is being used outside of Spread then comment the below define out.
@@ -94,7 +105,8 @@ typedef struct mem_header_d
 {
         int32u   obj_type;
         int32    ref_cnt;
-        size_t   block_len;
+        int32u   from_slab;     /* 1 = part of a slab, never freed */
+        int32u   block_len;
 } mem_header;
 #define MEM_SIZE = sizeof(mem_header);
 
@@ -117,16 +129,41 @@ typedef struct mem_info_d
 #endif
         unsigned int    num_obj_inpool;
         void            **list_head;
+        unsigned int    cache_max;      /* most objects a thread may cache */
+        unsigned int    objs_per_slab;  /* 0 = calloc objects one at a time */
+        pthread_mutex_t lock;           /* protects the shared pool */
 } mem_info;
 
+/* A thread's own free objects of one type, used without locking */
+typedef struct mem_cache_d
+{
+        void            **list_head;
+        unsigned int    num_obj;
+} mem_cache;
+
 static mem_info Mem[MAX_MEM_OBJECTS];
 
+static __thread mem_cache Mem_Cache[MAX_MEM_OBJECTS];
+static __thread bool      Mem_Cache_Registered;
+static pthread_key_t      Mem_Cache_Key;
+static pthread_once_t     Mem_Cache_Key_Once = PTHREAD_ONCE_INIT;
+
 static bool Initialized;
 
 #ifdef  SPREAD_STATUS
 static bool MemStatus_initialized;
 #endif
 
+#ifndef NDEBUG
+static void Mem_raise_max(unsigned int *max, unsigned int value);
+#endif
+static void Mem_cache_release(void *dummy);
+static void Mem_cache_key_create(void);
+static void Mem_cache_register(void);
+static void Mem_alloc_slab(int32u obj_type);
+static int  Mem_cache_refill(int32u obj_type);
+static void Mem_cache_flush(int32u obj_type, unsigned int count);
+
 int Mem_valid_objtype(int32u objtype) 
 {
         /* if any bits set higher then max object type return failure */
@@ -234,6 +271,224 @@ unsigned int Mem_max_bytes(int32u objtype)
 #endif /* ARCH_SGI_IRIX */
 #endif /* ARCH_PC_WIN95 */
 
+#ifndef NDEBUG
+/* Raises a high water mark. Two threads racing here can lose an update, which
+ * only costs the statistics a little accuracy. */
+static void Mem_raise_max(unsigned int *max, unsigned int value)
+{
+        if (value > *max) 
+        {
+                *max = value;
+        }
+}
+#endif
+
+/* Runs when a thread exits, and returns whatever it still holds to the
+ * shared pools */
+static void Mem_cache_release(void *dummy)
+{
+        int32u obj_type;
+
+        for (obj_type = 1; obj_type < MAX_MEM_OBJECTS; obj_type++)
+        {
+                if (Mem_Cache[obj_type].num_obj > 0) 
+                {
+                        Mem_cache_flush(obj_type, Mem_Cache[obj_type].num_obj);
+                }
+        }
+}
+
+static void Mem_cache_key_create(void)
+{
+        pthread_key_create(&Mem_Cache_Key, Mem_cache_release);
+}
+
+/* Arranges for the calling thread's cache to be released when it exits */
+static void Mem_cache_register(void)
+{
+        pthread_once(&Mem_Cache_Key_Once, Mem_cache_key_create);
+        pthread_setspecific(Mem_Cache_Key, (void *) &Mem_Cache_Registered);
+        Mem_Cache_Registered = TRUE;
+}
+
+/* Carves a slab of objects out of one calloc and adds them to the shared
+ * pool. Called with the pool locked. */
+static void Mem_alloc_slab(int32u obj_type)
+{
+        char *          slab;
+        size_t          elem_len;
+        unsigned int    i;
+        mem_header *    head_ptr;
+        void **         body_ptr;
+
+        /* Keep every header as aligned as calloc would have */
+        elem_len = (sizeof(mem_header) + sizeobj(obj_type) + 15) & ~((size_t) 15);
+
+        slab = (char *) calloc(Mem[obj_type].objs_per_slab, elem_len);
+        if (slab == NULL) 
+        {
+                return;
+        }
+        Mem[obj_type].num_calloc++;
+
+        for (i = 0; i < Mem[obj_type].objs_per_slab; i++)
+        {
+                head_ptr = (mem_header *) (slab + i * elem_len);
+                head_ptr->obj_type = obj_type;
+                head_ptr->ref_cnt = NO_REF_CNT;
+                head_ptr->from_slab = 1;
+                head_ptr->block_len = sizeobj(obj_type);
+
+                body_ptr = (void **) (head_ptr + 1);
+                *body_ptr = (void *) Mem[obj_type].list_head;
+                Mem[obj_type].list_head = body_ptr;
+                Mem[obj_type].num_obj_inpool++;
+        }
+
+#ifndef NDEBUG
+        Mem[obj_type].num_obj += Mem[obj_type].objs_per_slab;
+        Mem[obj_type].bytes_allocated += Mem[obj_type].objs_per_slab * elem_len;
+        Mem_raise_max(&Mem[obj_type].max_obj, Mem[obj_type].num_obj);
+        Mem_raise_max(&Mem[obj_type].max_bytes, Mem[obj_type].bytes_allocated);
+
+        Mem_raise_max(&Mem_Max_Objects, Mem_atomic_add(Mem_Obj_Allocated, Mem[obj_type].objs_per_slab));
+        Mem_raise_max(&Mem_Max_Bytes, Mem_atomic_add(Mem_Bytes_Allocated, Mem[obj_type].objs_per_slab * elem_len));
+#endif
+}
+
+/* Fills the calling thread's cache with up to half its limit from the shared
+ * pool, allocating more objects if the pool is empty. Returns 0 if not even
+ * one object could be had. */
+static int Mem_cache_refill(int32u obj_type)
+{
+        mem_cache *     cache;
+        mem_header *    head_ptr;
+        void **         body_ptr;
+        unsigned int    count;
+
+        cache = &Mem_Cache[obj_type];
+        if (!Mem_Cache_Registered) 
+        {
+                Mem_cache_register();
+        }
+
+        count = Mem[obj_type].cache_max / 2;
+        if (count == 0) 
+        {
+                count = 1;
+        }
+
+        pthread_mutex_lock(&Mem[obj_type].lock);
+
+        if (Mem[obj_type].list_head == NULL) 
+        {
+                if (Mem[obj_type].objs_per_slab > 0) 
+                {
+                        Mem_alloc_slab(obj_type);
+                } else 
+                {
+                        head_ptr = (mem_header *) calloc(1, sizeobj(obj_type) + sizeof(mem_header));
+                        if (head_ptr != NULL) 
+                        {
+                                head_ptr->obj_type = obj_type;
+                                head_ptr->ref_cnt  = NO_REF_CNT;
+                                head_ptr->from_slab = 0;
+                                head_ptr->block_len = sizeobj(obj_type);
+
+                                Mem[obj_type].num_calloc++;
+
+                                body_ptr = (void **) (head_ptr + 1);
+                                *body_ptr = NULL;
+                                Mem[obj_type].list_head = body_ptr;
+                                Mem[obj_type].num_obj_inpool++;
+#ifndef NDEBUG
+                                Mem[obj_type].num_obj++;
+                                Mem[obj_type].bytes_allocated += (sizeobj(obj_type) + sizeof(mem_header));
+                                Mem_raise_max(&Mem[obj_type].max_obj, Mem[obj_type].num_obj);
+                                Mem_raise_max(&Mem[obj_type].max_bytes, Mem[obj_type].bytes_allocated);
+
+                                Mem_raise_max(&Mem_Max_Objects, Mem_atomic_inc(Mem_Obj_Allocated));
+                                Mem_raise_max(&Mem_Max_Bytes, 
+                                              Mem_atomic_add(Mem_Bytes_Allocated, sizeobj(obj_type) + sizeof(mem_header)));
+#endif
+                        }
+                }
+        }
+
+        while (count > 0 && Mem[obj_type].list_head != NULL)
+        {
+                assert(Mem[obj_type].num_obj_inpool > 0);
+
+                body_ptr = Mem[obj_type].list_head;
+                Mem[obj_type].list_head = (void **) *(body_ptr);
+                Mem[obj_type].num_obj_inpool--;
+
+                *body_ptr = (void *) cache->list_head;
+                cache->list_head = body_ptr;
+                cache->num_obj++;
+                count--;
+        }
+
+        pthread_mutex_unlock(&Mem[obj_type].lock);
+
+        return(cache->list_head != NULL);
+}
+
+/* Moves count objects from the calling thread's cache to the shared pool.
+ * Once the pool holds threshold objects, the rest are returned to the system,
+ * except those carved from a slab. */
+static void Mem_cache_flush(int32u obj_type, unsigned int count)
+{
+        mem_cache *     cache;
+        mem_header *    head_ptr;
+        void **         body_ptr;
+
+        cache = &Mem_Cache[obj_type];
+
+        pthread_mutex_lock(&Mem[obj_type].lock);
+
+        while (count > 0 && cache->list_head != NULL)
+        {
+                body_ptr = cache->list_head;
+                cache->list_head = (void **) *(body_ptr);
+                cache->num_obj--;
+                count--;
+
+                head_ptr = mem_header_ptr(body_ptr);
+                if (Mem[obj_type].num_obj_inpool >= Mem[obj_type].threshold && !head_ptr->from_slab)
+                {
+#ifndef NDEBUG
+                        Mem[obj_type].num_obj--;
+                        Mem[obj_type].bytes_allocated -= (sizeobj(obj_type) + sizeof(mem_header));
+                        Mem_atomic_dec(Mem_Obj_Allocated);
+                        Mem_atomic_sub(Mem_Bytes_Allocated, sizeobj(obj_type) + sizeof(mem_header));
+#endif
+                        free(head_ptr);
+                } else 
+                {
+                        *body_ptr = (void *) Mem[obj_type].list_head;
+                        Mem[obj_type].list_head = body_ptr;
+                        Mem[obj_type].num_obj_inpool++;
+                }
+        }
+
+        pthread_mutex_unlock(&Mem[obj_type].lock);
+}
+
+/* Input: a registered object type, number of objects per slab
+ * Output: none
+ * Effects: from now on the pool of this type is refilled a slab at a time
+ */
+void            Mem_init_slab( int32u obj_type, unsigned int objs_per_slab )
+{
+        assert(Mem_valid_objtype(obj_type));
+
+        pthread_mutex_lock(&Mem[obj_type].lock);
+        Mem[obj_type].objs_per_slab = objs_per_slab;
+        pthread_mutex_unlock(&Mem[obj_type].lock);
+}
+
+
 void    Mem_init_status()
 {
 #ifdef SPREAD_STATUS
@@ -349,6 +604,9 @@ int            Mem_init_object(int32u obj_type, int32u size, unsigned int thresh
         Mem[obj_type].size = size;
         Mem[obj_type].threshold = threshold;
         Mem[obj_type].num_calloc = 0;
+        Mem[obj_type].cache_max = (threshold < 2 * MEM_CACHE_BATCH) ? threshold : 2 * MEM_CACHE_BATCH;
+        Mem[obj_type].objs_per_slab = 0;
+        pthread_mutex_init(&Mem[obj_type].lock, NULL);
 
 #ifndef NDEBUG
         Mem[obj_type].num_obj = 0;
@@ -379,6 +637,7 @@ int            Mem_init_object(int32u obj_type, int32u size, unsigned int thresh
 
                         head_ptr->obj_type = obj_type;
 			head_ptr->ref_cnt = NO_REF_CNT;
+			head_ptr->from_slab = 0;
                         head_ptr->block_len = sizeobj(obj_type);
                         /* We add 1 because pointer arithm. states a pointer + 1 equals a pointer
                          * to the next element in an array where each element is of a particular size.
@@ -463,94 +722,25 @@ int            Mem_init_object(int32u obj_type, int32u size, unsigned int thresh
  */
 void *          new(int32u obj_type)
 {
+        mem_cache *     cache;
+        void **         body_ptr;
 
         assert(Mem_valid_objtype(obj_type));
 
-        if (Mem[obj_type].list_head == NULL) 
+        cache = &Mem_Cache[obj_type];
+        if (cache->list_head == NULL && !Mem_cache_refill(obj_type))
         {
-                mem_header *    head_ptr;
-                
-		/* printf("calloc: %d\n", obj_type); */
-
-                head_ptr = (mem_header *) calloc(1, sizeobj(obj_type) + sizeof(mem_header));
-                if (head_ptr == NULL) 
-                {
-                        Alarm(MEMORY, "mem_alloc_object: Failure to calloc an object. Returning NULL object\n");
-                        return(NULL);
-                }
-                head_ptr->obj_type = obj_type;
-		head_ptr->ref_cnt  = NO_REF_CNT;
-                head_ptr->block_len = sizeobj(obj_type);
-
-      		Mem[obj_type].num_calloc++;
-
-#ifndef NDEBUG
-                Mem[obj_type].num_obj++;
-                Mem[obj_type].num_obj_inuse++;
-                Mem[obj_type].bytes_allocated += (sizeobj(obj_type) + sizeof(mem_header));
-                if (Mem[obj_type].bytes_allocated > Mem[obj_type].max_bytes)
-                {
-                        Mem[obj_type].max_bytes = Mem[obj_type].bytes_allocated;
-                }
-                if (Mem[obj_type].num_obj > Mem[obj_type].max_obj)
-                {       
-                        Mem[obj_type].max_obj = Mem[obj_type].num_obj;
-                }
-                if (Mem[obj_type].num_obj_inuse > Mem[obj_type].max_obj_inuse)
-                {
-                        Mem[obj_type].max_obj_inuse = Mem[obj_type].num_obj_inuse;
-                }
-
-                Mem_Bytes_Allocated += (sizeobj(obj_type) + sizeof(mem_header));
-                Mem_Obj_Allocated++;
-                Mem_Obj_Inuse++;
-                if (Mem_Bytes_Allocated > Mem_Max_Bytes) 
-                {
-                        Mem_Max_Bytes = Mem_Bytes_Allocated;
-                }
-                if (Mem_Obj_Allocated > Mem_Max_Objects)
-                {
-                        Mem_Max_Objects = Mem_Obj_Allocated;
-                }
-                if (Mem_Obj_Inuse > Mem_Max_Obj_Inuse)
-                {
-                        Mem_Max_Obj_Inuse = Mem_Obj_Inuse;
-                }
-
-#endif
-#ifdef TESTING
-        printf("alloc:object = 0x%x\n", head_ptr + 1);
-        printf("alloc:mem_headerptr = 0x%x\n", head_ptr);
-        printf("alloc:objtype = %u:\n", head_ptr->obj_type);
-        printf("alloc:blocklen = %u:\n", head_ptr->block_len);
-#endif
-
-
-#if ZERO_CREATE
-	        memset((void *) (head_ptr + 1), 0, sizeobj(obj_type));
-#endif
+                Alarm(MEMORY, "mem_alloc_object: Failure to calloc an object. Returning NULL object\n");
+                return(NULL);
+        }
 
-                return((void *) (head_ptr + 1));
-        } else
-        {
-                void ** body_ptr;
-                assert(Mem[obj_type].num_obj_inpool > 0 );
+        body_ptr = cache->list_head;
+        cache->list_head = (void **) *(body_ptr);
+        cache->num_obj--;
 
-                body_ptr = Mem[obj_type].list_head;
-                Mem[obj_type].list_head = (void *) *(body_ptr);
-                Mem[obj_type].num_obj_inpool--;
 #ifndef NDEBUG
-                Mem[obj_type].num_obj_inuse++;
-                if (Mem[obj_type].num_obj_inuse > Mem[obj_type].max_obj_inuse)
-                {
-                        Mem[obj_type].max_obj_inuse = Mem[obj_type].num_obj_inuse;
-                }
-                Mem_Obj_Inuse++;
-                if (Mem_Obj_Inuse > Mem_Max_Obj_Inuse)
-                {
-                        Mem_Max_Obj_Inuse = Mem_Obj_Inuse;
-                }
-
+        Mem_raise_max(&Mem[obj_type].max_obj_inuse, Mem_atomic_inc(Mem[obj_type].num_obj_inuse));
+        Mem_raise_max(&Mem_Max_Obj_Inuse, Mem_atomic_inc(Mem_Obj_Inuse));
 #endif
 #ifdef TESTING
         printf("pool:object = 0x%x\n", body_ptr);
@@ -560,11 +750,10 @@ void *          new(int32u obj_type)
 #endif
 
 #if ZERO_CREATE
-	        memset((void*)body_ptr, 0, sizeobj(obj_type));
+        memset((void*)body_ptr, 0, sizeobj(obj_type));
 #endif
 
-                return((void *) (body_ptr));
-        }
+        return((void *) (body_ptr));
 }
 
 
@@ -592,7 +781,7 @@ int             inc_ref_cnt(void *object)
 {
     assert(object != NULL);
     assert(mem_header_ptr(object)->ref_cnt > 0);
-    return(++mem_header_ptr(object)->ref_cnt);
+    return(Mem_atomic_inc(mem_header_ptr(object)->ref_cnt));
 }
 
 
@@ -608,7 +797,7 @@ int             dec_ref_cnt(void *object)
     if(object == NULL) { return 0; }
 
     assert(mem_header_ptr(object)->ref_cnt > 0);
-    ret = --mem_header_ptr(object)->ref_cnt;
+    ret = Mem_atomic_dec(mem_header_ptr(object)->ref_cnt);
     
     if(ret == 0) {
 	mem_header_ptr(object)->ref_cnt = NO_REF_CNT;
@@ -652,44 +841,23 @@ void *          Mem_alloc( unsigned int length)
         }
         head_ptr->obj_type = BLOCK_OBJECT;
 	head_ptr->ref_cnt = NO_REF_CNT;
+	head_ptr->from_slab = 0;
         head_ptr->block_len = length;
 
-	Mem[head_ptr->obj_type].num_calloc++;
+	Mem_atomic_inc(Mem[BLOCK_OBJECT].num_calloc);
 
 
 #ifndef NDEBUG
 
-        Mem[BLOCK_OBJECT].num_obj++;
-        Mem[BLOCK_OBJECT].num_obj_inuse++;
-        Mem[BLOCK_OBJECT].bytes_allocated += (length + sizeof(mem_header));
-        if (Mem[BLOCK_OBJECT].bytes_allocated > Mem[BLOCK_OBJECT].max_bytes)
-        {
-                Mem[BLOCK_OBJECT].max_bytes = Mem[BLOCK_OBJECT].bytes_allocated;
-        }
-        if (Mem[BLOCK_OBJECT].num_obj > Mem[BLOCK_OBJECT].max_obj)
-        {       
-                Mem[BLOCK_OBJECT].max_obj = Mem[BLOCK_OBJECT].num_obj;
-        }
-        if (Mem[BLOCK_OBJECT].num_obj_inuse > Mem[BLOCK_OBJECT].max_obj_inuse)
-        {
-                Mem[BLOCK_OBJECT].max_obj_inuse = Mem[BLOCK_OBJECT].num_obj_inuse;
-        }
-        
-        Mem_Bytes_Allocated += (length + sizeof(mem_header));
-        Mem_Obj_Allocated++;
-        Mem_Obj_Inuse++;
-        if (Mem_Bytes_Allocated > Mem_Max_Bytes) 
-        {
-                Mem_Max_Bytes = Mem_Bytes_Allocated;
-        }
-        if (Mem_Obj_Allocated > Mem_Max_Objects)
-        {
-                Mem_Max_Objects = Mem_Obj_Allocated;
-        }
-        if (Mem_Obj_Inuse > Mem_Max_Obj_Inuse)
-        {
-                Mem_Max_Obj_Inuse = Mem_Obj_Inuse;
-        }
+        /* Blocks bypass the pools, so there is no lock to count them under */
+        Mem_raise_max(&Mem[BLOCK_OBJECT].max_obj, Mem_atomic_inc(Mem[BLOCK_OBJECT].num_obj));
+        Mem_raise_max(&Mem[BLOCK_OBJECT].max_obj_inuse, Mem_atomic_inc(Mem[BLOCK_OBJECT].num_obj_inuse));
+        Mem_raise_max(&Mem[BLOCK_OBJECT].max_bytes, 
+                      Mem_atomic_add(Mem[BLOCK_OBJECT].bytes_allocated, length + sizeof(mem_header)));
+
+        Mem_raise_max(&Mem_Max_Bytes, Mem_atomic_add(Mem_Bytes_Allocated, length + sizeof(mem_header)));
+        Mem_raise_max(&Mem_Max_Objects, Mem_atomic_inc(Mem_Obj_Allocated));
+        Mem_raise_max(&Mem_Max_Obj_Inuse, Mem_atomic_inc(Mem_Obj_Inuse));
 
 #endif        
         return((void *) (head_ptr + 1));
@@ -705,6 +873,8 @@ void            dispose(void *object)
         int32u obj_type;
 	int32  ref_cnt;
 	size_t len;
+        mem_cache *cache;
+        void ** body_ptr;
 
         if (object == NULL) { return; }
 
@@ -718,43 +888,47 @@ void            dispose(void *object)
         printf("disp:objtype = %u:\n", mem_header_ptr(object)->obj_type);
         printf("disp:blocklen = %u:\n", mem_header_ptr(object)->block_len);
 #endif
-        assert(Mem_valid_objtype(obj_type));
+        assert(Mem_valid_objtype(obj_type) || obj_type == BLOCK_OBJECT);
 #ifndef NDEBUG
         assert(Mem[obj_type].num_obj_inuse > 0);
         assert(Mem[obj_type].num_obj > 0);
-        assert(Mem[obj_type].bytes_allocated >= mem_header_ptr(object)->block_len + sizeof(mem_header));
+        assert(Mem[obj_type].bytes_allocated >= len + sizeof(mem_header));
 	assert(ref_cnt == NO_REF_CNT);
 	/*
 	 *Alarm(MEMORY, "dispose: disposing pointer 0x%x to object type %d named %s\n", object, obj_type, Objnum_to_String(obj_type));
 	 */
 
-        Mem[obj_type].num_obj_inuse--;
-        Mem_Obj_Inuse--;
-        if (obj_type == BLOCK_OBJECT) 
-        {
-                assert(Mem[obj_type].num_obj_inpool == 0);
-                assert(Mem[obj_type].threshold == 0);
-        }
-
+        Mem_atomic_dec(Mem[obj_type].num_obj_inuse);
+        Mem_atomic_dec(Mem_Obj_Inuse);
 #endif
-        if ( Mem_obj_in_pool(obj_type) >= Mem[obj_type].threshold)
+        if (obj_type == BLOCK_OBJECT) 
         {
 #ifndef NDEBUG
-                Mem[obj_type].num_obj--;
-                Mem[obj_type].bytes_allocated -= (sizeobj(obj_type) + sizeof(mem_header));
-                Mem_Obj_Allocated--;
-                Mem_Bytes_Allocated -= (sizeobj(obj_type) + sizeof(mem_header));
+                Mem_atomic_dec(Mem[obj_type].num_obj);
+                Mem_atomic_sub(Mem[obj_type].bytes_allocated, len + sizeof(mem_header));
+                Mem_atomic_dec(Mem_Obj_Allocated);
+                Mem_atomic_sub(Mem_Bytes_Allocated, len + sizeof(mem_header));
 #endif
                 free(mem_header_ptr(object));
+                return;
+        }
 
-        } else 
+        cache = &Mem_Cache[obj_type];
+        if (!Mem_Cache_Registered) 
         {
-                void ** body_ptr;
-                
-                body_ptr = (void **) object;
-                *body_ptr = (void *) Mem[obj_type].list_head;
-                Mem[obj_type].list_head = body_ptr;
-                Mem[obj_type].num_obj_inpool++;
+                Mem_cache_register();
+        }
+
+        body_ptr = (void **) object;
+        *body_ptr = (void *) cache->list_head;
+        cache->list_head = body_ptr;
+        cache->num_obj++;
+
+        /* Over the limit, hand half of the cache back to the shared pool, so
+         * a thread that frees what others allocate does not hoard objects */
+        if (cache->num_obj > Mem[obj_type].cache_max) 
+        {
+                Mem_cache_flush(obj_type, cache->num_obj - Mem[obj_type].cache_max / 2);
         }
 }
 /* Input: A valid pointer to an object/block created with new or mem_alloc
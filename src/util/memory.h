@@ -59,6 +59,12 @@
  * Function Declarations
  ************************************/
 
+/* new, dispose and the reference count functions may be called from any thread. Each thread
+ * keeps a small cache of free objects of each type and goes to the shared pool of the type,
+ * under its lock, only to refill or drain that cache a batch at a time. Reference counts are
+ * updated atomically. Mem_init_object and Mem_init_slab must run before other threads start.
+ */
+
 /* Input: valid object type, size of object, threshold/watermark value for this object,
  *              number of initial objects to create
  * Output: error code
@@ -71,6 +77,14 @@ int            Mem_init_object(int32u obj_type, int32u size, unsigned int thresh
 /* This calls Mem_init_object and if any error results it EXIT's with a printed error */
 void            Mem_init_object_abort( int32u obj_type, int32u size, unsigned int threshold, unsigned int initial );
 
+/* Input: valid object type already registered with Mem_init_object, number of objects per slab
+ * Output: none
+ * Effects: when the pool of this type runs dry, objs_per_slab objects are carved out of a single
+ * calloc instead of allocating one. Objects from a slab are kept in the pool rather than freed,
+ * whatever the threshold.
+ */
+void            Mem_init_slab( int32u obj_type, unsigned int objs_per_slab );
+
 /* This initializes the status reporting of the memory module and should be called from
  * status.c after the Group, Recod, and RefRecord objects are mem_init'ed.
  * After this is called each object created by Mem_init_object() will automatically
@@ -25,6 +25,10 @@
  *
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  /* sendmmsg */
+#endif
+
 #ifndef ARCH_PC_WIN95
 
 #include <netdb.h>
@@ -55,13 +59,15 @@
 #include "rep_election.h"
 
 #include "apply.h"
+#include "merkle.h"
+#include "auth.h"
+#include "io_stage.h"
+#include "sm_output.h"
 
 #ifdef SET_USE_SPINES
 #include "spines/spines_lib.h"
 #endif
 
-#define MULTICAST 0
-
 /* The globally accessible variables */
 
 extern server_variables VAR;
@@ -78,6 +84,10 @@ extern int32 sd;
 
 /* Local */
 void UTIL_Multicast( sys_scatter *scat ); 
+int32u UTIL_Multicast_From_Stage( sys_scatter *scat ); 
+#if !SITE_MULTICAST && SITE_SENDMMSG && defined(__linux__)
+void UTIL_Multicast_Batched( sys_scatter *scat );
+#endif
 void UTIL_Load_Spines_Addresses(); 
 
 int32 server_address[NUM_SITES+1][NUM_SERVER_SLOTS]; 
@@ -90,35 +100,48 @@ int32u RETRANS_null_add_count;
 
 /* Utility Functions Specific to Steward */
 
-FILE *state_machine_file;
 
 global_slot_struct* UTIL_Get_Global_Slot( int32u seq_num ) {
 
     global_slot_struct *slot;
-    stdit it;
+    global_ring_entry *entry;
     stdhash *h;
 
-    h = &GLOBAL.History; 
+    slot = UTIL_Get_Global_Slot_If_Exists( seq_num );
+
+    if ( slot != NULL ) {
+	return slot;
+    }
 
     Alarm(DEBUG,"global seq_num %d\n",seq_num);
-    
-    stdhash_find( h, &it, &seq_num );
 
-    /* If there is nothing in the slot, then create a slot. */
-    if ( stdhash_is_end( h, &it) ) {
-	/* Allocate memory for a slot. */
-	if((slot = (global_slot_struct*) new_ref_cnt(GLOBAL_SLOT_OBJ))==NULL) {
-	    Alarm(EXIT,"DAT_Get_Global_Slot:"
-		   " Could not allocate memory for slot.\n");
-	}
+    /* There is nothing in the slot, so create a slot. */
+    /* Allocate memory for a slot. */
+    if((slot = (global_slot_struct*) new_ref_cnt(GLOBAL_SLOT_OBJ))==NULL) {
+	Alarm(EXIT,"DAT_Get_Global_Slot:"
+	       " Could not allocate memory for slot.\n");
+    }
 
-	/* insert this slot in the hash */
-	memset( (void*)slot, 0, sizeof(global_slot_struct) );
-	slot->purge_view = GLOBAL.View;
- 	stdhash_insert( h, NULL, &seq_num, &slot );
-    } else {
-	slot = *((global_slot_struct**) stdhash_it_val(&it));
-    }	
+    memset( (void*)slot, 0, sizeof(global_slot_struct) );
+    slot->seq_num = seq_num;
+    slot->purge_view = GLOBAL.View;
+
+    /* Put the slot in the ring if the entry is free, or if the slot there is
+     * older and already ordered. Otherwise put it in the hash. */
+    h = &GLOBAL.History; 
+    entry = &GLOBAL.Ring[ seq_num & (SLOT_RING_SIZE - 1) ];
+
+    if ( entry->slot != NULL && 
+	 ( entry->seq_num > seq_num || entry->seq_num > GLOBAL.ARU ) ) {
+	stdhash_insert( h, NULL, &seq_num, &slot );
+	return slot;
+    }
+
+    if ( entry->slot != NULL ) {
+	stdhash_insert( h, NULL, &entry->seq_num, &entry->slot );
+    }
+    entry->seq_num = seq_num;
+    entry->slot = slot;
 
     return slot;
  
@@ -127,29 +150,43 @@ global_slot_struct* UTIL_Get_Global_Slot( int32u seq_num ) {
 pending_slot_struct* UTIL_Get_Pending_Slot( int32u seq_num ) {
 
     pending_slot_struct *slot;
-    stdit it;
+    pending_ring_entry *entry;
     stdhash *h;
 
-    h = &PENDING.History; 
-
-    stdhash_find( h, &it, &seq_num );
+    slot = UTIL_Get_Pending_Slot_If_Exists( seq_num );
 
     Alarm(DEBUG,"GET PENDING SLOT %d\n",seq_num);
 
-    /* If there is nothing in the slot, then create a slot. */
-    if ( stdhash_is_end( h, &it) ) {
-	/* Allocate memory for a slot. */
-	if((slot = (pending_slot_struct*) new_ref_cnt(PENDING_SLOT_OBJ))==NULL) {
-	    Alarm(EXIT,"DAT_Get_Pending_Slot:"
-		   " Could not allocate memory for slot.\n");
-	}
-	memset( (void*)slot, 0, sizeof(pending_slot_struct) );
-	slot->purge_view = PENDING.View;
-	/* insert this slot in the hash */
- 	stdhash_insert( h, NULL, &seq_num, &slot );
-    } else {
-	slot = *((pending_slot_struct**) stdhash_it_val(&it));
-    }	
+    if ( slot != NULL ) {
+	return slot;
+    }
+
+    /* There is nothing in the slot, so create a slot. */
+    /* Allocate memory for a slot. */
+    if((slot = (pending_slot_struct*) new_ref_cnt(PENDING_SLOT_OBJ))==NULL) {
+	Alarm(EXIT,"DAT_Get_Pending_Slot:"
+	       " Could not allocate memory for slot.\n");
+    }
+    memset( (void*)slot, 0, sizeof(pending_slot_struct) );
+    slot->seq_num = seq_num;
+    slot->purge_view = PENDING.View;
+
+    /* Put the slot in the ring if the entry is free, or if the slot there is
+     * older and already ordered. Otherwise put it in the hash. */
+    h = &PENDING.History; 
+    entry = &PENDING.Ring[ seq_num & (SLOT_RING_SIZE - 1) ];
+
+    if ( entry->slot != NULL && 
+	 ( entry->seq_num > seq_num || entry->seq_num > PENDING.ARU ) ) {
+	stdhash_insert( h, NULL, &seq_num, &slot );
+	return slot;
+    }
+
+    if ( entry->slot != NULL ) {
+	stdhash_insert( h, NULL, &entry->seq_num, &entry->slot );
+    }
+    entry->seq_num = seq_num;
+    entry->slot = slot;
 
     return slot;
 
@@ -157,45 +194,141 @@ pending_slot_struct* UTIL_Get_Pending_Slot( int32u seq_num ) {
 
 pending_slot_struct* UTIL_Get_Pending_Slot_If_Exists( int32u seq_num ) {
 
-    pending_slot_struct *slot;
+    pending_ring_entry *entry;
     stdit it;
     stdhash *h;
 
+    entry = &PENDING.Ring[ seq_num & (SLOT_RING_SIZE - 1) ];
+
+    if ( entry->slot != NULL && entry->seq_num == seq_num ) {
+	return entry->slot;
+    }
+
+    /* Not in the ring. Look in the hash. */
     h = &PENDING.History; 
 
+    if ( stdhash_empty( h ) ) {
+	return NULL;
+    }
+
     stdhash_find( h, &it, &seq_num );
 
     /* If there is nothing in the slot, then do not create a slot. */
     if ( stdhash_is_end( h, &it) ) {
 	/* There is no slot. */
-	slot = NULL;
-    } else {
-	slot = *((pending_slot_struct**) stdhash_it_val(&it));
-    }	
+	return NULL;
+    }
 
-    return slot;
+    return *((pending_slot_struct**) stdhash_it_val(&it));
 
 }
 
 global_slot_struct* UTIL_Get_Global_Slot_If_Exists( int32u seq_num ) {
 
-    global_slot_struct *slot;
+    global_ring_entry *entry;
     stdit it;
     stdhash *h;
 
+    entry = &GLOBAL.Ring[ seq_num & (SLOT_RING_SIZE - 1) ];
+
+    if ( entry->slot != NULL && entry->seq_num == seq_num ) {
+	return entry->slot;
+    }
+
+    /* Not in the ring. Look in the hash. */
     h = &GLOBAL.History; 
 
+    if ( stdhash_empty( h ) ) {
+	return NULL;
+    }
+
     stdhash_find( h, &it, &seq_num );
 
-    /* If there is nothing in the slot, then create a slot. */
+    /* If there is nothing in the slot, then do not create a slot. */
     if ( stdhash_is_end( h, &it) ) {
 	/* There is no slot. */
-	slot = NULL;
-    } else {
-	slot = *((global_slot_struct**) stdhash_it_val(&it));
-    }	
+	return NULL;
+    }
 
-    return slot;
+    return *((global_slot_struct**) stdhash_it_val(&it));
+
+}
+
+/* Remove every global slot at or below max_seq from the ring and the hash,
+ * handing each one to release. Returns the number removed. */
+int32u UTIL_Remove_Global_Slots( int32u max_seq, 
+	void (*release)( global_slot_struct *slot ) ) {
+
+    int32u i;
+    int32u count;
+    stdit it;
+    stdhash *h;
+
+    count = 0;
+
+    for ( i = 0; i < SLOT_RING_SIZE; i++ ) {
+	if ( GLOBAL.Ring[i].slot != NULL && 
+	     GLOBAL.Ring[i].seq_num <= max_seq ) {
+	    release( GLOBAL.Ring[i].slot );
+	    GLOBAL.Ring[i].slot = NULL;
+	    count++;
+	}
+    }
+
+    h = &GLOBAL.History;
+
+    stdhash_begin( h, &it );
+    while ( !stdhash_is_end( h, &it ) ) {
+	if ( *(int32u*)stdhash_it_key( &it ) > max_seq ) {
+	    stdhash_it_next( &it );
+	    continue;
+	}
+	release( *((global_slot_struct**) stdhash_it_val( &it )) );
+	/* Moves the iterator on */
+	stdhash_erase( h, &it );
+	count++;
+    }
+
+    return count;
+
+}
+
+/* Remove every pending slot at or below max_seq from the ring and the hash,
+ * handing each one to release. Returns the number removed. */
+int32u UTIL_Remove_Pending_Slots( int32u max_seq, 
+	void (*release)( pending_slot_struct *slot ) ) {
+
+    int32u i;
+    int32u count;
+    stdit it;
+    stdhash *h;
+
+    count = 0;
+
+    for ( i = 0; i < SLOT_RING_SIZE; i++ ) {
+	if ( PENDING.Ring[i].slot != NULL && 
+	     PENDING.Ring[i].seq_num <= max_seq ) {
+	    release( PENDING.Ring[i].slot );
+	    PENDING.Ring[i].slot = NULL;
+	    count++;
+	}
+    }
+
+    h = &PENDING.History;
+
+    stdhash_begin( h, &it );
+    while ( !stdhash_is_end( h, &it ) ) {
+	if ( *(int32u*)stdhash_it_key( &it ) > max_seq ) {
+	    stdhash_it_next( &it );
+	    continue;
+	}
+	release( *((pending_slot_struct**) stdhash_it_val( &it )) );
+	/* Moves the iterator on */
+	stdhash_erase( h, &it );
+	count++;
+    }
+
+    return count;
 
 }
 
@@ -216,22 +349,33 @@ void UTIL_Initialize() {
     char name[100];
 
     /* Construct the hashes to store the histories these will store a global
-     * slot and a pending slot */
+     * slot and a pending slot. Most slots are kept in the rings instead. */
     stdhash_construct( &GLOBAL.History, sizeof(int32u), 
 	sizeof(global_slot_struct*), NULL, NULL, 0 ); 
 
     stdhash_construct( &PENDING.History, sizeof(int32u), 
 	sizeof(pending_slot_struct*), NULL, NULL, 0 ); 
 
+    memset( GLOBAL.Ring, 0, sizeof(GLOBAL.Ring) );
+    memset( PENDING.Ring, 0, sizeof(PENDING.Ring) );
+
     /* INIT memory */
 
     Mem_init_object_abort(GLOBAL_SLOT_OBJ, sizeof(global_slot_struct), 200, 20);
+    Mem_init_slab(GLOBAL_SLOT_OBJ, 32);
 
     Mem_init_object_abort(PENDING_SLOT_OBJ, sizeof(pending_slot_struct), 200,
 	    20);
+    Mem_init_slab(PENDING_SLOT_OBJ, 32);
 
     Mem_init_object_abort(DLL_NODE_OBJ, sizeof(dll_node_struct), 200, 20);
 
+    Mem_init_object_abort(MESS_SMALL_OBJ, MESS_SMALL_SIZE, 1000, 0);
+    Mem_init_slab(MESS_SMALL_OBJ, 64);
+
+    Mem_init_object_abort(MESS_MEDIUM_OBJ, MESS_MEDIUM_SIZE, 1000, 0);
+    Mem_init_slab(MESS_MEDIUM_OBJ, 64);
+
 
     /* Init counters for messages that are received. */
     for ( mcindex = 0; mcindex < MAX_MESS_TO_COUNT; mcindex++ ) {
@@ -243,11 +387,7 @@ void UTIL_Initialize() {
     sprintf(name,"state_machine_out.%02d_%02d.log",
 	    VAR.My_Site_ID,VAR.My_Server_ID);
 
-    state_machine_file = fopen( name, "w" );
-
-    if ( state_machine_file == NULL ) {
-	Alarm(PRINT,"Failed to open state machine output file.\n");
-    }
+    SMOUT_Initialize( name );
 #endif
 
     /* Used for debugging */
@@ -267,6 +407,65 @@ signed_message* UTIL_New_Signed_Message() {
     return mess;
 }
 
+/* The object type of the smallest buffer that holds bytes bytes of message. */
+static int32u UTIL_Message_Obj_Type( int32u bytes ) {
+
+    if ( bytes <= MESS_SMALL_SIZE ) {
+	return MESS_SMALL_OBJ;
+    }
+    if ( bytes <= MESS_MEDIUM_SIZE ) {
+	return MESS_MEDIUM_OBJ;
+    }
+    return PACK_BODY_OBJ;
+}
+
+/* Allocate a signed message whose content will be content_len bytes, in the
+ * smallest buffer that holds it. The content must not grow afterwards. */
+signed_message* UTIL_New_Signed_Message_Size( int32u content_len ) {
+
+    signed_message *mess;
+    int32u bytes;
+
+    bytes = sizeof(signed_message) + content_len;
+#if MERKLE_AGGREGATION
+    /* Leave room for an authentication path */
+    bytes += MERKLE_MAX_PATH_BYTES;
+#endif
+
+    if((mess = (signed_message*) 
+		new_ref_cnt(UTIL_Message_Obj_Type(bytes)))==NULL) {
+	Alarm(EXIT,"UTIL_New_Signed_Message_Size: Could not allocate memory "
+		"for message.\n");
+    }
+
+    return mess;
+}
+
+/* Return a received message of num_bytes bytes in the smallest buffer that
+ * holds it. If that is a packet_body, or the message is already in a smaller
+ * buffer, the message itself is returned. Either way the caller gets a
+ * reference of its own to the result. */
+signed_message* UTIL_Compact_Message( signed_message *mess, int32u num_bytes ) {
+
+    signed_message *compact;
+    int32u obj_type;
+
+    obj_type = UTIL_Message_Obj_Type( num_bytes );
+
+    if ( obj_type == PACK_BODY_OBJ || Mem_Obj_Type( mess ) != PACK_BODY_OBJ ) {
+	inc_ref_cnt( mess );
+	return mess;
+    }
+
+    if((compact = (signed_message*) new_ref_cnt(obj_type))==NULL) {
+	Alarm(EXIT,"UTIL_Compact_Message: Could not allocate memory for "
+		"message.\n");
+    }
+    memcpy( compact, mess, num_bytes );
+
+    return compact;
+}
+
 int32u UTIL_Leader_Site() {
     int32u rep;
     rep = GLOBAL.View % NUM_SITES;
@@ -295,10 +494,53 @@ int32u UTIL_I_Am_Representative() {
     return 0;
 }
 
+/* Updates the server state shown before each Alarm line (representative,
+ * leader site, constraint, the two views, and the global ARU). Called on the
+ * event loop where the views, the global ARU, or the CCS state change, so
+ * that threads logging elsewhere never read it. */
+void UTIL_Refresh_Alarm_Prefix() {
+    static int32u last_gview = 0xffffffff, last_pview, last_aru;
+    static char last_flags[3];
+    char flags[3];
+    char prefix[ALARM_PREFIX_SIZE];
+
+    flags[0] = UTIL_I_Am_Representative() ? 'R' : ' ';
+    flags[1] = UTIL_I_Am_In_Leader_Site() ? 'L' : ' ';
+    if ( CCS_Am_I_Constrained_In_Pending_Context() ) {
+	flags[2] = CCS_Is_Globally_Constrained() ? 'B' : 'P';
+    } else {
+	flags[2] = CCS_Is_Globally_Constrained() ? 'G' : ' ';
+    }
+
+    if ( GLOBAL.View == last_gview && PENDING.View == last_pview &&
+	 GLOBAL.ARU == last_aru && memcmp(flags, last_flags, 3) == 0 ) {
+	return;
+    }
+    last_gview = GLOBAL.View;
+    last_pview = PENDING.View;
+    last_aru   = GLOBAL.ARU;
+    memcpy(last_flags, flags, 3);
+
+    snprintf(prefix, sizeof(prefix), "%c%c%c %d %d %d ",
+	     flags[0], flags[1], flags[2], 
+	     GLOBAL.View, PENDING.View, GLOBAL.ARU);
+    Alarm_set_prefix(prefix);
+}
+
 void UTIL_RSA_Sign_Message( signed_message *mess ) {
 
     util_stopwatch w;
 
+    /* Local-area messages may carry MACs instead of a signature */
+    if ( AUTH_Authenticate_Message( mess ) ) {
+	return;
+    }
+
+    /* Ordering messages may be signed later under a Merkle root */
+    if ( MERKLE_Aggregate_Message( mess ) ) {
+	return;
+    }
+
     UTIL_Stopwatch_Start( &w );
     /* Sign this message */
     OPENSSL_RSA_Sign( ((byte*)mess) + SIGNATURE_SIZE, 
@@ -322,6 +564,10 @@ void UTIL_Site_Broadcast( signed_message *mess ) {
     //accept_message *accept_specific;
     //pre_prepare_message *pre_prepare_specific;
 
+    if ( MERKLE_Defer_Send( mess, MERKLE_SEND_SITE, 0, 0 ) ) {
+	return;
+    }
+
 #if 0 
     // BYZ_CODE
     /* Just loose a few packets */
@@ -367,7 +613,7 @@ void UTIL_Site_Broadcast( signed_message *mess ) {
 	VAR.My_Site_ID, VAR.My_Server_ID, mess->type, sig_share_type, seq );
 
     scat.num_elements = 1;
-    scat.elements[0].len = mess->len + sizeof(signed_message);
+    scat.elements[0].len = MERKLE_Message_Bytes( mess );
     scat.elements[0].buf = (char*)mess;
     UTIL_Multicast(&scat);
  
@@ -386,9 +632,13 @@ void UTIL_Send_To_Server( signed_message *mess, int32u site_id, int32u server_id
 #ifdef SET_USE_SPINES
     struct sockaddr_in dest_addr;
 #endif
+
+    if ( MERKLE_Defer_Send( mess, MERKLE_SEND_SERVER, site_id, server_id ) ) {
+	return;
+    }
     
     scat.num_elements = 1;
-    scat.elements[0].len = mess->len + sizeof(signed_message);
+    scat.elements[0].len = MERKLE_Message_Bytes( mess );
     scat.elements[0].buf = (char*)mess;
 
     /* Get address */
@@ -410,14 +660,22 @@ void UTIL_Send_To_Server( signed_message *mess, int32u site_id, int32u server_id
 	dest_addr.sin_addr.s_addr = htonl(address);
 
 	ret = spines_sendto(NET.Spines_Channel, mess, 
-		            mess->len + sizeof(signed_message), 0, 
+		            MERKLE_Message_Bytes( mess ), 0, 
 		(struct sockaddr *)&dest_addr, sizeof(struct sockaddr));
     } else {
 	address = UTIL_Get_Server_Address( site_id, server_id );
+	if ( IOSTAGE_Send( NET.Send_Channel, &address, 1, NET.Port, 
+		    (byte*)mess, scat.elements[0].len ) ) {
+	    return;
+	}
 	ret = DL_send(NET.Send_Channel, address, NET.Port, &scat);
     }
 #else
     address = UTIL_Get_Server_Address( site_id, server_id );
+    if ( IOSTAGE_Send( NET.Send_Channel, &address, 1, NET.Port, 
+		(byte*)mess, scat.elements[0].len ) ) {
+	return;
+    }
     ret = DL_send(NET.Send_Channel, address, NET.Port, &scat);
 #endif
 
@@ -432,14 +690,17 @@ void UTIL_Send_To_Server( signed_message *mess, int32u site_id, int32u server_id
 void UTIL_Multicast( sys_scatter *scat ) {
 
     int ret;
-#if MULTICAST
-#else    
+#if !SITE_MULTICAST
     int32u sindex;
 #endif
     
     /* Pseudo Multicast or True Multicast */
 
-#if MULTICAST    
+    if ( scat->num_elements == 1 && UTIL_Multicast_From_Stage( scat ) ) {
+	return;
+    }
+
+#if SITE_MULTICAST    
     ret = DL_send(NET.Send_Channel, NET.Mcast_Address, NET.Port, scat);
     if(ret <= 0) {
 	Alarm(EXIT, "BFT_Multicast (True multicast): socket error\n");
@@ -451,6 +712,13 @@ void UTIL_Multicast( sys_scatter *scat ) {
 
     Alarm(DEBUG,"PSEUDO MCAST\n");
 
+#if SITE_SENDMMSG && defined(__linux__)
+    if ( scat->num_elements == 1 ) {
+	UTIL_Multicast_Batched( scat );
+	return;
+    }
+#endif
+
     for ( sindex = 1; sindex <= NUM_SERVERS_IN_SITE; sindex++) {
         ret = DL_send(NET.Send_Channel, UTIL_Get_Server_Address(VAR.My_Site_ID,sindex), NET.Port, scat);
 	if(ret <= 0) {
@@ -462,6 +730,79 @@ void UTIL_Multicast( sys_scatter *scat ) {
     
 }
 
+/* Hand a site broadcast to the sender thread. Returns 0 if there is none. */
+int32u UTIL_Multicast_From_Stage( sys_scatter *scat ) {
+
+#if SITE_MULTICAST    
+    return IOSTAGE_Send( NET.Send_Channel, &NET.Mcast_Address, 1, NET.Port,
+	    (byte*)scat->elements[0].buf, scat->elements[0].len );
+#else
+    int32 address[NUM_SERVERS_IN_SITE];
+    int32u sindex;
+
+    for ( sindex = 1; sindex <= NUM_SERVERS_IN_SITE; sindex++ ) {
+	address[sindex-1] = UTIL_Get_Server_Address(VAR.My_Site_ID,sindex);
+    }
+    return IOSTAGE_Send( NET.Send_Channel, address, NUM_SERVERS_IN_SITE, 
+	    NET.Port, (byte*)scat->elements[0].buf, scat->elements[0].len );
+#endif
+}
+
+#if !SITE_MULTICAST && SITE_SENDMMSG && defined(__linux__)
+void UTIL_Multicast_Batched( sys_scatter *scat ) {
+
+    /* Send one copy of a single element scatter to each server in the site
+     * with one sendmmsg call. The destination addresses are built the first
+     * time through, after the address file has been loaded. */
+
+    static struct sockaddr_in dest[NUM_SERVERS_IN_SITE];
+    static struct mmsghdr     msgs[NUM_SERVERS_IN_SITE];
+    static int32u             built_site = 0;
+    struct iovec iov;
+    int32u sindex, sent;
+    int ret;
+
+    if ( built_site != VAR.My_Site_ID ) {
+	memset( dest, 0, sizeof(dest) );
+	memset( msgs, 0, sizeof(msgs) );
+	for ( sindex = 0; sindex < NUM_SERVERS_IN_SITE; sindex++ ) {
+	    dest[sindex].sin_family      = AF_INET;
+	    dest[sindex].sin_port        = htons(NET.Port);
+	    dest[sindex].sin_addr.s_addr = 
+		htonl(UTIL_Get_Server_Address(VAR.My_Site_ID,sindex+1));
+	    msgs[sindex].msg_hdr.msg_name    = &dest[sindex];
+	    msgs[sindex].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	}
+	built_site = VAR.My_Site_ID;
+    }
+
+    iov.iov_base = scat->elements[0].buf;
+    iov.iov_len  = scat->elements[0].len;
+    for ( sindex = 0; sindex < NUM_SERVERS_IN_SITE; sindex++ ) {
+	msgs[sindex].msg_hdr.msg_iov    = &iov;
+	msgs[sindex].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* sendmmsg may stop early; finish the rest one at a time so that DL_send
+     * handles any transient send errors. */
+    sent = 0;
+    ret = sendmmsg( NET.Send_Channel, msgs, NUM_SERVERS_IN_SITE, 0 );
+    if ( ret > 0 ) {
+	sent = ret;
+    }
+
+    for ( sindex = sent + 1; sindex <= NUM_SERVERS_IN_SITE; sindex++ ) {
+        ret = DL_send(NET.Send_Channel, UTIL_Get_Server_Address(VAR.My_Site_ID,sindex), NET.Port, scat);
+	if(ret <= 0) {
+	    Alarm(EXIT, "BFT_Multicast (Unicast): socket error\n");
+	}
+    }
+
+    Alarm(DEBUG,"%d %d Batched site send, %d in one call\n",
+	    VAR.My_Site_ID, VAR.My_Server_ID, sent );
+}
+#endif
+
 /* Load addresses of all servers from a configuration file */
 
 void UTIL_Load_Addresses() {
@@ -756,6 +1097,11 @@ void UTIL_Send_To_Client( int32 address, int32u site, int32u id, signed_message
 	    len );
 
     Alarm(DEBUG,"SOCKET: %d\n",sd);
+    if ( IOSTAGE_Send( sd, &address, 1, 
+		NET.Port+2+id+(site*NUM_SERVERS_IN_SITE),
+		(byte*)mess, mess->len+sizeof(signed_message) ) ) {
+	return;
+    }
     ret = sendto(sd, (char *)mess, mess->len+sizeof(signed_message), 0, 
 		 (struct sockaddr *)&cli_addr, len);
     if(ret < 0) {
@@ -1144,6 +1490,64 @@ void UTIL_Update_CCS_STATE_GLOBAL( int32u seq_num ) {
     }
 }
 
+/* Returns the first update of a batch when current is NULL and the update
+ * following current otherwise. The updates of a batch are signed messages
+ * stored back to back in batch_len bytes. NULL is returned when no further
+ * complete update fits in the batch. */
+signed_message* UTIL_Next_Batched_Update( byte *batch, int32u batch_len, 
+	signed_message *current ) {
+
+    int32u offset;
+    signed_message *next;
+
+    if ( current == NULL ) {
+	offset = 0;
+    } else {
+	offset = ((byte*)current - batch) + sizeof(signed_message) + 
+	    current->len;
+    }
+
+    if ( offset >= batch_len || 
+	 batch_len - offset < sizeof(signed_message) ) {
+	return NULL;
+    }
+
+    next = (signed_message*)(batch + offset);
+
+    if ( next->len > batch_len - offset - sizeof(signed_message) ) {
+	return NULL;
+    }
+
+    return next;
+
+}
+
+/* Returns 1 if the batch carried by the proposal contains an update that is
+ * byte for byte identical to the specified update, 0 otherwise. */
+int32u UTIL_Proposal_Contains_Update( signed_message *proposal, 
+	signed_message *update ) {
+
+    signed_message *batched;
+    byte *batch;
+    int32u batch_len;
+
+    batch = ((byte*)(proposal+1)) + sizeof(proposal_message);
+    batch_len = proposal->len - sizeof(proposal_message);
+
+    for ( batched = UTIL_Next_Batched_Update( batch, batch_len, NULL );
+	  batched != NULL;
+	  batched = UTIL_Next_Batched_Update( batch, batch_len, batched ) ) {
+	if ( batched->len == update->len &&
+	     memcmp( batched, update, 
+		     update->len + sizeof(signed_message) ) == 0 ) {
+	    return 1;
+	}
+    }
+
+    return 0;
+
+}
+
 /* Apply an update to the state machine */
 void UTIL_Apply_Update_To_State_Machine( signed_message *proposal ) {
 
@@ -1152,7 +1556,10 @@ void UTIL_Apply_Update_To_State_Machine( signed_message *proposal ) {
     signed_message *update;
     proposal_message *proposal_specific;
     update_message *update_specific;
-    char *content;
+    byte *batch;
+    int32u batch_len;
+    char line[80];
+    int len;
 
     /* Check that the message is a proposal */
     if ( proposal->type != PROPOSAL_TYPE ) {
@@ -1161,20 +1568,24 @@ void UTIL_Apply_Update_To_State_Machine( signed_message *proposal ) {
     }
 
     proposal_specific = (proposal_message*)(proposal+1);
-    update = (signed_message*)(proposal_specific+1);
-    update_specific = (update_message*)(update+1);
-    content = (char*)(update_specific+1);
-
-    /* Print small message to the file. */
-    fprintf(state_machine_file,"%d cli:%d site:%d time_stamp:%d\n",
+    batch = (byte*)(proposal_specific+1);
+    batch_len = proposal->len - sizeof(proposal_message);
+
+    /* Print a small message to the file for each update in the batch. The
+     * updates are applied in the order in which they appear in the batch. */
+    for ( update = UTIL_Next_Batched_Update( batch, batch_len, NULL );
+	  update != NULL;
+	  update = UTIL_Next_Batched_Update( batch, batch_len, update ) ) {
+	update_specific = (update_message*)(update+1);
+	len = snprintf(line, sizeof(line), "%d cli:%d site:%d time_stamp:%d\n",
 	    proposal_specific->seq_num,   /* The global sequence number */
 	    update->machine_id,           /* The id of the client */
 	    update->site_id,              /* The site of the client */
 	    update_specific->time_stamp   /* The time stamp of client */
 	    /*content */                  /* some data */
 	    );
-
-    //fflush(0);
+	SMOUT_Append( line, len );
+    }
 
 #endif
 }
@@ -1237,23 +1648,17 @@ int32u UTIL_CLIENT_Process_Update( signed_message *update ) {
 	gs = UTIL_Get_Global_Slot_If_Exists(
 	       CLIENT.client[ cli_site ][ cli_id ].global_seq_num );
 
+	/* The slot is freed once a stable checkpoint covers it */
 	if ( gs == NULL ) {
 	    CLI_ERR("Global slot NULL");
-	}
-
-	if ( !gs->is_ordered ) {
+	} else if ( !gs->is_ordered ) {
 	    CLI_ERR("Global slot not ordered.");
-	}
-
-	if ( gs->proposal == NULL ) {
+	} else if ( gs->proposal == NULL ) {
 	    CLI_ERR("Proposal NULL");
 	}
 
-	if ( memcmp( 
-		    update,
-		    ((byte*)(gs->proposal+1))+(sizeof(proposal_message)),
-		    update->len + sizeof(signed_message)
-		    ) != 0 ) {
+	if ( gs != NULL && gs->proposal != NULL &&
+	     !UTIL_Proposal_Contains_Update( gs->proposal, update ) ) {
 	    CLI_ERR("Updates don't match");
 	}
 	/* I don't need to forward the update, I don't need to inject it, I'm
@@ -1302,8 +1707,9 @@ void UTIL_CLIENT_Process_Globally_Ordered_Proposal( signed_message *proposal ) {
     signed_message *update;
     update_message *update_specific;
     int32u cli_id;
-    int32u cli_ts;
     int32u cli_site;
+    byte *batch;
+    int32u batch_len;
 
     if ( proposal == NULL ) {
 	Alarm(DEBUG,"UTIL_CLIENT_Process_Globally_Ordered_Proposal: "
@@ -1312,21 +1718,32 @@ void UTIL_CLIENT_Process_Globally_Ordered_Proposal( signed_message *proposal ) {
     }
 
     proposal_specific = (proposal_message*)(proposal+1);
-    
-    update = (signed_message*)(proposal_specific + 1);
-    update_specific = (update_message*)(update+1);
+    batch = (byte*)(proposal_specific + 1);
+    batch_len = proposal->len - sizeof(proposal_message);
 
-    cli_id = update->machine_id;
-    cli_site = update->site_id;
-    cli_ts = update_specific->time_stamp;
+    /* Every update in the batch was ordered at this sequence number */
+    for ( update = UTIL_Next_Batched_Update( batch, batch_len, NULL );
+	  update != NULL;
+	  update = UTIL_Next_Batched_Update( batch, batch_len, update ) ) {
+
+	update_specific = (update_message*)(update+1);
 
-    if ( update_specific->time_stamp > 
-	 CLIENT.client[ cli_site ][ cli_id ].globally_ordered_time_stamp ) {
-	/* Replace */
-	CLIENT.client[ cli_site ][ cli_id ].globally_ordered_time_stamp = 
-	    update_specific->time_stamp;
-	CLIENT.client[ cli_site ][ cli_id ].global_seq_num = 
-	    proposal_specific->seq_num;
+	cli_id = update->machine_id;
+	cli_site = update->site_id;
+
+	if ( cli_site < 1 || cli_site > NUM_SITES || 
+	     cli_id < 1 || cli_id > NUM_CLIENTS ) {
+	    continue;
+	}
+
+	if ( update_specific->time_stamp > 
+	     CLIENT.client[ cli_site ][ cli_id ].globally_ordered_time_stamp ) {
+	    /* Replace */
+	    CLIENT.client[ cli_site ][ cli_id ].globally_ordered_time_stamp = 
+		update_specific->time_stamp;
+	    CLIENT.client[ cli_site ][ cli_id ].global_seq_num = 
+		proposal_specific->seq_num;
+	}
     }
 
 }
@@ -1367,6 +1784,11 @@ void UTIL_CLIENT_Respond_To_Client(signed_message *update, int32u seq_num)
 
   ordered_proof = GRECON_Construct_Ordered_Proof_Message( seq_num );  
 
+  /* The slot may have been freed at a stable checkpoint */
+  if ( ordered_proof == NULL ) {
+    return;
+  }
+
   UTIL_Send_To_Client( update_specific->address, update->site_id, 
   		       update->machine_id, ordered_proof );
   
@@ -1587,6 +2009,11 @@ int32u UTIL_ATTACK_Len( int32u type ) {
 	case GLOBAL_RECONCILIATION_TYPE: 
 	  return sizeof(signed_message) + 
 	    sizeof(global_reconciliation_message);
+	case CHECKPOINT_TYPE:
+	  return sizeof(signed_message) + sizeof(checkpoint_message);
+	case CHECKPOINT_REPLY_TYPE:
+	  return sizeof(signed_message) * 2 + sizeof(checkpoint_reply_message) +
+	    sizeof(checkpoint_message);
 	case COMPLETE_ORDERED_PROOF_TYPE: 
 
 	case CCS_INVOCATION_TYPE:
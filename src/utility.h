@@ -44,10 +44,20 @@ pending_slot_struct* UTIL_Get_Pending_Slot( int32u seq_num );
 
 pending_slot_struct* UTIL_Get_Pending_Slot_If_Exists( int32u seq_num );
 
+int32u UTIL_Remove_Global_Slots( int32u max_seq, 
+	void (*release)( global_slot_struct *slot ) );
+
+int32u UTIL_Remove_Pending_Slots( int32u max_seq, 
+	void (*release)( pending_slot_struct *slot ) );
+
 void UTIL_Initialize();
 
 signed_message* UTIL_New_Signed_Message();
 
+signed_message* UTIL_New_Signed_Message_Size( int32u content_len );
+
+signed_message* UTIL_Compact_Message( signed_message *mess, int32u num_bytes );
+
 int32u UTIL_Leader_Site(); 
 
 int32u UTIL_Representative(); 
@@ -58,6 +68,8 @@ int32u UTIL_I_Am_In_Leader_Site();
 
 int32u UTIL_I_Am_Representative(); 
 
+void UTIL_Refresh_Alarm_Prefix();
+
 void UTIL_RSA_Sign_Message( signed_message *mess ); 
 
 void UTIL_Site_Broadcast( signed_message *mess ); 
@@ -170,6 +182,14 @@ void UTIL_Dump_Mess_Count();
 
 void UTIL_Apply_Update_To_State_Machine( signed_message *proposal ); 
 
+/* Update batches */
+
+signed_message* UTIL_Next_Batched_Update( byte *batch, int32u batch_len, 
+	signed_message *current ); 
+
+int32u UTIL_Proposal_Contains_Update( signed_message *proposal, 
+	signed_message *update ); 
+
 /* CCS Utilities called by functions external to CCS */
 
 void UTIL_Update_CCS_STATE_PENDING( int32u seq_num ); 
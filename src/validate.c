@@ -29,10 +29,14 @@
  * came from the server or site that should have sent them and check to make
  * sure that the lengths are correct. */
 
+#include <string.h>
+#include <pthread.h>
 #include "validate.h"
 #include "data_structs.h"
 #include "error_wrapper.h"
 #include "openssl_rsa.h"
+#include "merkle.h"
+#include "auth.h"
 #include "construct_collective_state_protocol.h"
 #include "construct_collective_state_util.h"
 #include "utility.h"
@@ -40,16 +44,47 @@
 
 extern server_variables VAR;
 
+#if VAL_SIG_CACHE_SIZE
+/* Signatures that have already been verified. The cache is also used by the
+ * verification threads, so it is protected by a lock. */
+typedef struct dummy_val_sig_cache_entry {
+    byte   digest[DIGEST_SIZE];
+    int32u sig_type;
+    int32u sender_id;
+    int32u site_id;
+    int32u valid;
+} val_sig_cache_entry;
+
+static val_sig_cache_entry val_sig_cache[VAL_SIG_CACHE_SIZE];
+static pthread_mutex_t val_sig_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /* Local Functions */
+int32u VAL_Check_Signature( int32u sig_type, int32u sender_id, 
+	int32u site_id, signed_message *mess ); 
+
+#if VAL_SIG_CACHE_SIZE
+val_sig_cache_entry* VAL_Sig_Cache_Entry( byte *digest ); 
+
+int32u VAL_Sig_Cache_Lookup( int32u sig_type, int32u sender_id, 
+	int32u site_id, byte *digest ); 
+
+void VAL_Sig_Cache_Insert( int32u sig_type, int32u sender_id, 
+	int32u site_id, byte *digest ); 
+#endif
+
 int32u VAL_Signature_Type( int32u message_type ); 
 
 int32u VAL_Validate_Sender( int32u sig_type, int32u sender_id ); 
 
-int32u VAL_Validate_Signed_Message( signed_message *mess, int32u num_bytes, 
-       int32u verify_signature ); 
+int32u VAL_Validate_Message_Contents( signed_message *message, 
+	int32u num_bytes, int32u verify_signature ); 
 
 int32u VAL_Validate_Update( update_message *update, int32u num_bytes ); 
 
+int32u VAL_Validate_Update_Batch( byte *batch, int32u num_bytes, 
+	int32u verify_signature ); 
+
 int32u VAL_Validate_Query_Message(query_message *query, int32u num_bytes);
 
 int32u VAL_Validate_Pre_Prepare( pre_prepare_message *pre_prepare, 
@@ -80,6 +115,11 @@ int32u VAL_Validate_Local_Reconciliation( local_reconciliation_message *l_new_re
 
 int32u VAL_Validate_Global_Reconciliation(global_reconciliation_message *grecon, int32u num_bytes);
 
+int32u VAL_Validate_Checkpoint( checkpoint_message *ckpt, int32u num_bytes ); 
+
+int32u VAL_Validate_Checkpoint_Reply( checkpoint_reply_message *reply, 
+	int32u num_bytes ); 
+
 int32u VAL_Validate_Ordered_Proof( ordered_proof_message *ordered_proof, int32u num_bytes ); 
 
 int32u VAL_Validate_CCS_Invocation_Message( signed_message *invocation,
@@ -124,7 +164,8 @@ int32u VAL_Signature_Type( int32u message_type ) {
          mt == CCS_INVOCATION_TYPE ||
 	 mt == CCS_REPORT_TYPE ||
 	 mt == CCS_DESCRIPTION_TYPE ||
-	 mt == GLOBAL_RECONCILIATION_TYPE
+	 mt == GLOBAL_RECONCILIATION_TYPE ||
+	 mt == CHECKPOINT_REPLY_TYPE
 	 ) {
 	return VAL_SIG_TYPE_SERVER;
     }
@@ -133,7 +174,8 @@ int32u VAL_Signature_Type( int32u message_type ) {
 	 mt == ACCEPT_TYPE   ||
 	 mt == CCS_UNION_TYPE ||
          mt == SITE_GLOBAL_VIEW_CHANGE_TYPE ||
-         mt == SITE_LOCAL_VIEW_PROOF_TYPE ) {
+         mt == SITE_LOCAL_VIEW_PROOF_TYPE ||
+	 mt == CHECKPOINT_TYPE ) {
 	return VAL_SIG_TYPE_SITE;
     }	
 
@@ -183,7 +225,13 @@ int32u VAL_Validate_Signed_Message( signed_message *mess, int32u num_bytes,
         return 0;
     }
     
-    if ( num_bytes != mess->len + sizeof(signed_message) ) {
+    if ( MERKLE_Is_Aggregated_Type( mess->type ) ) {
+	/* The content is followed by a Merkle authentication path */
+	if ( !MERKLE_Validate_Path_Length( mess, num_bytes ) ) {
+	    VALIDATE_FAILURE("");
+	    return 0;
+	}
+    } else if ( num_bytes != mess->len + sizeof(signed_message) ) {
 	VALIDATE_FAILURE("");
  	return 0;
     }
@@ -198,7 +246,8 @@ int32u VAL_Validate_Signed_Message( signed_message *mess, int32u num_bytes,
     if ( sig_type == VAL_SIG_TYPE_SERVER && 
 	    mess->site_id != VAR.My_Site_ID && 
 	    mess->type != ORDERED_PROOF_TYPE && 
-	    mess->type != GLOBAL_RECONCILIATION_TYPE  ) {
+	    mess->type != GLOBAL_RECONCILIATION_TYPE &&
+	    mess->type != CHECKPOINT_REPLY_TYPE ) {
 	VALIDATE_FAILURE("");
 	return 0;
     }
@@ -216,7 +265,8 @@ int32u VAL_Validate_Signed_Message( signed_message *mess, int32u num_bytes,
  	return 0;
     }
     
-    if ( !VAL_Is_Valid_Signature( sig_type, sender_id, mess->site_id, mess ) )
+    if ( verify_signature &&
+	 !VAL_Is_Valid_Signature( sig_type, sender_id, mess->site_id, mess ) )
     {
 	VALIDATE_FAILURE("");
         return 0;
@@ -225,14 +275,124 @@ int32u VAL_Validate_Signed_Message( signed_message *mess, int32u num_bytes,
     return 1; /* Passed all checks */
 }
 
+/* Check the outer signature of a received packet on a verification thread.
+ * This must not touch protocol state, so messages signed under a Merkle root
+ * (whose verified roots are cached on the event loop) are left for the event
+ * loop. Returns one of the VAL_SIG_* results. */
+int32u VAL_Check_Packet_Signature( signed_message *mess, int32u num_bytes ) {
+
+    if ( num_bytes < sizeof(signed_message) ) {
+	return VAL_SIG_INVALID;
+    }
+
+    if ( MERKLE_Is_Aggregated_Type( mess->type ) ) {
+	return VAL_SIG_UNCHECKED;
+    }
+
+    if ( VAL_Validate_Signed_Message( mess, num_bytes, 1 ) ) {
+	return VAL_SIG_VALID;
+    }
+
+    return VAL_SIG_INVALID;
+}
+
 /* Determine if the signature is valid. Assume that the lengths of the message
- * is okay. */
+ * is okay. A signature that has been verified before is found in the cache
+ * and not checked again. */
 int32u VAL_Is_Valid_Signature( int32u sig_type, int32u sender_id, 
 	int32u site_id, signed_message *mess ) {
 
+#if VAL_SIG_CACHE_SIZE
+    byte digest[DIGEST_SIZE];
+
+    if ( MERKLE_Is_Aggregated_Type( mess->type ) ) {
+	/* Verified Merkle roots are cached by the Merkle code */
+	return VAL_Check_Signature( sig_type, sender_id, site_id, mess );
+    }
+
+    if ( AUTH_Scheme( mess->type ) == AUTH_SCHEME_MAC ) {
+	/* A MAC costs less to check than to look up */
+	return VAL_Check_Signature( sig_type, sender_id, site_id, mess );
+    }
+
+    /* The digest covers the signature as well as the signed bytes */
+    OPENSSL_RSA_Make_Digest( (byte*)mess, 
+	    mess->len + sizeof(signed_message), digest );
+
+    if ( VAL_Sig_Cache_Lookup( sig_type, sender_id, site_id, digest ) ) {
+	return 1;
+    }
+
+    if ( !VAL_Check_Signature( sig_type, sender_id, site_id, mess ) ) {
+	return 0;
+    }
+
+    VAL_Sig_Cache_Insert( sig_type, sender_id, site_id, digest );
+    return 1;
+#else
+    return VAL_Check_Signature( sig_type, sender_id, site_id, mess );
+#endif
+}
+
+#if VAL_SIG_CACHE_SIZE
+val_sig_cache_entry* VAL_Sig_Cache_Entry( byte *digest ) {
+
+    int32u index;
+
+    memcpy( &index, digest, sizeof(int32u) );
+    return &val_sig_cache[index & (VAL_SIG_CACHE_SIZE - 1)];
+}
+
+int32u VAL_Sig_Cache_Lookup( int32u sig_type, int32u sender_id, 
+	int32u site_id, byte *digest ) {
+
+    val_sig_cache_entry *entry;
+    int32u found;
+
+    pthread_mutex_lock( &val_sig_cache_lock );
+    entry = VAL_Sig_Cache_Entry( digest );
+    found = entry->valid &&
+	    entry->sig_type == sig_type &&
+	    entry->sender_id == sender_id &&
+	    entry->site_id == site_id &&
+	    OPENSSL_RSA_Digests_Equal( entry->digest, digest );
+    pthread_mutex_unlock( &val_sig_cache_lock );
+
+    return found;
+}
+
+void VAL_Sig_Cache_Insert( int32u sig_type, int32u sender_id, 
+	int32u site_id, byte *digest ) {
+
+    val_sig_cache_entry *entry;
+
+    pthread_mutex_lock( &val_sig_cache_lock );
+    entry = VAL_Sig_Cache_Entry( digest );
+    memcpy( entry->digest, digest, DIGEST_SIZE );
+    entry->sig_type  = sig_type;
+    entry->sender_id = sender_id;
+    entry->site_id   = site_id;
+    entry->valid     = 1;
+    pthread_mutex_unlock( &val_sig_cache_lock );
+}
+#endif
+
+/* Check the signature on a message with RSA, a MAC, the Merkle code, or the
+ * threshold library. */
+int32u VAL_Check_Signature( int32u sig_type, int32u sender_id, 
+	int32u site_id, signed_message *mess ) {
+
   byte digest[DIGEST_SIZE];
 
     if ( sig_type == VAL_SIG_TYPE_SERVER ) {
+	if ( AUTH_Scheme( mess->type ) == AUTH_SCHEME_MAC ) {
+	    /* My entry of the sender's authenticator */
+	    return AUTH_Verify_Message( mess, sender_id, site_id );
+	}
+	if ( MERKLE_Is_Aggregated_Type( mess->type ) ) {
+	    /* The RSA signature is on the root of a Merkle tree */
+	    return MERKLE_Verify_Message( mess, sender_id, site_id );
+	}
 	/* Check an RSA signature using openssl. A server sent the message. */
 	return OPENSSL_RSA_Verify( 
 		 ((byte*)mess) + SIGNATURE_SIZE,
@@ -322,6 +482,59 @@ int32u VAL_Validate_Query_Message( query_message *query, int32u num_bytes ) {
     return 1;
 }
 
+/* Determine if a batch of updates is valid. A batch is one or more client
+ * updates, each a signed message with an update_message structure following
+ * it, stored back to back and filling exactly num_bytes. */
+int32u VAL_Validate_Update_Batch( byte *batch, int32u num_bytes, 
+	int32u verify_signature ) {
+
+    signed_message *update;
+    int32u offset, update_bytes, count;
+
+    offset = 0;
+    count = 0;
+
+    while ( offset < num_bytes ) {
+
+	if ( num_bytes - offset < (sizeof(signed_message)) ) {
+	    /* Safety check */
+	    VALIDATE_FAILURE("");	
+	    return 0;
+	}
+
+	update = (signed_message*)(batch + offset);
+
+	if ( update->len > num_bytes - offset - sizeof(signed_message) ) {
+	    VALIDATE_FAILURE("");	
+	    return 0;
+	}
+	
+	update_bytes = update->len + sizeof(signed_message);
+
+	if ( ! VAL_Validate_Signed_Message( update, update_bytes, 
+		    verify_signature ) ) {
+	    VALIDATE_FAILURE("");	
+	    return 0;
+	}
+
+	if ( ! VAL_Validate_Update( (update_message*)(update + 1), 
+		    update->len ) ) {
+	    VALIDATE_FAILURE("");	
+	    return 0;
+	}
+
+	offset += update_bytes;
+	count++;
+    }
+
+    if ( count < 1 || count > UPDATE_BATCH_MAX_COUNT ) {
+	VALIDATE_FAILURE("");	
+	return 0;
+    }
+
+    return 1;
+}
+
 /* Determine if a Pre-Prepare is valid */
 int32u VAL_Validate_Pre_Prepare( pre_prepare_message *pre_prepare,
        int32u num_bytes ) {
@@ -336,27 +549,13 @@ int32u VAL_Validate_Pre_Prepare( pre_prepare_message *pre_prepare,
 	return 0;
     }
 
-    /* An update follows -- this is just a signed message with an update_message
-     * structure following it. */
-    if ( ! VAL_Validate_Signed_Message( (signed_message*)(pre_prepare + 1),
+    /* A batch of updates follows -- each is just a signed message with an
+     * update_message structure following it. */
+    if ( ! VAL_Validate_Update_Batch( (byte*)(pre_prepare + 1),
 	       num_bytes - (sizeof(pre_prepare_message)), 1 ) ) {
 	VALIDATE_FAILURE("");	
 	return 0;
     }
- 
-    if ( num_bytes - (sizeof(pre_prepare_message)) < (sizeof(signed_message)) ) {
-	/* Safety check */
-	VALIDATE_FAILURE("");	
-	return 0;
-    }
-    
-    if ( ! VAL_Validate_Update( (update_message*)((byte*)(pre_prepare + 1) + 
-		sizeof(signed_message)),
-	       num_bytes - (sizeof(pre_prepare_message)) -
-	       (sizeof(signed_message))  ) ) {
-	VALIDATE_FAILURE("");	
-	return 0;
-    }
 
     return 1;
 }
@@ -497,6 +696,15 @@ int32u VAL_Validate_Sig_Share( sig_share_message *sig_share,
 	    Alarm(DEBUG,"%d %d DONE VALIDATE CCS_UNION SIG SHARE\n",
 		    VAR.My_Site_ID, VAR.My_Server_ID );
 	    return 1;
+	case CHECKPOINT_TYPE:
+	    if ( !VAL_Validate_Checkpoint( 
+		(checkpoint_message*)(content+1),
+		    num_bytes - sizeof(sig_share_message) - sizeof(signed_message) 
+		    ) ) { 
+		VALIDATE_FAILURE("");
+		return 0;
+	    }
+	    return 1;
 	default:
 	    /* The signature share is for an invalid type. */
 	    VALIDATE_FAILURE("");
@@ -518,27 +726,14 @@ int32u VAL_Validate_Proposal( proposal_message *proposal,
 	return 0;
     }
 
-    /* An update follows -- this is just a signed message with an update_message
-     * structure following it. */
-    if ( ! VAL_Validate_Signed_Message( (signed_message*)(proposal + 1),
+    /* A batch of updates follows -- each is just a signed message with an
+     * update_message structure following it. */
+    if ( ! VAL_Validate_Update_Batch( (byte*)(proposal + 1),
 	       num_bytes - (sizeof(proposal_message)), verify_signature ) ) {
 	VALIDATE_FAILURE("");
 	return 0;
     }
 
-    if ( num_bytes < (sizeof(proposal_message) + sizeof(signed_message)) ) {
-	/* Safety check */	
-	VALIDATE_FAILURE("");
-	return 0;
-    }
-    
-    if ( ! VAL_Validate_Update( (update_message*)((byte*)(proposal + 1)+sizeof(signed_message)),
-	       num_bytes - (sizeof(proposal_message)) - 
-	        (sizeof(signed_message))) ) {
-	VALIDATE_FAILURE("");
-	return 0;
-    }
-
     return 1;
 }
 
@@ -729,6 +924,61 @@ int32u VAL_Validate_Global_Reconciliation(
   return 1;
 }
 
+/* Determine if a Checkpoint message is valid */
+int32u VAL_Validate_Checkpoint( checkpoint_message *ckpt, int32u num_bytes ) {
+
+    if ( num_bytes != sizeof(checkpoint_message) ) {
+	VALIDATE_FAILURE("");
+	return 0;
+    }
+
+    /* Checkpoints are only taken at the interval */
+    if ( ckpt->seq_num == 0 || ckpt->seq_num % CHECKPOINT_INTERVAL != 0 ) {
+	VALIDATE_FAILURE("");
+	return 0;
+    }
+
+    return 1;
+}
+
+/* Determine if a Checkpoint Reply message is valid: it must carry a valid
+ * threshold signed checkpoint at or above the requested seq */
+int32u VAL_Validate_Checkpoint_Reply( checkpoint_reply_message *reply, 
+	int32u num_bytes ) {
+
+    signed_message *ckpt;
+
+    if ( num_bytes != sizeof(checkpoint_reply_message) + 
+	    sizeof(signed_message) + sizeof(checkpoint_message) ) {
+	VALIDATE_FAILURE("");
+	return 0;
+    }
+
+    ckpt = (signed_message*)(reply+1);
+    if ( ckpt->type != CHECKPOINT_TYPE ) {
+	VALIDATE_FAILURE("");
+	return 0;
+    }
+
+    if ( !VAL_Validate_Signed_Message( ckpt, 
+		num_bytes - sizeof(checkpoint_reply_message), 1 ) ) {
+	VALIDATE_FAILURE("");
+	return 0;
+    }
+
+    if ( !VAL_Validate_Checkpoint( (checkpoint_message*)(ckpt+1), 
+		ckpt->len ) ) {
+	return 0;
+    }
+
+    if ( ((checkpoint_message*)(ckpt+1))->seq_num < reply->seq_num ) {
+	VALIDATE_FAILURE("");
+	return 0;
+    }
+
+    return 1;
+}
+
 /* Determine if an ordered proof message is valid */
 int32u VAL_Validate_Ordered_Proof( ordered_proof_message *ordered_proof, 
 	int32u num_bytes ) {
@@ -938,11 +1188,27 @@ int32u VAL_Validate_CCS_Description_Message(ccs_description_message *description
 /* Determine if a message from the network is valid. */
 int32u VAL_Validate_Message( signed_message *message, int32u num_bytes ) {
 
+    return VAL_Validate_Message_Contents( message, num_bytes, 1 );
+}
+
+/* Determine if a message from the network is valid when its outer signature
+ * has already been checked (by a verifier thread). Signatures on messages
+ * carried inside it are still checked. */
+int32u VAL_Validate_Presigned_Message( signed_message *message, 
+	int32u num_bytes ) {
+
+    return VAL_Validate_Message_Contents( message, num_bytes, 0 );
+}
+
+int32u VAL_Validate_Message_Contents( signed_message *message, 
+	int32u num_bytes, int32u verify_signature ) {
+
     byte *content;
     int32u num_content_bytes;
 
     /* This is a signed message */
-    if ( ! VAL_Validate_Signed_Message( message, num_bytes, 1 ) ) {
+    if ( ! VAL_Validate_Signed_Message( message, num_bytes, 
+		verify_signature ) ) {
       Alarm(VALID_PRINT, "Validate signed message failed.\n");
 	VALIDATE_FAILURE_LOG(message,num_bytes);
  	return 0;
@@ -955,7 +1221,8 @@ int32u VAL_Validate_Message( signed_message *message, int32u num_bytes ) {
     }
     
     content = (byte*)(message + 1);
-    num_content_bytes = num_bytes - sizeof(signed_message); /* always >= 0 */
+    num_content_bytes = num_bytes - sizeof(signed_message) - 
+	MERKLE_Path_Bytes( message ); /* always >= 0 */
 
     switch (message->type) {
 	case PRE_PREPARE_TYPE:
@@ -1084,6 +1351,20 @@ int32u VAL_Validate_Message( signed_message *message, int32u num_bytes ) {
 	return 0;
       }
       break;
+    case CHECKPOINT_TYPE:
+	if ( !VAL_Validate_Checkpoint( (checkpoint_message*)(content),
+		   num_content_bytes ) ) {
+	    VALIDATE_FAILURE_LOG(message,num_bytes);
+	    return 0;
+	}
+	break;
+    case CHECKPOINT_REPLY_TYPE:
+	if ( !VAL_Validate_Checkpoint_Reply( 
+		   (checkpoint_reply_message*)(content), num_content_bytes ) ) {
+	    VALIDATE_FAILURE_LOG(message,num_bytes);
+	    return 0;
+	}
+	break;
 #if 0
        WE ARE NOT USING QUERIES FOR RED TEAM
     case QUERY_TYPE:
@@ -41,9 +41,22 @@
 #define VAL_SIG_TYPE_SITE      3
 #define VAL_SIG_TYPE_CLIENT    4
 
+/* Results of checking a packet signature off the event loop */
+#define VAL_SIG_INVALID        0
+#define VAL_SIG_VALID          1
+#define VAL_SIG_UNCHECKED      2  /* Left for the event loop to check */
+
 /* Validation Functions */
 
 /* Public */
 int32u VAL_Validate_Message( signed_message *message, int32u num_bytes ); 
 
+int32u VAL_Validate_Presigned_Message( signed_message *message, 
+	int32u num_bytes ); 
+
+int32u VAL_Validate_Signed_Message( signed_message *mess, int32u num_bytes, 
+       int32u verify_signature ); 
+
+int32u VAL_Check_Packet_Signature( signed_message *mess, int32u num_bytes ); 
+
 #endif 
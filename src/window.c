@@ -0,0 +1,206 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* Adaptive ordering windows. For each window, the representative keeps the
+ * smallest and a smoothed time from sending a Pre-Prepare (or putting a
+ * Proposal on the wide area) until the seq number is ordered. Once per window
+ * of ordered seq numbers (an epoch), the number of seq numbers that are
+ * queued rather than being worked on is estimated as
+ *
+ *     window * (1 - smallest_time / smoothed_time)
+ *
+ * The smallest time is taken over the last WIN_MIN_EPOCHS epochs only, so
+ * that it follows a lasting rise in the round trip time.
+ *
+ * If fewer than WIN_QUEUED_LOW are queued and the window kept me from
+ * sending, the window grows by one. If more than WIN_QUEUED_HIGH are queued,
+ * it shrinks by one. A retransmission halves it. */
+
+#include "data_structs.h"
+#include "window.h"
+#include "construct_collective_state_protocol.h"
+#include "util/alarm.h"
+#include <string.h>
+
+#define WIN_QUEUED_LOW   1.0
+#define WIN_QUEUED_HIGH  3.0
+#define WIN_MIN_EPOCHS   8
+
+typedef struct dummy_window_controller {
+    int32u *window;      /* The window being controlled */
+    int32u max;          /* Largest window allowed */
+    int32u adaptive;     /* Whether the window is adapted */
+    double min_time;     /* Smallest time to order a seq number */
+    double epoch_min[WIN_MIN_EPOCHS];  /* Smallest time in each of the last
+					  epochs, 0 if none */
+    int32u epoch;        /* Entry of epoch_min for the current epoch */
+    double time;         /* Smoothed time to order a seq number */
+    int32u samples;      /* Seq numbers ordered since the last adjustment */
+    int32u full;         /* The window kept me from sending since the last
+			    adjustment */
+} window_controller;
+
+extern server_variables VAR;
+
+window_controller win_controller[2];
+
+/* Local Functions */
+void WIN_Initialize_Controller( window_controller *wc, int32u *window,
+	int32u initial, int32u fixed, int32u max ); 
+void WIN_Adjust( window_controller *wc ); 
+
+void WIN_Initialize( int32u local_window, int32u global_window ) {
+
+    WIN_Initialize_Controller( &win_controller[PENDING_CONTEXT], 
+	    &VAR.Local_window, LOCAL_WINDOW, local_window, LOCAL_WINDOW_MAX );
+
+    WIN_Initialize_Controller( &win_controller[GLOBAL_CONTEXT], 
+	    &VAR.Global_window, GLOBAL_WINDOW, global_window, 
+	    GLOBAL_WINDOW_MAX );
+
+    Alarm(PRINT,"Local window %d%s, global window %d%s\n",
+	    VAR.Local_window, local_window == 0 ? " (adaptive)" : "",
+	    VAR.Global_window, global_window == 0 ? " (adaptive)" : "" );
+
+}
+
+void WIN_Initialize_Controller( window_controller *wc, int32u *window,
+	int32u initial, int32u fixed, int32u max ) {
+
+    wc->window   = window;
+    wc->max      = max;
+    wc->adaptive = ( fixed == 0 );
+    wc->min_time = 0;
+    memset( wc->epoch_min, 0, sizeof(wc->epoch_min) );
+    wc->epoch    = 0;
+    wc->time     = 0;
+    wc->samples  = 0;
+    wc->full     = 0;
+
+    *window = ( fixed == 0 ) ? initial : fixed;
+
+    if ( *window > max ) {
+	*window = max;
+    }
+
+}
+
+void WIN_Ordered( int32u context, sp_time sent ) {
+
+    window_controller *wc;
+    sp_time diff;
+    double elapsed;
+
+    wc = &win_controller[context];
+
+    if ( !wc->adaptive || ( sent.sec == 0 && sent.usec == 0 ) ) {
+	return;
+    }
+
+    diff = E_sub_time( E_get_time(), sent );
+    elapsed = diff.sec + diff.usec / 1000000.0;
+
+    if ( elapsed <= 0 ) {
+	return;
+    }
+
+    if ( wc->epoch_min[wc->epoch] == 0 || 
+	 elapsed < wc->epoch_min[wc->epoch] ) {
+	wc->epoch_min[wc->epoch] = elapsed;
+    }
+
+    if ( wc->time == 0 ) {
+	wc->time = elapsed;
+    } else {
+	wc->time = 0.875 * wc->time + 0.125 * elapsed;
+    }
+
+    wc->samples++;
+
+    if ( wc->samples >= *wc->window ) {
+	WIN_Adjust( wc );
+    }
+
+}
+
+void WIN_Adjust( window_controller *wc ) {
+
+    double queued;
+    int32u i;
+
+    wc->min_time = 0;
+    for ( i = 0; i < WIN_MIN_EPOCHS; i++ ) {
+	if ( wc->epoch_min[i] != 0 && 
+	     ( wc->min_time == 0 || wc->epoch_min[i] < wc->min_time ) ) {
+	    wc->min_time = wc->epoch_min[i];
+	}
+    }
+
+    queued = *wc->window * ( 1.0 - wc->min_time / wc->time );
+
+    if ( queued > WIN_QUEUED_HIGH && *wc->window > 1 ) {
+	(*wc->window)--;
+    } else if ( queued < WIN_QUEUED_LOW && wc->full && 
+		*wc->window < wc->max ) {
+	(*wc->window)++;
+    }
+
+    Alarm(ASEQ_PRINT,"Window %d queued %f time %f min %f\n",
+	    *wc->window, queued, wc->time, wc->min_time );
+
+    wc->samples = 0;
+    wc->full = 0;
+
+    /* Start a new epoch, forgetting the oldest one */
+    wc->epoch = ( wc->epoch + 1 ) % WIN_MIN_EPOCHS;
+    wc->epoch_min[wc->epoch] = 0;
+
+}
+
+void WIN_Window_Full( int32u context ) {
+
+    win_controller[context].full = 1;
+
+}
+
+void WIN_Retransmitted( int32u context ) {
+
+    window_controller *wc;
+
+    wc = &win_controller[context];
+
+    if ( !wc->adaptive ) {
+	return;
+    }
+
+    *wc->window = ( *wc->window + 1 ) / 2;
+    wc->samples = 0;
+    wc->full = 0;
+
+    Alarm(ASEQ_PRINT,"Retransmission, window %d\n", *wc->window );
+
+}
@@ -0,0 +1,52 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* Ordering windows. The representative of the leader site may have at most
+ * VAR.Local_window seq numbers above the pending aru and VAR.Global_window
+ * above the global aru in flight. Unless a window is fixed on the command
+ * line, it is adapted to the measured time that it takes to order a seq
+ * number, in the manner of TCP Vegas. */
+
+#ifndef WINDOW_D5XK2RW9MP3ZTB7QJ4NA
+#define WINDOW_D5XK2RW9MP3ZTB7QJ4NA
+
+#include "data_structs.h"
+
+/* A window value of 0 means the window is adapted */
+void WIN_Initialize( int32u local_window, int32u global_window ); 
+
+/* Report that a seq number that I sent at the given time was ordered. The
+ * context is PENDING_CONTEXT or GLOBAL_CONTEXT. */
+void WIN_Ordered( int32u context, sp_time sent ); 
+
+/* Report that the window kept me from sending */
+void WIN_Window_Full( int32u context ); 
+
+/* Report that I had to retransmit */
+void WIN_Retransmitted( int32u context ); 
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* Worker thread pools. The event loop submits messages into a ring of slots,
+ * which is a bounded queue with one producer and many consumers. Submitting
+ * fills the slot and then advances submit_seq; a worker claims the next slot
+ * by advancing claim_seq with a compare-and-swap, runs the work function, and
+ * marks the slot done. The event loop delivers finished slots strictly in
+ * submission order, so a slow job holds back the jobs behind it. A worker
+ * that finds the ring empty sleeps on a condition variable, and the event
+ * loop only takes the mutex to wake it when some worker is asleep, so a busy
+ * pool passes work without locks. */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <openssl/crypto.h>
+#include "worker_pool.h"
+#include "util/alarm.h"
+#include "util/sp_events.h"
+#include "util/memory.h"
+
+int32u wpool_crypto_locks_ready;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+pthread_mutex_t *wpool_crypto_locks;
+#endif
+
+/* Local Functions */
+void* WPOOL_Worker_Thread( void *pool ); 
+wpool_slot* WPOOL_Claim( worker_pool *pool ); 
+void WPOOL_Deliver( int fd, int dummy, void *pool ); 
+void WPOOL_Init_Crypto_Locks(); 
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/* OpenSSL before 1.1 is only thread safe with these callbacks installed. */
+void WPOOL_Crypto_Lock( int mode, int n, const char *file, int line ) {
+
+    if ( mode & CRYPTO_LOCK ) {
+	pthread_mutex_lock( &wpool_crypto_locks[n] );
+    } else {
+	pthread_mutex_unlock( &wpool_crypto_locks[n] );
+    }
+}
+
+void WPOOL_Crypto_Thread_Id( CRYPTO_THREADID *id ) {
+
+    CRYPTO_THREADID_set_numeric( id, (unsigned long)pthread_self() );
+}
+#endif
+
+void WPOOL_Init_Crypto_Locks() {
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    int i;
+
+    wpool_crypto_locks = (pthread_mutex_t*)
+	malloc( CRYPTO_num_locks() * sizeof(pthread_mutex_t) );
+    if ( wpool_crypto_locks == NULL ) {
+	Alarm(EXIT,"WPOOL_Init_Crypto_Locks: Could not allocate locks.\n");
+    }
+    for ( i = 0; i < CRYPTO_num_locks(); i++ ) {
+	pthread_mutex_init( &wpool_crypto_locks[i], NULL );
+    }
+    CRYPTO_THREADID_set_callback( WPOOL_Crypto_Thread_Id );
+    CRYPTO_set_locking_callback( WPOOL_Crypto_Lock );
+#endif
+}
+
+/* Start a pool of num_threads threads. work is called on a worker thread for
+ * each submitted message and returns a result; deliver is then called on the
+ * event loop for each message, in submission order, with that result. At
+ * most queue_size (a power of 2) messages can be outstanding. */
+worker_pool* WPOOL_Create( int32u num_threads, int32u queue_size,
+	int32u (* work)( signed_message *mess, int32u num_bytes ),
+	void (* deliver)( signed_message *mess, int32u num_bytes,
+	    int32u result ) ) {
+
+    worker_pool *pool;
+    int32u i;
+    pthread_t thread;
+
+    if ( queue_size == 0 || (queue_size & (queue_size - 1)) ) {
+	Alarm(EXIT,"WPOOL_Create: Queue size %d is not a power of 2.\n",
+		queue_size);
+    }
+
+    if ( !wpool_crypto_locks_ready ) {
+	WPOOL_Init_Crypto_Locks();
+	wpool_crypto_locks_ready = 1;
+    }
+
+    pool = (worker_pool*)malloc( sizeof(worker_pool) );
+    if ( pool == NULL ) {
+	Alarm(EXIT,"WPOOL_Create: Could not allocate pool.\n");
+    }
+    memset( pool, 0, sizeof(worker_pool) );
+
+    pool->slots = (wpool_slot*)malloc( queue_size * sizeof(wpool_slot) );
+    if ( pool->slots == NULL ) {
+	Alarm(EXIT,"WPOOL_Create: Could not allocate slots.\n");
+    }
+    memset( pool->slots, 0, queue_size * sizeof(wpool_slot) );
+
+    pool->queue_size = queue_size;
+    pool->work = work;
+    pool->deliver = deliver;
+
+    pthread_mutex_init( &pool->lock, NULL );
+    pthread_cond_init( &pool->work_ready, NULL );
+
+    pool->event_fd = eventfd( 0, EFD_NONBLOCK );
+    if ( pool->event_fd < 0 ) {
+	Alarm(EXIT,"WPOOL_Create: Could not create eventfd.\n");
+    }
+
+    E_attach_fd( pool->event_fd, READ_FD, WPOOL_Deliver, 0, pool, 
+	    MEDIUM_PRIORITY );
+
+    for ( i = 0; i < num_threads; i++ ) {
+	if ( pthread_create( &thread, NULL, WPOOL_Worker_Thread, pool ) ) {
+	    Alarm(EXIT,"WPOOL_Create: Could not start worker thread.\n");
+	}
+	pthread_detach( thread );
+    }
+
+    return pool;
+}
+
+int32u WPOOL_Is_Full( worker_pool *pool ) {
+
+    return ( pool->submit_seq - pool->deliver_seq == pool->queue_size );
+}
+
+/* The number of messages that can be submitted before the ring is full. */
+int32u WPOOL_Free_Slots( worker_pool *pool ) {
+
+    return ( pool->queue_size - (pool->submit_seq - pool->deliver_seq) );
+}
+
+/* Stop reading a receive socket until there is room in the ring again. */
+void WPOOL_Hold_Fd( worker_pool *pool, int fd ) {
+
+    int32u i;
+
+    for ( i = 0; i < pool->num_held_fds; i++ ) {
+	if ( pool->held_fds[i] == fd ) {
+	    return;
+	}
+    }
+
+    if ( pool->num_held_fds == WPOOL_MAX_HELD_FDS ) {
+	Alarm(EXIT,"WPOOL_Hold_Fd: Too many receive sockets.\n");
+    }
+
+    E_deactivate_fd( fd, READ_FD );
+    pool->held_fds[pool->num_held_fds++] = fd;
+}
+
+/* Hand a message to the worker threads. The pool takes over the caller's
+ * reference to the message. The caller must check WPOOL_Is_Full first. */
+void WPOOL_Submit( worker_pool *pool, signed_message *mess, 
+	int32u num_bytes ) {
+
+    wpool_slot *slot;
+
+    slot = &pool->slots[pool->submit_seq & (pool->queue_size - 1)];
+    slot->mess = mess;
+    slot->num_bytes = num_bytes;
+    slot->state = WPOOL_SLOT_QUEUED;
+
+    /* Publish the slot before the counter, and the counter before looking
+     * for sleepers (see WPOOL_Claim) */
+    __sync_synchronize();
+    pool->submit_seq++;
+    __sync_synchronize();
+
+    if ( pool->sleepers != 0 ) {
+	pthread_mutex_lock( &pool->lock );
+	pthread_cond_signal( &pool->work_ready );
+	pthread_mutex_unlock( &pool->lock );
+    }
+}
+
+/* Claim the next queued slot, sleeping while there is none. */
+wpool_slot* WPOOL_Claim( worker_pool *pool ) {
+
+    int32u seq;
+
+    while ( 1 ) {
+	seq = pool->claim_seq;
+	if ( seq != pool->submit_seq ) {
+	    if ( __sync_bool_compare_and_swap( &pool->claim_seq, seq, 
+			seq + 1 ) ) {
+		__sync_synchronize();
+		return &pool->slots[seq & (pool->queue_size - 1)];
+	    }
+	    continue;
+	}
+
+	/* Announce the sleeper before the last look at submit_seq, so that
+	 * WPOOL_Submit either sees it or we see the new message. */
+	pthread_mutex_lock( &pool->lock );
+	__sync_fetch_and_add( &pool->sleepers, 1 );
+	if ( pool->claim_seq == pool->submit_seq ) {
+	    pthread_cond_wait( &pool->work_ready, &pool->lock );
+	}
+	__sync_fetch_and_sub( &pool->sleepers, 1 );
+	pthread_mutex_unlock( &pool->lock );
+    }
+}
+
+void* WPOOL_Worker_Thread( void *p ) {
+
+    worker_pool *pool;
+    wpool_slot *slot;
+    uint64_t one;
+
+    pool = (worker_pool*)p;
+    one = 1;
+
+    while ( 1 ) {
+	slot = WPOOL_Claim( pool );
+
+	slot->result = pool->work( slot->mess, slot->num_bytes );
+
+	/* Publish the result before the state */
+	__sync_synchronize();
+	slot->state = WPOOL_SLOT_DONE;
+
+	if ( write( pool->event_fd, &one, sizeof(one) ) != sizeof(one) ) {
+	    /* The counter is already nonzero, so the loop will wake up. */
+	}
+    }
+
+    return NULL;
+}
+
+/* Called by the event system when worker threads have finished messages.
+ * Deliver every finished message at the head of the ring. */
+void WPOOL_Deliver( int fd, int dummy, void *p ) {
+
+    worker_pool *pool;
+    wpool_slot *slot;
+    uint64_t count;
+    int32u i;
+
+    pool = (worker_pool*)p;
+
+    if ( read( pool->event_fd, &count, sizeof(count) ) < 0 ) {
+	/* Nothing to clear */
+    }
+
+    while ( pool->deliver_seq != pool->submit_seq ) {
+	slot = &pool->slots[pool->deliver_seq & (pool->queue_size - 1)];
+	if ( slot->state != WPOOL_SLOT_DONE ) {
+	    break;
+	}
+	__sync_synchronize();
+
+	slot->state = WPOOL_SLOT_FREE;
+	pool->deliver_seq++;
+
+	pool->deliver( slot->mess, slot->num_bytes, slot->result );
+    }
+
+    /* There is room again, so resume reading held sockets. */
+    if ( pool->num_held_fds > 0 && !WPOOL_Is_Full( pool ) ) {
+	for ( i = 0; i < pool->num_held_fds; i++ ) {
+	    E_activate_fd( pool->held_fds[i], READ_FD );
+	}
+	pool->num_held_fds = 0;
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Steward.
+ *     
+ * The contents of this file are subject to the Steward Open-Source
+ * License, Version 1.0 (the ``License''); you may not use
+ * this file except in compliance with the License.  You may obtain a
+ * copy of the License at:
+ *
+ * http://www.dsn.jhu.edu/byzrep/steward/LICENSE.txt
+ *
+ * or in the file ``LICENSE.txt'' found in this distribution.
+ *
+ * Software distributed under the License is distributed on an AS IS basis, 
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License 
+ * for the specific language governing rights and limitations under the 
+ * License.
+ *
+ * The Creators of Steward are:
+ *  Yair Amir, Claudiu Danilov, Danny Dolev, Jonathan Kirsch, John Lane,
+ *  Cristina Nita-Rotaru, Josh Olsen, and David Zage.
+ *
+ * Copyright (c) 2005 - 2010 
+ * The Johns Hopkins University, Purdue University, The Hebrew University.
+ * All rights reserved.
+ *
+ */
+
+/* Worker thread pools. The event loop submits messages to a pool, whose
+ * threads run the pool's work function on them. The results are delivered
+ * back on the event loop, through an eventfd, in the order in which the
+ * messages were submitted. Work functions must not touch protocol state. */
+
+#ifndef WPOOL_R3MZ8QW2NX5KD7LA9PTE
+#define WPOOL_R3MZ8QW2NX5KD7LA9PTE 1
+
+#include <pthread.h>
+#include "data_structs.h"
+
+#define WPOOL_SLOT_FREE      0
+#define WPOOL_SLOT_QUEUED    1
+#define WPOOL_SLOT_DONE      2
+
+#define WPOOL_MAX_HELD_FDS   4
+
+typedef struct dummy_wpool_slot {
+    signed_message *mess;
+    int32u num_bytes;
+    int32u result;
+    volatile int32u state;
+} wpool_slot;
+
+typedef struct dummy_worker_pool {
+    wpool_slot *slots;
+    int32u queue_size;          /* Power of 2 */
+
+    /* Counters, only ever incremented. submit and deliver are only
+     * written by the event loop; workers claim with a compare-and-swap on
+     * claim_seq. */
+    volatile int32u submit_seq;
+    volatile int32u claim_seq;
+    int32u deliver_seq;
+
+    /* Only for putting idle workers to sleep and waking them */
+    volatile int32u sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t  work_ready;
+
+    int event_fd;
+
+    /* Receive sockets that were left unread because the ring was full */
+    int held_fds[WPOOL_MAX_HELD_FDS];
+    int32u num_held_fds;
+
+    int32u (* work)( signed_message *mess, int32u num_bytes );
+    void (* deliver)( signed_message *mess, int32u num_bytes, 
+	    int32u result );
+} worker_pool;
+
+/* Public functions */
+
+worker_pool* WPOOL_Create( int32u num_threads, int32u queue_size,
+	int32u (* work)( signed_message *mess, int32u num_bytes ),
+	void (* deliver)( signed_message *mess, int32u num_bytes,
+	    int32u result ) ); 
+
+int32u WPOOL_Is_Full( worker_pool *pool ); 
+
+int32u WPOOL_Free_Slots( worker_pool *pool ); 
+
+void WPOOL_Hold_Fd( worker_pool *pool, int fd ); 
+
+void WPOOL_Submit( worker_pool *pool, signed_message *mess, 
+	int32u num_bytes ); 
+
+#endif